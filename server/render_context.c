@@ -23,6 +23,23 @@ render_context_update_timeline(struct render_context *ctx,
       write_eventfd(ctx->fence_eventfd, 1);
 }
 
+static bool
+render_context_dispatch_get_command_stats(struct render_context *ctx,
+                                          const union render_context_op_request *request,
+                                          UNUSED const int *fds,
+                                          UNUSED int fd_count)
+{
+   const struct render_context_op_get_command_stats_request *req =
+      &request->get_command_stats;
+
+   struct render_context_op_get_command_stats_reply reply;
+   memset(&reply, 0, sizeof(reply));
+   reply.count = render_state_get_command_stats(
+      ctx->ctx_id, reply.stats, MIN2(req->max_count, ARRAY_SIZE(reply.stats)));
+
+   return render_socket_send_reply(&ctx->socket, &reply, sizeof(reply));
+}
+
 static bool
 render_context_dispatch_submit_fence(struct render_context *ctx,
                                      const union render_context_op_request *request,
@@ -117,7 +134,8 @@ render_context_dispatch_create_resource(struct render_context *ctx,
    int res_fd;
    bool ok = render_state_create_resource(ctx->ctx_id, req->res_id, req->blob_id,
                                           req->blob_size, req->blob_flags, &reply.fd_type,
-                                          &res_fd, &reply.map_info, &reply.vulkan_info);
+                                          &res_fd, &reply.map_info, &reply.map_offset,
+                                          &reply.suballocated, &reply.vulkan_info);
    if (!ok)
       return render_socket_send_reply(&ctx->socket, &reply, sizeof(reply));
 
@@ -198,6 +216,7 @@ static const struct render_context_dispatch_entry
       RENDER_CONTEXT_DISPATCH(DESTROY_RESOURCE, destroy_resource, 0),
       RENDER_CONTEXT_DISPATCH(SUBMIT_CMD, submit_cmd, 0),
       RENDER_CONTEXT_DISPATCH(SUBMIT_FENCE, submit_fence, 0),
+      RENDER_CONTEXT_DISPATCH(GET_COMMAND_STATS, get_command_stats, 0),
 #undef RENDER_CONTEXT_DISPATCH
    };
 
@@ -9,6 +9,7 @@
 #include <stdint.h>
 
 #include "virgl_resource.h"
+#include "virglrenderer.h"
 
 /* this covers the command line options and the socket type */
 #define RENDER_SERVER_VERSION 0
@@ -39,6 +40,7 @@ enum render_context_op {
    RENDER_CONTEXT_OP_DESTROY_RESOURCE,
    RENDER_CONTEXT_OP_SUBMIT_CMD,
    RENDER_CONTEXT_OP_SUBMIT_FENCE,
+   RENDER_CONTEXT_OP_GET_COMMAND_STATS,
 
    RENDER_CONTEXT_OP_COUNT,
 };
@@ -148,6 +150,10 @@ struct render_context_op_create_resource_request {
 struct render_context_op_create_resource_reply {
    enum virgl_resource_fd_type fd_type;
    uint32_t map_info; /* VIRGL_RENDERER_MAP_* */
+   /* offset of the blob in the fd, for blobs suballocated from larger fds */
+   uint64_t map_offset;
+   /* the fd refers to more than the blob and must not be shared */
+   bool suballocated;
    /* vulkan_info is set if the fd_type is VIRGL_RESOURCE_FD_OPAQUE */
    struct virgl_resource_vulkan_info vulkan_info;
    /* followed by 1 fd if not VIRGL_RESOURCE_FD_INVALID */
@@ -212,6 +218,25 @@ struct render_context_op_submit_fence_request {
    uint32_t seqno;
 };
 
+/* Get the per-command counters of the context.
+ *
+ * Only the most expensive commands are returned such that the reply fits in
+ * one page.
+ *
+ * This roughly corresponds to virgl_renderer_context_get_command_stats.
+ */
+struct render_context_op_get_command_stats_request {
+   struct render_context_op_header header;
+   uint32_t max_count;
+};
+
+#define RENDER_CONTEXT_COMMAND_STAT_MAX_COUNT 32
+
+struct render_context_op_get_command_stats_reply {
+   uint32_t count;
+   struct virgl_renderer_command_stat stats[RENDER_CONTEXT_COMMAND_STAT_MAX_COUNT];
+};
+
 union render_context_op_request {
    struct render_context_op_header header;
    struct render_context_op_nop_request nop;
@@ -221,6 +246,7 @@ union render_context_op_request {
    struct render_context_op_destroy_resource_request destroy_resource;
    struct render_context_op_submit_cmd_request submit_cmd;
    struct render_context_op_submit_fence_request submit_fence;
+   struct render_context_op_get_command_stats_request get_command_stats;
 };
 
 #endif /* RENDER_PROTOCOL_H */
@@ -0,0 +1,403 @@
+/*
+ * Copyright 2026 agent
+ * SPDX-License-Identifier: MIT
+ */
+
+/* virgl_render_replay feeds a capture file recorded with VKR_CAPTURE back to
+ * vkr and reports where the time is spent, split into the time spent in
+ * decoding and object tracking and the time spent in driver calls.  No guest
+ * is needed.
+ *
+ * Resources imported by the guest are replaced by shm resources of the same
+ * size.  Only the command streams executed by vkExecuteCommandStreamsMESA are
+ * written back to resources; other resource contents are not captured.  In
+ * particular, the driver replays submits without the data the guest wrote to
+ * mapped memory, so the driver times only hint at the real ones.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "util/list.h"
+#include "util/macros.h"
+
+#include "vkr_capture.h"
+#include "vkr_renderer.h"
+
+struct render_replay_resource {
+   uint32_t ctx_id;
+   uint32_t res_id;
+
+   void *ptr;
+   size_t size;
+
+   struct list_head head;
+};
+
+struct render_replay_stat {
+   const char *name;
+   uint64_t count;
+   uint64_t bytes;
+   uint64_t ns;
+};
+
+static struct {
+   struct list_head resources;
+
+   uint64_t retired_fences;
+
+   struct render_replay_stat stats[VKR_CAPTURE_RECORD_RESOURCE_DESTROY + 1];
+
+   /* indexed by VkCommandTypeEXT; collected from destroyed contexts */
+   struct virgl_renderer_command_stat commands[256];
+} replay = {
+   .stats = {
+      [VKR_CAPTURE_RECORD_CONTEXT_CREATE] = { .name = "context create" },
+      [VKR_CAPTURE_RECORD_CONTEXT_DESTROY] = { .name = "context destroy" },
+      [VKR_CAPTURE_RECORD_CMD] = { .name = "cmd" },
+      [VKR_CAPTURE_RECORD_STREAM] = { .name = "stream" },
+      [VKR_CAPTURE_RECORD_FENCE] = { .name = "fence" },
+      [VKR_CAPTURE_RECORD_RESOURCE_CREATE] = { .name = "resource create" },
+      [VKR_CAPTURE_RECORD_RESOURCE_IMPORT] = { .name = "resource import" },
+      [VKR_CAPTURE_RECORD_RESOURCE_DESTROY] = { .name = "resource destroy" },
+   },
+};
+
+static uint64_t
+render_replay_now(void)
+{
+   const uint64_t ns_per_sec = 1000000000llu;
+   struct timespec now;
+   if (clock_gettime(CLOCK_MONOTONIC, &now))
+      return 0;
+   return ns_per_sec * now.tv_sec + now.tv_nsec;
+}
+
+static void
+render_replay_cb_debug_logger(const char *fmt, va_list ap)
+{
+   vfprintf(stderr, fmt, ap);
+}
+
+static void
+render_replay_cb_retire_fence(UNUSED uint32_t ctx_id,
+                              UNUSED uint32_t ring_idx,
+                              UNUSED uint64_t fence_id)
+{
+   /* this is called from other threads */
+   __atomic_fetch_add(&replay.retired_fences, 1, __ATOMIC_RELAXED);
+}
+
+static const struct vkr_renderer_callbacks render_replay_cbs = {
+   .debug_logger = render_replay_cb_debug_logger,
+   .retire_fence = render_replay_cb_retire_fence,
+};
+
+static struct render_replay_resource *
+render_replay_lookup_resource(uint32_t ctx_id, uint32_t res_id)
+{
+   list_for_each_entry (struct render_replay_resource, res, &replay.resources, head) {
+      if (res->ctx_id == ctx_id && res->res_id == res_id)
+         return res;
+   }
+   return NULL;
+}
+
+static void
+render_replay_collect_command_stats(uint32_t ctx_id)
+{
+   struct virgl_renderer_command_stat stats[ARRAY_SIZE(replay.commands)];
+   const uint32_t count =
+      vkr_renderer_get_command_stats(ctx_id, stats, ARRAY_SIZE(stats));
+
+   for (uint32_t i = 0; i < count; i++) {
+      if (stats[i].command_type >= ARRAY_SIZE(replay.commands))
+         continue;
+
+      struct virgl_renderer_command_stat *cmd = &replay.commands[stats[i].command_type];
+      if (!cmd->count)
+         memcpy(cmd->name, stats[i].name, sizeof(cmd->name));
+      cmd->count += stats[i].count;
+      cmd->bytes += stats[i].bytes;
+      cmd->ns += stats[i].ns;
+      cmd->driver_ns += stats[i].driver_ns;
+   }
+}
+
+static void
+render_replay_destroy_resource(struct render_replay_resource *res)
+{
+   vkr_renderer_destroy_resource(res->ctx_id, res->res_id);
+
+   if (res->ptr)
+      munmap(res->ptr, res->size);
+   list_del(&res->head);
+   free(res);
+}
+
+static bool
+render_replay_create_resource(uint32_t ctx_id,
+                              const struct vkr_capture_resource *info,
+                              bool import)
+{
+   struct render_replay_resource *res = calloc(1, sizeof(*res));
+   if (!res)
+      return false;
+
+   /* imported resources are replaced by shm */
+   const uint64_t blob_id = import ? 0 : info->blob_id;
+   const uint32_t blob_flags = import ? VIRGL_RENDERER_BLOB_FLAG_USE_MAPPABLE
+                                      : info->blob_flags;
+
+   enum virgl_resource_fd_type fd_type;
+   int fd;
+   uint32_t map_info;
+   uint64_t map_offset;
+   bool suballocated;
+   struct virgl_resource_vulkan_info vulkan_info;
+   if (!vkr_renderer_create_resource(ctx_id, info->res_id, blob_id, info->blob_size,
+                                     blob_flags, &fd_type, &fd, &map_info, &map_offset,
+                                     &suballocated, &vulkan_info)) {
+      free(res);
+      return false;
+   }
+
+   res->ctx_id = ctx_id;
+   res->res_id = info->res_id;
+   res->size = info->blob_size;
+
+   /* only needed for streams; mapping might fail for device memory */
+   if (fd_type == VIRGL_RESOURCE_FD_SHM || fd_type == VIRGL_RESOURCE_FD_DMABUF) {
+      res->ptr =
+         mmap(NULL, res->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, map_offset);
+      if (res->ptr == MAP_FAILED)
+         res->ptr = NULL;
+   }
+   close(fd);
+
+   list_addtail(&res->head, &replay.resources);
+
+   return true;
+}
+
+static bool
+render_replay_write_stream(uint32_t ctx_id, const void *payload, size_t size)
+{
+   const struct vkr_capture_stream *info = payload;
+   if (size < sizeof(*info))
+      return false;
+
+   const size_t stream_size = size - sizeof(*info);
+   struct render_replay_resource *res =
+      render_replay_lookup_resource(ctx_id, info->res_id);
+   if (!res || !res->ptr || info->offset > res->size ||
+       stream_size > res->size - info->offset)
+      return false;
+
+   memcpy((uint8_t *)res->ptr + info->offset, info + 1, stream_size);
+
+   return true;
+}
+
+static bool
+render_replay_record(const struct vkr_capture_record *record, void *payload)
+{
+   const uint32_t ctx_id = record->ctx_id;
+   const size_t size = record->size;
+
+   switch (record->type) {
+   case VKR_CAPTURE_RECORD_CONTEXT_CREATE: {
+      const struct vkr_capture_context *info = payload;
+      if (size < sizeof(*info) || info->name_len > size - sizeof(*info))
+         return false;
+      return vkr_renderer_create_context(ctx_id, info->ctx_flags, info->name_len,
+                                         (const char *)(info + 1));
+   }
+   case VKR_CAPTURE_RECORD_CONTEXT_DESTROY:
+      list_for_each_entry_safe (struct render_replay_resource, res, &replay.resources,
+                                head) {
+         if (res->ctx_id == ctx_id)
+            render_replay_destroy_resource(res);
+      }
+      render_replay_collect_command_stats(ctx_id);
+      vkr_renderer_destroy_context(ctx_id);
+      return true;
+   case VKR_CAPTURE_RECORD_CMD:
+      return vkr_renderer_submit_cmd(ctx_id, payload, size);
+   case VKR_CAPTURE_RECORD_STREAM:
+      return render_replay_write_stream(ctx_id, payload, size);
+   case VKR_CAPTURE_RECORD_FENCE: {
+      const struct vkr_capture_fence *info = payload;
+      if (size < sizeof(*info))
+         return false;
+      return vkr_renderer_submit_fence(ctx_id, info->flags, info->ring_idx,
+                                       info->fence_id);
+   }
+   case VKR_CAPTURE_RECORD_RESOURCE_CREATE:
+   case VKR_CAPTURE_RECORD_RESOURCE_IMPORT: {
+      const struct vkr_capture_resource *info = payload;
+      if (size < sizeof(*info))
+         return false;
+      return render_replay_create_resource(
+         ctx_id, info, record->type == VKR_CAPTURE_RECORD_RESOURCE_IMPORT);
+   }
+   case VKR_CAPTURE_RECORD_RESOURCE_DESTROY: {
+      const struct vkr_capture_resource *info = payload;
+      if (size < sizeof(*info))
+         return false;
+      struct render_replay_resource *res =
+         render_replay_lookup_resource(ctx_id, info->res_id);
+      if (!res)
+         return false;
+      render_replay_destroy_resource(res);
+      return true;
+   }
+   default:
+      return false;
+   }
+}
+
+static bool
+render_replay_file(FILE *file)
+{
+   struct vkr_capture_header header;
+   if (fread(&header, sizeof(header), 1, file) != 1 ||
+       header.magic != VKR_CAPTURE_MAGIC || header.version != VKR_CAPTURE_VERSION) {
+      fprintf(stderr, "not a vkr capture file\n");
+      return false;
+   }
+
+   void *payload = NULL;
+   size_t payload_size = 0;
+   uint64_t record_count = 0;
+   bool ok = true;
+
+   struct vkr_capture_record record;
+   while (fread(&record, sizeof(record), 1, file) == 1) {
+      if (record.size > payload_size) {
+         void *tmp = realloc(payload, record.size);
+         if (!tmp) {
+            ok = false;
+            break;
+         }
+         payload = tmp;
+         payload_size = record.size;
+      }
+      if (record.size && fread(payload, record.size, 1, file) != 1) {
+         fprintf(stderr, "truncated record %" PRIu64 "\n", record_count);
+         ok = false;
+         break;
+      }
+
+      const uint64_t begin = render_replay_now();
+      const bool replayed = render_replay_record(&record, payload);
+      const uint64_t end = render_replay_now();
+
+      if (!replayed) {
+         fprintf(stderr, "failed to replay record %" PRIu64 " (type %u, ctx %u)\n",
+                 record_count, record.type, record.ctx_id);
+      }
+
+      if (record.type < ARRAY_SIZE(replay.stats) && replay.stats[record.type].name) {
+         struct render_replay_stat *stat = &replay.stats[record.type];
+         stat->count++;
+         stat->bytes += record.size;
+         stat->ns += end - begin;
+      }
+
+      record_count++;
+   }
+
+   free(payload);
+
+   return ok;
+}
+
+static void
+render_replay_report(uint64_t total_ns)
+{
+   printf("%-18s %10s %14s %14s\n", "record", "count", "bytes", "time (us)");
+   for (uint32_t i = 0; i < ARRAY_SIZE(replay.stats); i++) {
+      const struct render_replay_stat *stat = &replay.stats[i];
+      if (!stat->name || !stat->count)
+         continue;
+      printf("%-18s %10" PRIu64 " %14" PRIu64 " %14" PRIu64 "\n", stat->name,
+             stat->count, stat->bytes, stat->ns / 1000);
+   }
+
+   bool has_commands = false;
+   for (uint32_t i = 0; i < ARRAY_SIZE(replay.commands); i++) {
+      const struct virgl_renderer_command_stat *cmd = &replay.commands[i];
+      if (!cmd->count)
+         continue;
+
+      if (!has_commands) {
+         printf("\n%-48s %10s %14s %14s %14s\n", "command", "count", "bytes",
+                "decode (us)", "driver (us)");
+         has_commands = true;
+      }
+      printf("%-48s %10" PRIu64 " %14" PRIu64 " %14" PRIu64 " %14" PRIu64 "\n", cmd->name,
+             cmd->count, cmd->bytes, (cmd->ns - cmd->driver_ns) / 1000,
+             cmd->driver_ns / 1000);
+   }
+   if (has_commands) {
+      printf("\nnote: guest writes to mapped memory are not captured; the driver times "
+             "are not representative of the guest workload\n\n");
+   }
+
+   printf("retired fences: %" PRIu64 "\n",
+          __atomic_load_n(&replay.retired_fences, __ATOMIC_RELAXED));
+   printf("total: %" PRIu64 " us\n", total_ns / 1000);
+}
+
+int
+main(int argc, char **argv)
+{
+   if (argc != 2) {
+      fprintf(stderr, "usage: %s <capture file>\n", argv[0]);
+      return -1;
+   }
+
+   FILE *file = fopen(argv[1], "rb");
+   if (!file) {
+      fprintf(stderr, "failed to open %s: %s\n", argv[1], strerror(errno));
+      return -1;
+   }
+
+   list_inithead(&replay.resources);
+
+   /* per-command counters are reported unless VKR_DEBUG is set explicitly */
+   setenv("VKR_DEBUG", "command_stats", 0);
+
+   static const uint32_t vkr_flags =
+      VKR_RENDERER_THREAD_SYNC | VKR_RENDERER_ASYNC_FENCE_CB;
+   if (!vkr_renderer_init(vkr_flags, &render_replay_cbs)) {
+      fclose(file);
+      return -1;
+   }
+
+   const uint64_t begin = render_replay_now();
+   const bool ok = render_replay_file(file);
+
+   list_for_each_entry_safe (struct render_replay_resource, res, &replay.resources, head)
+      render_replay_destroy_resource(res);
+
+   /* this waits for the devices to idle */
+   vkr_renderer_fini();
+   const uint64_t end = render_replay_now();
+
+   fclose(file);
+
+   render_replay_report(end - begin);
+
+   return ok ? 0 : -1;
+}
@@ -213,6 +213,15 @@ render_state_submit_fence(uint32_t ctx_id,
    return vkr_renderer_submit_fence(ctx_id, flags, ring_idx, fence_id);
 }
 
+uint32_t
+render_state_get_command_stats(uint32_t ctx_id,
+                               struct virgl_renderer_command_stat *stats,
+                               uint32_t max_count)
+{
+   SCOPE_LOCK_RENDERER();
+   return vkr_renderer_get_command_stats(ctx_id, stats, max_count);
+}
+
 bool
 render_state_create_resource(uint32_t ctx_id,
                              uint32_t res_id,
@@ -222,11 +231,14 @@ render_state_create_resource(uint32_t ctx_id,
                              enum virgl_resource_fd_type *out_fd_type,
                              int *out_res_fd,
                              uint32_t *out_map_info,
+                             uint64_t *out_map_offset,
+                             bool *out_suballocated,
                              struct virgl_resource_vulkan_info *out_vulkan_info)
 {
    SCOPE_LOCK_RENDERER();
    return vkr_renderer_create_resource(ctx_id, res_id, blob_id, blob_size, blob_flags,
                                        out_fd_type, out_res_fd, out_map_info,
+                                       out_map_offset, out_suballocated,
                                        out_vulkan_info);
 }
 
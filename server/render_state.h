@@ -32,6 +32,11 @@ render_state_submit_fence(uint32_t ctx_id,
                           uint64_t ring_idx,
                           uint64_t fence_id);
 
+uint32_t
+render_state_get_command_stats(uint32_t ctx_id,
+                               struct virgl_renderer_command_stat *stats,
+                               uint32_t max_count);
+
 bool
 render_state_create_resource(uint32_t ctx_id,
                              uint32_t res_id,
@@ -41,6 +46,8 @@ render_state_create_resource(uint32_t ctx_id,
                              enum virgl_resource_fd_type *out_fd_type,
                              int *out_res_fd,
                              uint32_t *out_map_info,
+                             uint64_t *out_map_offset,
+                             bool *out_suballocated,
                              struct virgl_resource_vulkan_info *out_vulkan_info);
 
 bool
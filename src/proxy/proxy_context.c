@@ -306,6 +306,34 @@ proxy_context_submit_cmd(struct virgl_context *base, const void *buffer, size_t
    return reply.ok ? 0 : -1;
 }
 
+static int
+proxy_context_get_command_stats(struct virgl_context *base,
+                                struct virgl_renderer_command_stat *stats,
+                                uint32_t *count)
+{
+   struct proxy_context *ctx = (struct proxy_context *)base;
+
+   const struct render_context_op_get_command_stats_request req = {
+      .header.op = RENDER_CONTEXT_OP_GET_COMMAND_STATS,
+      .max_count = MIN2(*count, RENDER_CONTEXT_COMMAND_STAT_MAX_COUNT),
+   };
+   if (!proxy_socket_send_request(&ctx->socket, &req, sizeof(req))) {
+      proxy_log("failed to get command stats");
+      return -1;
+   }
+
+   struct render_context_op_get_command_stats_reply reply;
+   if (!proxy_socket_receive_reply(&ctx->socket, &reply, sizeof(reply))) {
+      proxy_log("failed to get command stats reply");
+      return -1;
+   }
+
+   *count = MIN2(reply.count, req.max_count);
+   memcpy(stats, reply.stats, sizeof(*stats) * *count);
+
+   return 0;
+}
+
 static bool
 validate_resource_fd_shm(int fd, uint64_t expected_size)
 {
@@ -400,6 +428,8 @@ proxy_context_get_blob(struct virgl_context *base,
    blob->type = reply.fd_type;
    blob->u.fd = reply_fd;
    blob->map_info = reply.map_info;
+   blob->map_offset = reply.map_offset;
+   blob->suballocated = reply.suballocated;
 
    if (reply.fd_type == VIRGL_RESOURCE_FD_OPAQUE)
       blob->vulkan_info = reply.vulkan_info;
@@ -451,6 +481,12 @@ proxy_context_attach_resource(struct virgl_context *base, struct virgl_resource
    if (proxy_context_resource_find(ctx, res_id))
       return;
 
+   /* the fd of a suballocated resource refers to more than the resource */
+   if (res->suballocated) {
+      proxy_log("cannot attach suballocated res %d", res_id);
+      return;
+   }
+
    /* The current render protocol only supports importing dma-buf or pipe resource that
     * can be exported to dma-buf. A protocol change is needed when there exists use case
     * for importing external Vulkan opaque resource. For shm, we only create with blob_id
@@ -555,6 +591,8 @@ proxy_context_init_base(struct proxy_context *ctx)
    ctx->base.get_fencing_fd = proxy_context_get_fencing_fd;
    ctx->base.retire_fences = proxy_context_retire_fences;
    ctx->base.submit_fence = proxy_context_submit_fence;
+
+   ctx->base.get_command_stats = proxy_context_get_command_stats;
 }
 
 static bool
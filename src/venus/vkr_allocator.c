@@ -29,66 +29,128 @@
 #include <string.h>
 #include <unistd.h>
 
-#include "util/list.h"
+#include "util/hash_table.h"
+#include "util/u_math.h"
 #include "venus-protocol/vulkan.h"
 #include "virgl_resource.h"
+#include "virgl_util.h"
 
-/* Assume that we will deal with at most 4 devices.
- *  This is to avoid per-device resource dynamic allocations.
- *  For now, `vkr_allocator` is designed for Mesa CI use which
- *  uses lavapipe as the only Vulkan driver, but allow logic to
- *  assume more for some leeway and felxibilty; especially if
- *  this allocator is expanded to use whatever devices available.
+/* mapped memories are counted by power-of-two size classes, from 4KB or
+ * less to 4GB or more
  */
-#define VKR_ALLOCATOR_MAX_DEVICE_COUNT 4
+#define VKR_ALLOCATOR_SIZE_CLASS_COUNT 21
 
-struct vkr_opaque_fd_mem_info {
+struct vkr_allocator_stats {
+   uint64_t map_count;
+   uint64_t map_failure_count;
+   uint64_t size_class_map_counts[VKR_ALLOCATOR_SIZE_CLASS_COUNT];
+
+   uint32_t mapped_count;
+   uint64_t mapped_size;
+   uint64_t mapped_peak_size;
+};
+
+struct vkr_allocator_device {
+   VkPhysicalDevice physical_device;
+   uint8_t device_uuid[VK_UUID_SIZE];
+
+   /* created when a resource of the device is first mapped */
    VkDevice device;
+   bool device_failed;
+
+   struct vkr_allocator_stats stats;
+};
+
+struct vkr_opaque_fd_mem_info {
+   struct vkr_allocator_device *device;
    VkDeviceMemory device_memory;
    uint32_t res_id;
    uint64_t size;
-
-   struct list_head head;
 };
 
 static struct vkr_allocator {
    VkInstance instance;
 
-   VkPhysicalDevice physical_devices[VKR_ALLOCATOR_MAX_DEVICE_COUNT];
-   VkDevice devices[VKR_ALLOCATOR_MAX_DEVICE_COUNT];
-   uint8_t device_uuids[VKR_ALLOCATOR_MAX_DEVICE_COUNT][VK_UUID_SIZE];
+   struct vkr_allocator_device *devices;
    uint32_t device_count;
 
-   struct list_head memories;
+   /* vkr_opaque_fd_mem_info keyed by res_id */
+   struct hash_table *memories;
 } vkr_allocator;
 
 static bool vkr_allocator_initialized;
 
+static uint32_t
+vkr_allocator_get_size_class(uint64_t size)
+{
+   const uint32_t min_order = 12;
+   const uint32_t order = size > 1 ? util_logbase2_64(size - 1) + 1 : 0;
+   return CLAMP(order, min_order, min_order + VKR_ALLOCATOR_SIZE_CLASS_COUNT - 1) -
+          min_order;
+}
+
 static void
 vkr_allocator_free_memory(struct vkr_opaque_fd_mem_info *mem_info)
 {
-   vkFreeMemory(mem_info->device, mem_info->device_memory, NULL);
-   list_del(&mem_info->head);
+   struct vkr_allocator_device *dev = mem_info->device;
+
+   vkFreeMemory(dev->device, mem_info->device_memory, NULL);
+
+   dev->stats.mapped_count--;
+   dev->stats.mapped_size -= mem_info->size;
+
    free(mem_info);
 }
 
-static VkDevice
+static VkResult
+vkr_allocator_create_device(struct vkr_allocator_device *dev)
+{
+   float priority = 1.0;
+   VkDeviceQueueCreateInfo queue_info = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+      /* Use any queue since we dont really need it.
+       * We are guaranteed at least one by the spec */
+      .queueFamilyIndex = 0,
+      .queueCount = 1,
+      .pQueuePriorities = &priority
+   };
+
+   VkDeviceCreateInfo dev_info = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+      .queueCreateInfoCount = 1,
+      .pQueueCreateInfos = &queue_info,
+   };
+
+   return vkCreateDevice(dev->physical_device, &dev_info, NULL, &dev->device);
+}
+
+static struct vkr_allocator_device *
 vkr_allocator_get_device(struct virgl_resource *res)
 {
    for (uint32_t i = 0; i < vkr_allocator.device_count; ++i) {
-      if (memcmp(vkr_allocator.device_uuids[i], res->vulkan_info.device_uuid,
-                 VK_UUID_SIZE) == 0)
-         return vkr_allocator.devices[i];
+      struct vkr_allocator_device *dev = &vkr_allocator.devices[i];
+      if (memcmp(dev->device_uuid, res->vulkan_info.device_uuid, VK_UUID_SIZE))
+         continue;
+
+      if (dev->device == VK_NULL_HANDLE && !dev->device_failed) {
+         const VkResult result = vkr_allocator_create_device(dev);
+         if (result != VK_SUCCESS) {
+            virgl_log("vkr_allocator: failed to create device %u (%d)\n", i, result);
+            dev->device_failed = true;
+         }
+      }
+
+      return dev->device != VK_NULL_HANDLE ? dev : NULL;
    }
 
-   return VK_NULL_HANDLE;
+   return NULL;
 }
 
 static struct vkr_opaque_fd_mem_info *
 vkr_allocator_allocate_memory(struct virgl_resource *res)
 {
-   VkDevice dev_handle = vkr_allocator_get_device(res);
-   if (dev_handle == VK_NULL_HANDLE)
+   struct vkr_allocator_device *dev = vkr_allocator_get_device(res);
+   if (!dev)
       return NULL;
 
    int fd = -1;
@@ -110,43 +172,82 @@ vkr_allocator_allocate_memory(struct virgl_resource *res)
    };
 
    VkDeviceMemory mem_handle;
-   if (vkAllocateMemory(dev_handle, &alloc_info, NULL, &mem_handle) != VK_SUCCESS) {
+   if (vkAllocateMemory(dev->device, &alloc_info, NULL, &mem_handle) != VK_SUCCESS) {
       close(fd);
       return NULL;
    }
 
    struct vkr_opaque_fd_mem_info *mem_info = calloc(1, sizeof(*mem_info));
    if (!mem_info) {
-      vkFreeMemory(dev_handle, mem_handle, NULL);
+      vkFreeMemory(dev->device, mem_handle, NULL);
       return NULL;
    }
 
-   mem_info->device = dev_handle;
+   mem_info->device = dev;
    mem_info->device_memory = mem_handle;
    mem_info->res_id = res->res_id;
    mem_info->size = res->vulkan_info.allocation_size;
 
-   list_addtail(&mem_info->head, &vkr_allocator.memories);
+   struct vkr_allocator_stats *stats = &dev->stats;
+   stats->mapped_count++;
+   stats->mapped_size += mem_info->size;
+   stats->mapped_peak_size = MAX2(stats->mapped_peak_size, stats->mapped_size);
 
    return mem_info;
 }
 
-void
-vkr_allocator_fini(void)
+static void
+vkr_allocator_log_stats(void)
 {
-   if (!vkr_allocator_initialized)
-      return;
+   for (uint32_t i = 0; i < vkr_allocator.device_count; ++i) {
+      const struct vkr_allocator_stats *stats = &vkr_allocator.devices[i].stats;
+      if (!stats->map_count && !stats->map_failure_count)
+         continue;
+
+      virgl_log("vkr_allocator: device %u: %" PRIu64 " maps, %" PRIu64
+                " failures, peak %" PRIu64 " bytes\n",
+                i, stats->map_count, stats->map_failure_count, stats->mapped_peak_size);
+      for (uint32_t j = 0; j < VKR_ALLOCATOR_SIZE_CLASS_COUNT; j++) {
+         if (stats->size_class_map_counts[j]) {
+            virgl_log("vkr_allocator:   <= %" PRIu64 " bytes: %" PRIu64 " maps\n",
+                      (uint64_t)4096 << j, stats->size_class_map_counts[j]);
+         }
+      }
+   }
+}
 
-   struct vkr_opaque_fd_mem_info *mem_info, *mem_info_temp;
-   LIST_FOR_EACH_ENTRY_SAFE (mem_info, mem_info_temp, &vkr_allocator.memories, head)
-      vkr_allocator_free_memory(mem_info);
+static void
+vkr_allocator_free_memory_entry(struct hash_entry *entry)
+{
+   vkr_allocator_free_memory(entry->data);
+}
+
+static void
+vkr_allocator_destroy(void)
+{
+   if (vkr_allocator.memories)
+      _mesa_hash_table_destroy(vkr_allocator.memories, vkr_allocator_free_memory_entry);
 
    for (uint32_t i = 0; i < vkr_allocator.device_count; ++i) {
-      vkDestroyDevice(vkr_allocator.devices[i], NULL);
+      if (vkr_allocator.devices[i].device != VK_NULL_HANDLE)
+         vkDestroyDevice(vkr_allocator.devices[i].device, NULL);
    }
-   vkDestroyInstance(vkr_allocator.instance, NULL);
+   free(vkr_allocator.devices);
+
+   if (vkr_allocator.instance != VK_NULL_HANDLE)
+      vkDestroyInstance(vkr_allocator.instance, NULL);
 
    memset(&vkr_allocator, 0, sizeof(vkr_allocator));
+}
+
+void
+vkr_allocator_fini(void)
+{
+   if (!vkr_allocator_initialized)
+      return;
+
+   vkr_allocator_log_stats();
+   vkr_allocator_destroy();
 
    vkr_allocator_initialized = false;
 }
@@ -170,15 +271,26 @@ vkr_allocator_init(void)
    if (res != VK_SUCCESS)
       goto fail;
 
-   vkr_allocator.device_count = VKR_ALLOCATOR_MAX_DEVICE_COUNT;
+   uint32_t count = 0;
+   res = vkEnumeratePhysicalDevices(vkr_allocator.instance, &count, NULL);
+   if (res != VK_SUCCESS || !count)
+      goto fail;
 
-   res = vkEnumeratePhysicalDevices(vkr_allocator.instance, &vkr_allocator.device_count,
-                                    vkr_allocator.physical_devices);
-   if (res != VK_SUCCESS && res != VK_INCOMPLETE)
+   VkPhysicalDevice *physical_devs = malloc(sizeof(*physical_devs) * count);
+   vkr_allocator.devices = calloc(count, sizeof(*vkr_allocator.devices));
+   if (!physical_devs || !vkr_allocator.devices) {
+      free(physical_devs);
       goto fail;
+   }
 
-   for (uint32_t i = 0; i < vkr_allocator.device_count; ++i) {
-      VkPhysicalDevice physical_dev_handle = vkr_allocator.physical_devices[i];
+   res = vkEnumeratePhysicalDevices(vkr_allocator.instance, &count, physical_devs);
+   if (res != VK_SUCCESS && res != VK_INCOMPLETE) {
+      free(physical_devs);
+      goto fail;
+   }
+
+   for (uint32_t i = 0; i < count; ++i) {
+      struct vkr_allocator_device *dev = &vkr_allocator.devices[i];
 
       VkPhysicalDeviceIDProperties id_props = {
          .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES
@@ -186,43 +298,23 @@ vkr_allocator_init(void)
       VkPhysicalDeviceProperties2 props2 = {
          .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &id_props
       };
-      vkGetPhysicalDeviceProperties2(physical_dev_handle, &props2);
-
-      memcpy(vkr_allocator.device_uuids[i], id_props.deviceUUID, VK_UUID_SIZE);
-
-      float priority = 1.0;
-      VkDeviceQueueCreateInfo queue_info = {
-         .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-         /* Use any queue since we dont really need it.
-          * We are guaranteed at least one by the spec */
-         .queueFamilyIndex = 0,
-         .queueCount = 1,
-         .pQueuePriorities = &priority
-      };
+      vkGetPhysicalDeviceProperties2(physical_devs[i], &props2);
 
-      VkDeviceCreateInfo dev_info = {
-         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-         .queueCreateInfoCount = 1,
-         .pQueueCreateInfos = &queue_info,
-      };
-
-      res =
-         vkCreateDevice(physical_dev_handle, &dev_info, NULL, &vkr_allocator.devices[i]);
-      if (res != VK_SUCCESS)
-         goto fail;
+      dev->physical_device = physical_devs[i];
+      memcpy(dev->device_uuid, id_props.deviceUUID, VK_UUID_SIZE);
    }
+   vkr_allocator.device_count = count;
+   free(physical_devs);
 
-   list_inithead(&vkr_allocator.memories);
+   vkr_allocator.memories =
+      _mesa_hash_table_create(NULL, _mesa_hash_u32, _mesa_key_u32_equal);
+   if (!vkr_allocator.memories)
+      goto fail;
 
    return 0;
 
 fail:
-   for (uint32_t i = 0; i < vkr_allocator.device_count; ++i) {
-      vkDestroyDevice(vkr_allocator.devices[i], NULL);
-   }
-   vkDestroyInstance(vkr_allocator.instance, NULL);
-
-   memset(&vkr_allocator, 0, sizeof(vkr_allocator));
+   vkr_allocator_destroy();
 
    return -1;
 }
@@ -242,40 +334,41 @@ vkr_allocator_resource_map(struct virgl_resource *res, void **map, uint64_t *out
    if (!mem_info)
       return -EINVAL;
 
+   struct vkr_allocator_stats *stats = &mem_info->device->stats;
+
    void *ptr;
-   if (vkMapMemory(mem_info->device, mem_info->device_memory, 0, mem_info->size, 0,
-                   &ptr) != VK_SUCCESS) {
+   if (vkMapMemory(mem_info->device->device, mem_info->device_memory, 0, mem_info->size,
+                   0, &ptr) != VK_SUCCESS) {
+      stats->map_failure_count++;
       vkr_allocator_free_memory(mem_info);
       return -EINVAL;
    }
 
+   _mesa_hash_table_insert(vkr_allocator.memories, &mem_info->res_id, mem_info);
+
+   stats->map_count++;
+   stats->size_class_map_counts[vkr_allocator_get_size_class(mem_info->size)]++;
+
    *map = ptr;
    *out_size = mem_info->size;
 
    return 0;
 }
 
-static struct vkr_opaque_fd_mem_info *
-vkr_allocator_get_mem_info(struct virgl_resource *res)
-{
-   struct vkr_opaque_fd_mem_info *mem_info, *mem_info_temp;
-   LIST_FOR_EACH_ENTRY_SAFE (mem_info, mem_info_temp, &vkr_allocator.memories, head)
-      if (mem_info->res_id == res->res_id)
-         return mem_info;
-
-   return NULL;
-}
-
 int
 vkr_allocator_resource_unmap(struct virgl_resource *res)
 {
    assert(vkr_allocator_initialized);
 
-   struct vkr_opaque_fd_mem_info *mem_info = vkr_allocator_get_mem_info(res);
-   if (!mem_info)
+   struct hash_entry *entry =
+      _mesa_hash_table_search(vkr_allocator.memories, &res->res_id);
+   if (!entry)
       return -EINVAL;
 
-   vkUnmapMemory(mem_info->device, mem_info->device_memory);
+   struct vkr_opaque_fd_mem_info *mem_info = entry->data;
+   _mesa_hash_table_remove(vkr_allocator.memories, entry);
+
+   vkUnmapMemory(mem_info->device->device, mem_info->device_memory);
 
    vkr_allocator_free_memory(mem_info);
 
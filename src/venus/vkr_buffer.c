@@ -6,6 +6,7 @@
 #include "vkr_buffer.h"
 
 #include "vkr_buffer_gen.h"
+#include "vkr_device_memory.h"
 #include "vkr_physical_device.h"
 
 static void
@@ -56,7 +57,9 @@ vkr_dispatch_vkGetBufferMemoryRequirements(
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetBufferMemoryRequirements_args_handle(args);
-   vk->GetBufferMemoryRequirements(args->device, args->buffer, args->pMemoryRequirements);
+   VKR_DRIVER_CALL(vk->GetBufferMemoryRequirements(args->device, args->buffer,
+                                                   args->pMemoryRequirements));
+   vkr_device_memory_check_requirements(dev, args->pMemoryRequirements);
 }
 
 static void
@@ -68,7 +71,28 @@ vkr_dispatch_vkGetBufferMemoryRequirements2(
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetBufferMemoryRequirements2_args_handle(args);
-   vk->GetBufferMemoryRequirements2(args->device, args->pInfo, args->pMemoryRequirements);
+   VKR_DRIVER_CALL(vk->GetBufferMemoryRequirements2(args->device, args->pInfo,
+                                                    args->pMemoryRequirements));
+   vkr_device_memory_check_requirements(dev,
+                                        &args->pMemoryRequirements->memoryRequirements);
+}
+
+/* info->memoryOffset must be adjusted already */
+static bool
+vkr_buffer_check_bind(struct vkr_device *dev, const VkBindBufferMemoryInfo *info)
+{
+   struct vn_device_proc_table *vk = &dev->proc_table;
+
+   if (!vkr_device_memory_is_suballocated(info->memory))
+      return true;
+
+   /* handles in info are not replaced yet */
+   const struct vkr_buffer *buf = vkr_buffer_from_handle(info->buffer);
+   VkMemoryRequirements reqs;
+   VKR_DRIVER_CALL(vk->GetBufferMemoryRequirements(dev->base.handle.device,
+                                                   buf->base.handle.buffer, &reqs));
+
+   return vkr_device_memory_check_bind(dev, info->memory, info->memoryOffset, &reqs);
 }
 
 static void
@@ -78,9 +102,22 @@ vkr_dispatch_vkBindBufferMemory(UNUSED struct vn_dispatch_context *dispatch,
    struct vkr_device *dev = vkr_device_from_handle(args->device);
    struct vn_device_proc_table *vk = &dev->proc_table;
 
+   vkr_device_memory_adjust_offset(args->memory, &args->memoryOffset);
+
+   const VkBindBufferMemoryInfo info = {
+      .sType = VK_STRUCTURE_TYPE_BIND_BUFFER_MEMORY_INFO,
+      .buffer = args->buffer,
+      .memory = args->memory,
+      .memoryOffset = args->memoryOffset,
+   };
+   if (!vkr_buffer_check_bind(dev, &info)) {
+      args->ret = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+      return;
+   }
+
    vn_replace_vkBindBufferMemory_args_handle(args);
-   args->ret =
-      vk->BindBufferMemory(args->device, args->buffer, args->memory, args->memoryOffset);
+   VKR_DRIVER_CALL(args->ret = vk->BindBufferMemory(args->device, args->buffer,
+                                                    args->memory, args->memoryOffset));
 }
 
 static void
@@ -90,8 +127,18 @@ vkr_dispatch_vkBindBufferMemory2(UNUSED struct vn_dispatch_context *dispatch,
    struct vkr_device *dev = vkr_device_from_handle(args->device);
    struct vn_device_proc_table *vk = &dev->proc_table;
 
+   for (uint32_t i = 0; i < args->bindInfoCount; i++) {
+      VkBindBufferMemoryInfo *info = (VkBindBufferMemoryInfo *)&args->pBindInfos[i];
+      vkr_device_memory_adjust_offset(info->memory, &info->memoryOffset);
+      if (!vkr_buffer_check_bind(dev, info)) {
+         args->ret = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+         return;
+      }
+   }
+
    vn_replace_vkBindBufferMemory2_args_handle(args);
-   args->ret = vk->BindBufferMemory2(args->device, args->bindInfoCount, args->pBindInfos);
+   VKR_DRIVER_CALL(args->ret = vk->BindBufferMemory2(args->device, args->bindInfoCount,
+                                                     args->pBindInfos));
 }
 
 static void
@@ -103,7 +150,8 @@ vkr_dispatch_vkGetBufferOpaqueCaptureAddress(
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetBufferOpaqueCaptureAddress_args_handle(args);
-   args->ret = vk->GetBufferOpaqueCaptureAddress(args->device, args->pInfo);
+   VKR_DRIVER_CALL(args->ret = vk->GetBufferOpaqueCaptureAddress(args->device,
+                                                                 args->pInfo));
 }
 
 static void
@@ -114,7 +162,7 @@ vkr_dispatch_vkGetBufferDeviceAddress(UNUSED struct vn_dispatch_context *dispatc
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetBufferDeviceAddress_args_handle(args);
-   args->ret = vk->GetBufferDeviceAddress(args->device, args->pInfo);
+   VKR_DRIVER_CALL(args->ret = vk->GetBufferDeviceAddress(args->device, args->pInfo));
 }
 
 static void
@@ -140,8 +188,10 @@ vkr_dispatch_vkGetDeviceBufferMemoryRequirements(
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetDeviceBufferMemoryRequirements_args_handle(args);
-   vk->GetDeviceBufferMemoryRequirements(args->device, args->pInfo,
-                                         args->pMemoryRequirements);
+   VKR_DRIVER_CALL(vk->GetDeviceBufferMemoryRequirements(args->device, args->pInfo,
+                                                         args->pMemoryRequirements));
+   vkr_device_memory_check_requirements(dev,
+                                        &args->pMemoryRequirements->memoryRequirements);
 }
 
 void
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2026 agent
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "vkr_capture.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "util/u_debug.h"
+
+#include "vkr_common.h"
+
+static struct {
+   bool enabled;
+
+   mtx_t mutex;
+   FILE *file;
+} vkr_capture;
+
+static uint64_t
+vkr_capture_now(void)
+{
+   const uint64_t ns_per_sec = 1000000000llu;
+   struct timespec now;
+   if (clock_gettime(CLOCK_MONOTONIC, &now))
+      return 0;
+   return ns_per_sec * now.tv_sec + now.tv_nsec;
+}
+
+void
+vkr_capture_init(void)
+{
+   const char *path = debug_get_option("VKR_CAPTURE", NULL);
+   if (!path || !*path)
+      return;
+
+   /* there is a process per context with the render server */
+   char filename[1024];
+   snprintf(filename, sizeof(filename), "%s.%d", path, (int)getpid());
+
+   FILE *file = fopen(filename, "wbe");
+   if (!file) {
+      vkr_log("failed to open capture file %s", filename);
+      return;
+   }
+
+   const struct vkr_capture_header header = {
+      .magic = VKR_CAPTURE_MAGIC,
+      .version = VKR_CAPTURE_VERSION,
+   };
+   if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+       mtx_init(&vkr_capture.mutex, mtx_plain) != thrd_success) {
+      vkr_log("failed to initialize capture file %s", filename);
+      fclose(file);
+      return;
+   }
+
+   vkr_capture.file = file;
+   vkr_capture.enabled = true;
+
+   vkr_log("capturing to %s", filename);
+}
+
+void
+vkr_capture_fini(void)
+{
+   if (!vkr_capture.file)
+      return;
+
+   fclose(vkr_capture.file);
+   mtx_destroy(&vkr_capture.mutex);
+
+   vkr_capture.file = NULL;
+   vkr_capture.enabled = false;
+}
+
+bool
+vkr_capture_is_enabled(void)
+{
+   return vkr_capture.enabled;
+}
+
+void
+vkr_capture_write(enum vkr_capture_record_type type,
+                  uint32_t ctx_id,
+                  const void *info,
+                  size_t info_size,
+                  const void *data,
+                  size_t data_size)
+{
+   if (!vkr_capture.enabled)
+      return;
+
+   const struct vkr_capture_record record = {
+      .type = type,
+      .ctx_id = ctx_id,
+      .timestamp = vkr_capture_now(),
+      .size = info_size + data_size,
+   };
+
+   mtx_lock(&vkr_capture.mutex);
+
+   /* check again in case a concurrent write has failed */
+   if (!vkr_capture.enabled) {
+      mtx_unlock(&vkr_capture.mutex);
+      return;
+   }
+
+   bool ok = fwrite(&record, sizeof(record), 1, vkr_capture.file) == 1;
+   if (ok && info_size)
+      ok = fwrite(info, info_size, 1, vkr_capture.file) == 1;
+   if (ok && data_size)
+      ok = fwrite(data, data_size, 1, vkr_capture.file) == 1;
+
+   if (!ok) {
+      /* a truncated record makes the rest of the file useless */
+      vkr_log("failed to write capture record; capture stopped");
+      vkr_capture.enabled = false;
+   }
+
+   mtx_unlock(&vkr_capture.mutex);
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright 2026 agent
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef VKR_CAPTURE_H
+#define VKR_CAPTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* When VKR_CAPTURE is set to a path, everything that enters vkr through
+ * vkr_renderer_* is recorded to "<path>.<pid>" and can be fed back to vkr
+ * by virgl_render_replay without a guest.
+ *
+ * A capture file is a vkr_capture_header followed by records.  Each record
+ * is a vkr_capture_record followed by size bytes of payload.  All fields are
+ * in host byte order.
+ *
+ * Command buffers are recorded after they have been dispatched, while the
+ * context is still locked.  That way, the streams that vkExecuteCommandStreamsMESA
+ * reads from resources are recorded before the command buffer that executes
+ * them, and the replayer can write them back to the resources beforehand.
+ * Commands read from rings go through vkr_context_submit_cmd and are recorded
+ * like any other command buffer.  Other guest writes to resources, such as
+ * mapped memory, are not captured.
+ */
+
+#define VKR_CAPTURE_MAGIC 0x5256504bu /* "KPVR" */
+#define VKR_CAPTURE_VERSION 1
+
+enum vkr_capture_record_type {
+   /* vkr_capture_context followed by the name */
+   VKR_CAPTURE_RECORD_CONTEXT_CREATE = 1,
+   /* no payload */
+   VKR_CAPTURE_RECORD_CONTEXT_DESTROY = 2,
+   /* the command buffer */
+   VKR_CAPTURE_RECORD_CMD = 3,
+   /* vkr_capture_stream followed by the stream */
+   VKR_CAPTURE_RECORD_STREAM = 4,
+   /* vkr_capture_fence */
+   VKR_CAPTURE_RECORD_FENCE = 5,
+   /* vkr_capture_resource */
+   VKR_CAPTURE_RECORD_RESOURCE_CREATE = 6,
+   VKR_CAPTURE_RECORD_RESOURCE_IMPORT = 7,
+   VKR_CAPTURE_RECORD_RESOURCE_DESTROY = 8,
+};
+
+struct vkr_capture_header {
+   uint32_t magic;
+   uint32_t version;
+};
+
+struct vkr_capture_record {
+   uint32_t type;
+   uint32_t ctx_id;
+   /* CLOCK_MONOTONIC */
+   uint64_t timestamp;
+   uint64_t size;
+};
+
+struct vkr_capture_context {
+   uint32_t ctx_flags;
+   uint32_t name_len;
+};
+
+struct vkr_capture_stream {
+   uint32_t res_id;
+   uint32_t padding;
+   uint64_t offset;
+};
+
+struct vkr_capture_fence {
+   uint32_t flags;
+   uint32_t ring_idx;
+   uint64_t fence_id;
+};
+
+struct vkr_capture_resource {
+   uint32_t res_id;
+   uint32_t blob_flags;
+   uint64_t blob_id;
+   uint64_t blob_size;
+   uint32_t fd_type;
+   uint32_t padding;
+};
+
+void
+vkr_capture_init(void);
+
+void
+vkr_capture_fini(void);
+
+bool
+vkr_capture_is_enabled(void);
+
+void
+vkr_capture_write(enum vkr_capture_record_type type,
+                  uint32_t ctx_id,
+                  const void *info,
+                  size_t info_size,
+                  const void *data,
+                  size_t data_size);
+
+#endif /* VKR_CAPTURE_H */
@@ -6,6 +6,7 @@
 #include "vkr_command_buffer.h"
 
 #include "vkr_command_buffer_gen.h"
+#include "vkr_pipeline.h"
 
 #ifdef __clang__
 #pragma clang diagnostic ignored "-Wgnu-zero-variadic-macro-arguments"
@@ -18,7 +19,7 @@
       struct vn_device_proc_table *_vk = &_cmd->device->proc_table;                      \
                                                                                          \
       vn_replace_vk##cmd_name##_args_handle(args);                                       \
-      _vk->cmd_name(args->commandBuffer, ##__VA_ARGS__);                                 \
+      VKR_DRIVER_CALL(_vk->cmd_name(args->commandBuffer, ##__VA_ARGS__));                \
    } while (0)
 
 static void
@@ -54,7 +55,8 @@ vkr_dispatch_vkResetCommandPool(UNUSED struct vn_dispatch_context *dispatch,
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkResetCommandPool_args_handle(args);
-   args->ret = vk->ResetCommandPool(args->device, args->commandPool, args->flags);
+   VKR_DRIVER_CALL(args->ret = vk->ResetCommandPool(args->device, args->commandPool,
+                                                    args->flags));
 }
 
 static void
@@ -65,7 +67,7 @@ vkr_dispatch_vkTrimCommandPool(UNUSED struct vn_dispatch_context *dispatch,
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkTrimCommandPool_args_handle(args);
-   vk->TrimCommandPool(args->device, args->commandPool, args->flags);
+   VKR_DRIVER_CALL(vk->TrimCommandPool(args->device, args->commandPool, args->flags));
 }
 
 static void
@@ -114,7 +116,7 @@ vkr_dispatch_vkResetCommandBuffer(UNUSED struct vn_dispatch_context *dispatch,
    struct vn_device_proc_table *vk = &cmd->device->proc_table;
 
    vn_replace_vkResetCommandBuffer_args_handle(args);
-   args->ret = vk->ResetCommandBuffer(args->commandBuffer, args->flags);
+   VKR_DRIVER_CALL(args->ret = vk->ResetCommandBuffer(args->commandBuffer, args->flags));
 }
 
 static void
@@ -125,7 +127,8 @@ vkr_dispatch_vkBeginCommandBuffer(UNUSED struct vn_dispatch_context *dispatch,
    struct vn_device_proc_table *vk = &cmd->device->proc_table;
 
    vn_replace_vkBeginCommandBuffer_args_handle(args);
-   args->ret = vk->BeginCommandBuffer(args->commandBuffer, args->pBeginInfo);
+   VKR_DRIVER_CALL(args->ret = vk->BeginCommandBuffer(args->commandBuffer,
+                                                      args->pBeginInfo));
 }
 
 static void
@@ -136,13 +139,18 @@ vkr_dispatch_vkEndCommandBuffer(UNUSED struct vn_dispatch_context *dispatch,
    struct vn_device_proc_table *vk = &cmd->device->proc_table;
 
    vn_replace_vkEndCommandBuffer_args_handle(args);
-   args->ret = vk->EndCommandBuffer(args->commandBuffer);
+   VKR_DRIVER_CALL(args->ret = vk->EndCommandBuffer(args->commandBuffer));
 }
 
 static void
-vkr_dispatch_vkCmdBindPipeline(UNUSED struct vn_dispatch_context *dispatch,
+vkr_dispatch_vkCmdBindPipeline(struct vn_dispatch_context *dispatch,
                                struct vn_command_vkCmdBindPipeline *args)
 {
+   /* the pipeline might still be created by the compiler threads */
+   struct vkr_pipeline *pipeline = (struct vkr_pipeline *)(uintptr_t)args->pipeline;
+   if (pipeline && !vkr_pipeline_wait(dispatch->data, pipeline))
+      return;
+
    VKR_CMD_CALL(CmdBindPipeline, args, args->pipelineBindPoint, args->pipeline);
 }
 
@@ -126,17 +126,153 @@ static const struct vn_info_extension_table vkr_extension_table = {
 
 static const struct debug_named_value vkr_debug_options[] = {
    { "validate", VKR_DEBUG_VALIDATE, "Force enabling the validation layer" },
+   { "command_stats", VKR_DEBUG_COMMAND_STATS, "Collect per-command counters" },
+   DEBUG_NAMED_VALUE_END
+};
+
+static const struct debug_named_value vkr_perf_options[] = {
+   { "timeline_retire", VKR_PERF_TIMELINE_RETIRE,
+     "Retire fences through a per-queue timeline semaphore" },
+   { "fence_reactor", VKR_PERF_FENCE_REACTOR,
+     "Wait for the fences of all queues from a single epoll thread" },
+   { "async_pipeline", VKR_PERF_ASYNC_PIPELINE,
+     "Create pipelines on compiler threads when no reply is expected" },
+   { "suballocate_memory", VKR_PERF_SUBALLOCATE_MEMORY,
+     "Suballocate small host-visible memories from exported slabs" },
+   { "format_cache", VKR_PERF_FORMAT_CACHE,
+     "Cache format queries per physical device and share them across contexts" },
+   { "coalesce_submits", VKR_PERF_COALESCE_SUBMITS,
+     "Merge consecutive queue submissions into a single driver call" },
+   { "deferred_destroy", VKR_PERF_DEFERRED_DESTROY,
+     "Batch the destruction of driver objects at the end of command streams" },
    DEBUG_NAMED_VALUE_END
 };
 
 uint32_t vkr_debug_flags;
+uint32_t vkr_perf_flags;
+__thread uint64_t *vkr_driver_ns;
 
 DEBUG_GET_ONCE_FLAGS_OPTION(vkr_debug_flags, "VKR_DEBUG", vkr_debug_options, 0)
+DEBUG_GET_ONCE_FLAGS_OPTION(vkr_perf_flags, "VKR_PERF", vkr_perf_options, 0)
 
 void
 vkr_debug_init(void)
 {
    vkr_debug_flags = debug_get_option_vkr_debug_flags();
+   vkr_perf_flags = debug_get_option_vkr_perf_flags();
+}
+
+#define VKR_THREAD_AFFINITY_MAX_CPUS 1024
+
+/* the CPUs ring and queue threads are restricted to */
+static struct {
+   bool enabled;
+   uint32_t mask[VKR_THREAD_AFFINITY_MAX_CPUS / 32];
+} vkr_thread_affinity;
+
+/* parses a Linux CPU list such as "0-7,16-23" */
+static bool
+vkr_parse_cpu_list(const char *str, uint32_t *mask)
+{
+   const char *p = str;
+   while (*p && *p != '\n') {
+      char *end;
+      const unsigned long first = strtoul(p, &end, 10);
+      if (end == p)
+         return false;
+
+      unsigned long last = first;
+      p = end;
+      if (*p == '-') {
+         last = strtoul(p + 1, &end, 10);
+         if (end == p + 1 || last < first)
+            return false;
+         p = end;
+      }
+
+      if (last >= VKR_THREAD_AFFINITY_MAX_CPUS)
+         return false;
+      for (unsigned long cpu = first; cpu <= last; cpu++)
+         mask[cpu / 32] |= 1u << (cpu % 32);
+
+      if (*p == ',')
+         p++;
+      else if (*p && *p != '\n')
+         return false;
+   }
+
+   return true;
+}
+
+static bool
+vkr_parse_numa_node(const char *node, uint32_t *mask)
+{
+   char *end;
+   const unsigned long index = strtoul(node, &end, 10);
+   if (end == node || *end)
+      return false;
+
+   char path[64];
+   snprintf(path, sizeof(path), "/sys/devices/system/node/node%lu/cpulist", index);
+
+   FILE *file = fopen(path, "re");
+   if (!file)
+      return false;
+
+   char cpu_list[1024];
+   const bool ok = fgets(cpu_list, sizeof(cpu_list), file) &&
+                   vkr_parse_cpu_list(cpu_list, mask);
+   fclose(file);
+
+   return ok;
+}
+
+void
+vkr_thread_affinity_init(void)
+{
+   /* VKR_CPU_AFFINITY takes precedence over VKR_NUMA_NODE */
+   const char *cpu_list = debug_get_option("VKR_CPU_AFFINITY", NULL);
+   const char *node = debug_get_option("VKR_NUMA_NODE", NULL);
+
+   memset(vkr_thread_affinity.mask, 0, sizeof(vkr_thread_affinity.mask));
+   vkr_thread_affinity.enabled = false;
+
+   bool ok;
+   if (cpu_list && *cpu_list)
+      ok = vkr_parse_cpu_list(cpu_list, vkr_thread_affinity.mask);
+   else if (node && *node)
+      ok = vkr_parse_numa_node(node, vkr_thread_affinity.mask);
+   else
+      return;
+
+   uint32_t any = 0;
+   for (uint32_t i = 0; i < ARRAY_SIZE(vkr_thread_affinity.mask); i++)
+      any |= vkr_thread_affinity.mask[i];
+
+   if (!ok || !any) {
+      vkr_log("ignoring invalid thread affinity %s",
+              cpu_list && *cpu_list ? cpu_list : node);
+      return;
+   }
+
+   vkr_thread_affinity.enabled = true;
+}
+
+bool
+vkr_thread_affinity_is_enabled(void)
+{
+   return vkr_thread_affinity.enabled;
+}
+
+void
+vkr_thread_apply_affinity(void)
+{
+   if (!vkr_thread_affinity.enabled)
+      return;
+
+   if (!util_set_current_thread_affinity(vkr_thread_affinity.mask, NULL,
+                                         VKR_THREAD_AFFINITY_MAX_CPUS))
+      vkr_log("failed to set thread affinity");
 }
 
 void
@@ -17,6 +17,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "c11/threads.h"
 #include "util/hash_table.h"
@@ -39,6 +40,18 @@
 
 #define VKR_DEBUG(category) (unlikely(vkr_debug_flags & VKR_DEBUG_##category))
 
+#define VKR_PERF(category) (unlikely(vkr_perf_flags & VKR_PERF_##category))
+
+/* accumulate the time spent in a driver call to vkr_driver_ns */
+#define VKR_DRIVER_CALL(...)                                                             \
+   do {                                                                                  \
+      uint64_t *_driver_ns = vkr_driver_ns;                                              \
+      const uint64_t _begin_ns = unlikely(_driver_ns) ? vkr_get_time_ns() : 0;           \
+      __VA_ARGS__;                                                                       \
+      if (unlikely(_driver_ns))                                                          \
+         *_driver_ns += vkr_get_time_ns() - _begin_ns;                                   \
+   } while (0)
+
 /* define a type-safe cast function */
 #define VKR_DEFINE_OBJECT_CAST(vkr_type, vk_enum, vk_type)                               \
    static inline struct vkr_##vkr_type *vkr_##vkr_type##_from_handle(vk_type handle)     \
@@ -93,6 +106,17 @@ typedef uint64_t vkr_object_id;
 
 enum vkr_debug_flags {
    VKR_DEBUG_VALIDATE = 1 << 0,
+   VKR_DEBUG_COMMAND_STATS = 1 << 1,
+};
+
+enum vkr_perf_flags {
+   VKR_PERF_TIMELINE_RETIRE = 1 << 0,
+   VKR_PERF_FENCE_REACTOR = 1 << 1,
+   VKR_PERF_ASYNC_PIPELINE = 1 << 2,
+   VKR_PERF_SUBALLOCATE_MEMORY = 1 << 3,
+   VKR_PERF_FORMAT_CACHE = 1 << 4,
+   VKR_PERF_COALESCE_SUBMITS = 1 << 5,
+   VKR_PERF_DEFERRED_DESTROY = 1 << 6,
 };
 
 /* base class for all objects */
@@ -153,13 +177,43 @@ struct vkr_region {
 };
 
 extern uint32_t vkr_debug_flags;
+extern uint32_t vkr_perf_flags;
+
+/* the driver time of the command being dispatched by this thread; NULL unless
+ * VKR_DEBUG=command_stats
+ */
+extern __thread uint64_t *vkr_driver_ns;
 
 void
 vkr_debug_init(void);
 
+/* Ring and queue threads are pinned to the CPUs listed in VKR_CPU_AFFINITY
+ * (e.g., "0-7,16-23"), or to the CPUs of VKR_NUMA_NODE.  The VMM sets them to
+ * its vCPU placement such that the threads reading a ring share the caches of
+ * the vCPUs writing it.
+ */
+void
+vkr_thread_affinity_init(void);
+
+bool
+vkr_thread_affinity_is_enabled(void);
+
+void
+vkr_thread_apply_affinity(void);
+
 void
 vkr_log(const char *fmt, ...);
 
+static inline uint64_t
+vkr_get_time_ns(void)
+{
+   const uint64_t ns_per_sec = 1000000000llu;
+   struct timespec now;
+   if (clock_gettime(CLOCK_MONOTONIC, &now))
+      return 0;
+   return ns_per_sec * now.tv_sec + now.tv_nsec;
+}
+
 static inline uint32_t
 vkr_api_version_cap_minor(uint32_t version, uint32_t cap)
 {
@@ -16,6 +16,7 @@
 #include "util/xxhash.h"
 
 #include "vkr_buffer.h"
+#include "vkr_capture.h"
 #include "vkr_command_buffer.h"
 #include "vkr_context.h"
 #include "vkr_cs.h"
@@ -148,11 +149,137 @@ vkr_context_submit_fence(struct vkr_context *ctx,
    flags = VIRGL_RENDERER_FENCE_FLAG_MERGEABLE;
    bool ok = vkr_queue_sync_submit(ctx->sync_queues[ring_idx], flags, ring_idx, fence_id);
 
+   /* so is fence submission, which also happens when the guest is otherwise idle */
+   vkr_context_flush_deferred_objects(ctx);
+
    mtx_unlock(&ctx->mutex);
 
    return ok;
 }
 
+void
+vkr_context_dispatch_command(struct vkr_context *ctx)
+{
+   struct vkr_cs_decoder *dec = &ctx->decoder;
+
+   /* peek the command header without touching the decoder state */
+   struct {
+      int32_t type;
+      uint32_t flags;
+   } header = { .type = -1 };
+   if ((size_t)(dec->end - dec->cur) >= sizeof(header))
+      memcpy(&header, dec->cur, sizeof(header));
+
+   const uint8_t *begin = dec->cur;
+   ctx->command_begin = begin;
+   ctx->command_flags = header.flags;
+
+   /* any other command must see the coalesced submits */
+   if (ctx->submit_batch && header.type != VK_COMMAND_TYPE_vkQueueSubmit_EXT &&
+       header.type != VK_COMMAND_TYPE_vkQueueSubmit2_EXT)
+      vkr_queue_submit_batch_flush(ctx->submit_batch);
+
+   if (likely(!ctx->command_stats)) {
+      vn_dispatch_command(&ctx->dispatch);
+      return;
+   }
+
+   const int32_t cmd_type = header.type;
+   const uint64_t begin_ns = vkr_get_time_ns();
+
+   /* the driver time of nested commands is also that of this command */
+   uint64_t *outer_driver_ns = vkr_driver_ns;
+   uint64_t driver_ns = 0;
+   vkr_driver_ns = &driver_ns;
+
+   vn_dispatch_command(&ctx->dispatch);
+
+   vkr_driver_ns = outer_driver_ns;
+   if (outer_driver_ns)
+      *outer_driver_ns += driver_ns;
+
+   if (cmd_type < 0 || (uint32_t)cmd_type >= ARRAY_SIZE(vn_dispatch_table))
+      return;
+
+   /* nested streams restore the decoder state before returning */
+   struct vkr_context_command_stat *stat = &ctx->command_stats[cmd_type];
+   stat->count++;
+   stat->bytes += dec->cur - begin;
+   stat->ns += vkr_get_time_ns() - begin_ns;
+   stat->driver_ns += driver_ns;
+}
+
+static int
+vkr_context_command_stat_compare(const void *a, const void *b)
+{
+   const struct virgl_renderer_command_stat *stat_a = a;
+   const struct virgl_renderer_command_stat *stat_b = b;
+
+   /* the most expensive commands first */
+   if (stat_a->ns != stat_b->ns)
+      return stat_a->ns < stat_b->ns ? 1 : -1;
+   return stat_a->command_type < stat_b->command_type ? -1 : 1;
+}
+
+static uint32_t
+vkr_context_get_command_stats_locked(struct vkr_context *ctx,
+                                     struct virgl_renderer_command_stat *stats,
+                                     uint32_t max_count)
+{
+   if (!ctx->command_stats)
+      return 0;
+
+   uint32_t count = 0;
+   for (uint32_t i = 0; i < ARRAY_SIZE(vn_dispatch_table); i++) {
+      if (ctx->command_stats[i].count)
+         count++;
+   }
+   if (!count)
+      return 0;
+
+   /* too large for the stacks of the ring threads */
+   struct virgl_renderer_command_stat *all = malloc(sizeof(*all) * count);
+   if (!all)
+      return 0;
+
+   count = 0;
+   for (uint32_t i = 0; i < ARRAY_SIZE(vn_dispatch_table); i++) {
+      const struct vkr_context_command_stat *stat = &ctx->command_stats[i];
+      if (!stat->count)
+         continue;
+
+      struct virgl_renderer_command_stat *out = &all[count++];
+      memset(out, 0, sizeof(*out));
+      out->command_type = i;
+      snprintf(out->name, sizeof(out->name), "%s",
+               vn_dispatch_command_name((VkCommandTypeEXT)i));
+      out->count = stat->count;
+      out->bytes = stat->bytes;
+      out->ns = stat->ns;
+      out->driver_ns = stat->driver_ns;
+   }
+
+   qsort(all, count, sizeof(all[0]), vkr_context_command_stat_compare);
+
+   count = MIN2(count, max_count);
+   memcpy(stats, all, sizeof(*stats) * count);
+   free(all);
+
+   return count;
+}
+
+uint32_t
+vkr_context_get_command_stats(struct vkr_context *ctx,
+                              struct virgl_renderer_command_stat *stats,
+                              uint32_t max_count)
+{
+   mtx_lock(&ctx->mutex);
+   const uint32_t count = vkr_context_get_command_stats_locked(ctx, stats, max_count);
+   mtx_unlock(&ctx->mutex);
+
+   return count;
+}
+
 bool
 vkr_context_submit_cmd(struct vkr_context *ctx, const void *buffer, size_t size)
 {
@@ -169,7 +296,7 @@ vkr_context_submit_cmd(struct vkr_context *ctx, const void *buffer, size_t size)
 
    bool ok = true;
    while (vkr_cs_decoder_has_command(&ctx->decoder)) {
-      vn_dispatch_command(&ctx->dispatch);
+      vkr_context_dispatch_command(ctx);
       if (vkr_cs_decoder_get_fatal(&ctx->decoder)) {
          vkr_log("submit_cmd: vn_dispatch_command failed");
          ok = false;
@@ -177,6 +304,15 @@ vkr_context_submit_cmd(struct vkr_context *ctx, const void *buffer, size_t size)
       }
    }
 
+   if (ctx->submit_batch)
+      vkr_queue_submit_batch_flush(ctx->submit_batch);
+
+   /* end of stream is a safe point for deferred destruction */
+   vkr_context_flush_deferred_objects(ctx);
+
+   /* recorded after dispatch such that the streams it executes come first */
+   vkr_capture_write(VKR_CAPTURE_RECORD_CMD, ctx->ctx_id, NULL, 0, buffer, size);
+
    vkr_cs_decoder_reset(&ctx->decoder);
 
    mtx_unlock(&ctx->mutex);
@@ -407,6 +543,38 @@ vkr_context_get_name(const struct vkr_context *ctx)
    return ctx->instance_name ? ctx->instance_name : ctx->debug_name;
 }
 
+static void
+vkr_context_dump_command_stats(struct vkr_context *ctx)
+{
+   TRACE_FUNC();
+
+   struct virgl_renderer_command_stat stats[16];
+   const uint32_t count =
+      vkr_context_get_command_stats_locked(ctx, stats, ARRAY_SIZE(stats));
+   if (!count)
+      return;
+
+   vkr_log("context %d (%s) command stats:", ctx->ctx_id, vkr_context_get_name(ctx));
+   for (uint32_t i = 0; i < count; i++) {
+      vkr_log("  %-40s count %" PRIu64 " bytes %" PRIu64 " time %" PRIu64
+              " us (driver %" PRIu64 " us)",
+              stats[i].name, stats[i].count, stats[i].bytes, stats[i].ns / 1000,
+              stats[i].driver_ns / 1000);
+   }
+}
+
+static void
+vkr_context_dump_memory_stats(struct vkr_context *ctx)
+{
+   const struct vkr_context_memory_stats *stats = &ctx->memory_stats;
+
+   vkr_log("context %d (%s) memory stats: %" PRIu64 " suballocations (peak %u) in "
+           "%" PRIu64 " slabs (peak %u), %" PRIu64 " fallbacks",
+           ctx->ctx_id, vkr_context_get_name(ctx), stats->suballocation_alloc_count,
+           stats->suballocation_peak_count, stats->slab_alloc_count,
+           stats->slab_peak_count, stats->fallback_count);
+}
+
 void
 vkr_context_destroy(struct vkr_context *ctx)
 {
@@ -426,6 +594,25 @@ vkr_context_destroy(struct vkr_context *ctx)
       vkr_instance_destroy(ctx, ctx->instance);
    }
 
+   if (ctx->memory_stats.slab_alloc_count)
+      vkr_context_dump_memory_stats(ctx);
+
+   if (ctx->command_stats) {
+      vkr_context_dump_command_stats(ctx);
+      free(ctx->command_stats);
+   }
+
+   if (ctx->submit_batch) {
+      vkr_log("context %d (%s) submit stats: %" PRIu64 " submits received, %" PRIu64
+              " issued",
+              ctx->ctx_id, vkr_context_get_name(ctx), ctx->submit_batch->received_count,
+              ctx->submit_batch->issued_count);
+      vkr_queue_submit_batch_destroy(ctx->submit_batch);
+   }
+
+   /* deferred objects are destroyed with their devices */
+   assert(list_is_empty(&ctx->deferred_devices));
+
    _mesa_hash_table_destroy(ctx->resource_table, vkr_context_free_resource);
    _mesa_hash_table_destroy(ctx->object_table, vkr_context_free_object);
 
@@ -484,6 +671,19 @@ vkr_context_create(uint32_t ctx_id,
    if (VKR_DEBUG(VALIDATE))
       ctx->validate_level = VKR_CONTEXT_VALIDATE_FULL;
 
+   if (VKR_DEBUG(COMMAND_STATS)) {
+      ctx->command_stats =
+         calloc(ARRAY_SIZE(vn_dispatch_table), sizeof(*ctx->command_stats));
+      if (!ctx->command_stats)
+         goto err_command_stats;
+   }
+
+   if (VKR_PERF(COALESCE_SUBMITS)) {
+      ctx->submit_batch = vkr_queue_submit_batch_create();
+      if (!ctx->submit_batch)
+         goto err_submit_batch;
+   }
+
    if (mtx_init(&ctx->mutex, mtx_plain) != thrd_success)
       goto err_mtx_init;
 
@@ -502,6 +702,7 @@ vkr_context_create(uint32_t ctx_id,
    vkr_context_init_dispatch(ctx);
 
    list_inithead(&ctx->rings);
+   list_inithead(&ctx->deferred_devices);
 
    return ctx;
 
@@ -510,6 +711,11 @@ err_ctx_resource_table:
 err_ctx_object_table:
    mtx_destroy(&ctx->mutex);
 err_mtx_init:
+   if (ctx->submit_batch)
+      vkr_queue_submit_batch_destroy(ctx->submit_batch);
+err_submit_batch:
+   free(ctx->command_stats);
+err_command_stats:
    free(ctx->debug_name);
 err_debug_name:
    free(ctx);
@@ -32,6 +32,36 @@ struct vkr_resource {
    size_t size;
 };
 
+/* per-command counters collected with VKR_DEBUG=command_stats */
+struct vkr_context_command_stat {
+   uint64_t count;
+   /* bytes decoded for the command itself; the commands in the streams it
+    * executes are counted under their own types
+    */
+   uint64_t bytes;
+   /* time spent in the dispatch, including the commands it executes */
+   uint64_t ns;
+   /* the part of ns spent in driver calls; the rest is spent in decoding and
+    * object tracking
+    */
+   uint64_t driver_ns;
+};
+
+/* counters of VkDeviceMemory suballocated with VKR_PERF=suballocate_memory */
+struct vkr_context_memory_stats {
+   uint32_t slab_count;
+   uint32_t slab_peak_count;
+   uint64_t slab_size;
+   uint64_t slab_alloc_count;
+
+   uint32_t suballocation_count;
+   uint32_t suballocation_peak_count;
+   uint64_t suballocation_size;
+   uint64_t suballocation_alloc_count;
+   /* allocations that could not be suballocated */
+   uint64_t fallback_count;
+};
+
 enum vkr_context_validate_level {
    /* no validation */
    VKR_CONTEXT_VALIDATE_NONE,
@@ -59,6 +89,21 @@ struct vkr_context {
    struct vkr_cs_decoder decoder;
    struct vn_dispatch_context dispatch;
 
+   /* the command being dispatched by vkr_context_dispatch_command */
+   const uint8_t *command_begin;
+   VkCommandFlagsEXT command_flags;
+
+   /* indexed by VkCommandTypeEXT; NULL unless VKR_DEBUG=command_stats */
+   struct vkr_context_command_stat *command_stats;
+
+   struct vkr_context_memory_stats memory_stats;
+
+   /* NULL unless VKR_PERF=coalesce_submits */
+   struct vkr_queue_submit_batch *submit_batch;
+
+   /* devices with deferred object destruction */
+   struct list_head deferred_devices;
+
    struct vkr_queue *sync_queues[64];
 
    struct vkr_instance *instance;
@@ -85,6 +130,14 @@ vkr_context_submit_fence(struct vkr_context *ctx,
 bool
 vkr_context_submit_cmd(struct vkr_context *ctx, const void *buffer, size_t size);
 
+void
+vkr_context_dispatch_command(struct vkr_context *ctx);
+
+uint32_t
+vkr_context_get_command_stats(struct vkr_context *ctx,
+                              struct virgl_renderer_command_stat *stats,
+                              uint32_t max_count);
+
 bool
 vkr_context_create_resource(struct vkr_context *ctx,
                             uint32_t res_id,
@@ -160,6 +213,16 @@ vkr_context_remove_object(struct vkr_context *ctx, struct vkr_object *obj)
    }
 }
 
+/* remove an object from the object table without freeing it */
+static inline void
+vkr_context_detach_object(struct vkr_context *ctx, struct vkr_object *obj)
+{
+   struct hash_entry *entry = _mesa_hash_table_search(ctx->object_table, &obj->id);
+   assert(entry);
+   if (likely(entry))
+      _mesa_hash_table_remove(ctx->object_table, entry);
+}
+
 static inline void
 vkr_context_remove_objects(struct vkr_context *ctx, struct list_head *objects)
 {
@@ -16,7 +16,8 @@ vkr_dispatch_vkGetDescriptorSetLayoutSupport(
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetDescriptorSetLayoutSupport_args_handle(args);
-   vk->GetDescriptorSetLayoutSupport(args->device, args->pCreateInfo, args->pSupport);
+   VKR_DRIVER_CALL(vk->GetDescriptorSetLayoutSupport(args->device, args->pCreateInfo,
+                                                     args->pSupport));
 }
 
 static void
@@ -81,7 +82,8 @@ vkr_dispatch_vkResetDescriptorPool(struct vn_dispatch_context *dispatch,
    }
 
    vn_replace_vkResetDescriptorPool_args_handle(args);
-   args->ret = vk->ResetDescriptorPool(args->device, args->descriptorPool, args->flags);
+   VKR_DRIVER_CALL(args->ret = vk->ResetDescriptorPool(args->device, args->descriptorPool,
+                                                       args->flags));
 
    vkr_descriptor_pool_release(ctx, pool);
    list_inithead(&pool->descriptor_sets);
@@ -140,9 +142,9 @@ vkr_dispatch_vkUpdateDescriptorSets(UNUSED struct vn_dispatch_context *dispatch,
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkUpdateDescriptorSets_args_handle(args);
-   vk->UpdateDescriptorSets(args->device, args->descriptorWriteCount,
-                            args->pDescriptorWrites, args->descriptorCopyCount,
-                            args->pDescriptorCopies);
+   VKR_DRIVER_CALL(vk->UpdateDescriptorSets(
+      args->device, args->descriptorWriteCount, args->pDescriptorWrites,
+      args->descriptorCopyCount, args->pDescriptorCopies));
 }
 
 static void
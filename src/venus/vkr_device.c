@@ -12,6 +12,7 @@
 #include "vkr_descriptor_set.h"
 #include "vkr_device_memory.h"
 #include "vkr_physical_device.h"
+#include "vkr_pipeline.h"
 #include "vkr_queue.h"
 
 static VkResult
@@ -62,6 +63,19 @@ vkr_device_create_queues(struct vkr_context *ctx,
    return VK_SUCCESS;
 }
 
+static bool
+vkr_device_is_timeline_semaphore_enabled(const VkDeviceCreateInfo *create_info)
+{
+   const VkPhysicalDeviceVulkan12Features *vk12_feats = vkr_find_struct(
+      create_info->pNext, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES);
+   if (vk12_feats)
+      return vk12_feats->timelineSemaphore;
+
+   const VkPhysicalDeviceTimelineSemaphoreFeatures *timeline_feats = vkr_find_struct(
+      create_info->pNext, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES);
+   return timeline_feats && timeline_feats->timelineSemaphore;
+}
+
 static void
 vkr_device_init_proc_table(struct vkr_device *dev,
                            uint32_t api_version,
@@ -120,8 +134,8 @@ vkr_dispatch_vkCreateDevice(struct vn_dispatch_context *dispatch,
    }
 
    vn_replace_vkCreateDevice_args_handle(args);
-   args->ret = vkCreateDevice(args->physicalDevice, args->pCreateInfo, NULL,
-                              &dev->base.handle.device);
+   VKR_DRIVER_CALL(args->ret = vkCreateDevice(args->physicalDevice, args->pCreateInfo,
+                                              NULL, &dev->base.handle.device));
    if (args->ret != VK_SUCCESS) {
       free(exts);
       free(dev);
@@ -136,6 +150,9 @@ vkr_dispatch_vkCreateDevice(struct vn_dispatch_context *dispatch,
 
    free(exts);
 
+   dev->timeline_retire = VKR_PERF(TIMELINE_RETIRE) &&
+                          vkr_device_is_timeline_semaphore_enabled(args->pCreateInfo);
+
    args->ret = vkr_device_create_queues(ctx, dev, args->pCreateInfo->queueCreateInfoCount,
                                         args->pCreateInfo->pQueueCreateInfos);
    if (args->ret != VK_SUCCESS) {
@@ -144,26 +161,29 @@ vkr_dispatch_vkCreateDevice(struct vn_dispatch_context *dispatch,
       return;
    }
 
+   vkr_device_init_host_pipeline_cache(dev);
+   list_inithead(&dev->pipeline_jobs);
+   list_inithead(&dev->memory_slabs);
+
    mtx_init(&dev->free_sync_mutex, mtx_plain);
    list_inithead(&dev->free_syncs);
 
    list_inithead(&dev->objects);
+   list_inithead(&dev->deferred_objects);
+   list_inithead(&dev->deferred_head);
 
    list_add(&dev->base.track_head, &physical_dev->devices);
 
    vkr_context_add_object(ctx, &dev->base);
 }
 
-static void
-vkr_device_object_destroy(struct vkr_context *ctx,
-                          struct vkr_device *dev,
-                          struct vkr_object *obj)
+/* destroy the driver handle of an object, without any other cleanup */
+void
+vkr_device_object_destroy_driver_handle(struct vkr_device *dev, struct vkr_object *obj)
 {
    struct vn_device_proc_table *vk = &dev->proc_table;
    VkDevice device = dev->base.handle.device;
 
-   assert(vkr_device_should_track_object(obj));
-
    switch (obj->type) {
    case VK_OBJECT_TYPE_SEMAPHORE:
       vk->DestroySemaphore(device, obj->handle.semaphore, NULL);
@@ -171,10 +191,6 @@ vkr_device_object_destroy(struct vkr_context *ctx,
    case VK_OBJECT_TYPE_FENCE:
       vk->DestroyFence(device, obj->handle.fence, NULL);
       break;
-   case VK_OBJECT_TYPE_DEVICE_MEMORY:
-      vk->FreeMemory(device, obj->handle.device_memory, NULL);
-      vkr_device_memory_release((struct vkr_device_memory *)obj);
-      break;
    case VK_OBJECT_TYPE_BUFFER:
       vk->DestroyBuffer(device, obj->handle.buffer, NULL);
       break;
@@ -214,21 +230,9 @@ vkr_device_object_destroy(struct vkr_context *ctx,
    case VK_OBJECT_TYPE_SAMPLER:
       vk->DestroySampler(device, obj->handle.sampler, NULL);
       break;
-   case VK_OBJECT_TYPE_DESCRIPTOR_POOL: {
-      /* Destroying VkDescriptorPool frees all VkDescriptorSet allocated inside. */
-      vk->DestroyDescriptorPool(device, obj->handle.descriptor_pool, NULL);
-      vkr_descriptor_pool_release(ctx, (struct vkr_descriptor_pool *)obj);
-      break;
-   }
    case VK_OBJECT_TYPE_FRAMEBUFFER:
       vk->DestroyFramebuffer(device, obj->handle.framebuffer, NULL);
       break;
-   case VK_OBJECT_TYPE_COMMAND_POOL: {
-      /* Destroying VkCommandPool frees all VkCommandBuffer allocated inside. */
-      vk->DestroyCommandPool(device, obj->handle.command_pool, NULL);
-      vkr_command_pool_release(ctx, (struct vkr_command_pool *)obj);
-      break;
-   }
    case VK_OBJECT_TYPE_SAMPLER_YCBCR_CONVERSION:
       vk->DestroySamplerYcbcrConversion(device, obj->handle.sampler_ycbcr_conversion,
                                         NULL);
@@ -242,16 +246,137 @@ vkr_device_object_destroy(struct vkr_context *ctx,
       assert(false);
       break;
    };
+}
+
+static void
+vkr_device_object_destroy(struct vkr_context *ctx,
+                          struct vkr_device *dev,
+                          struct vkr_object *obj)
+{
+   struct vn_device_proc_table *vk = &dev->proc_table;
+   VkDevice device = dev->base.handle.device;
+
+   assert(vkr_device_should_track_object(obj));
+
+   switch (obj->type) {
+   case VK_OBJECT_TYPE_DEVICE_MEMORY: {
+      struct vkr_device_memory *mem = (struct vkr_device_memory *)obj;
+      /* the driver memory of a suballocation belongs to the slab */
+      if (!mem->slab)
+         vk->FreeMemory(device, obj->handle.device_memory, NULL);
+      vkr_device_memory_release(mem);
+      break;
+   }
+   case VK_OBJECT_TYPE_DESCRIPTOR_POOL: {
+      /* Destroying VkDescriptorPool frees all VkDescriptorSet allocated inside. */
+      vk->DestroyDescriptorPool(device, obj->handle.descriptor_pool, NULL);
+      vkr_descriptor_pool_release(ctx, (struct vkr_descriptor_pool *)obj);
+      break;
+   }
+   case VK_OBJECT_TYPE_COMMAND_POOL: {
+      /* Destroying VkCommandPool frees all VkCommandBuffer allocated inside. */
+      vk->DestroyCommandPool(device, obj->handle.command_pool, NULL);
+      vkr_command_pool_release(ctx, (struct vkr_command_pool *)obj);
+      break;
+   }
+   default:
+      vkr_device_object_destroy_driver_handle(dev, obj);
+      break;
+   };
 
    vkr_device_remove_object(ctx, dev, obj);
 }
 
+/* destroy at most max_count deferred objects of the device */
+static uint32_t
+vkr_device_flush_deferred_objects(struct vkr_device *dev, uint32_t max_count)
+{
+   uint32_t count = 0;
+   list_for_each_entry_safe (struct vkr_object, obj, &dev->deferred_objects, track_head) {
+      if (count == max_count)
+         break;
+
+      vkr_device_object_destroy_driver_handle(dev, obj);
+      list_del(&obj->track_head);
+      free(obj);
+      count++;
+   }
+
+   if (list_is_empty(&dev->deferred_objects))
+      list_delinit(&dev->deferred_head);
+
+   return count;
+}
+
+bool
+vkr_device_defer_object_destroy(struct vkr_context *ctx,
+                                struct vkr_device *dev,
+                                struct vkr_object *obj)
+{
+   /* pending pipeline creations might still use the object */
+   if (vkr_device_defer_pipeline_job_object(ctx, dev, obj))
+      return true;
+
+   if (!VKR_PERF(DEFERRED_DESTROY))
+      return false;
+
+   /* only objects without cleanup other than the driver handle */
+   switch (obj->type) {
+   case VK_OBJECT_TYPE_SEMAPHORE:
+   case VK_OBJECT_TYPE_FENCE:
+   case VK_OBJECT_TYPE_BUFFER:
+   case VK_OBJECT_TYPE_IMAGE:
+   case VK_OBJECT_TYPE_EVENT:
+   case VK_OBJECT_TYPE_QUERY_POOL:
+   case VK_OBJECT_TYPE_BUFFER_VIEW:
+   case VK_OBJECT_TYPE_IMAGE_VIEW:
+   case VK_OBJECT_TYPE_SHADER_MODULE:
+   case VK_OBJECT_TYPE_PIPELINE_LAYOUT:
+   case VK_OBJECT_TYPE_RENDER_PASS:
+   case VK_OBJECT_TYPE_PIPELINE:
+   case VK_OBJECT_TYPE_SAMPLER:
+   case VK_OBJECT_TYPE_FRAMEBUFFER:
+   case VK_OBJECT_TYPE_SAMPLER_YCBCR_CONVERSION:
+   case VK_OBJECT_TYPE_DESCRIPTOR_UPDATE_TEMPLATE:
+      break;
+   default:
+      return false;
+   }
+
+   /* the object id is released right away and the object is kept until the
+    * driver handle is destroyed
+    */
+   list_del(&obj->track_head);
+   vkr_context_detach_object(ctx, obj);
+
+   if (list_is_empty(&dev->deferred_objects))
+      list_addtail(&dev->deferred_head, &ctx->deferred_devices);
+   list_addtail(&obj->track_head, &dev->deferred_objects);
+
+   return true;
+}
+
+void
+vkr_context_flush_deferred_objects(struct vkr_context *ctx)
+{
+   uint32_t budget = VKR_DEVICE_DEFERRED_DESTROY_BATCH_COUNT;
+   list_for_each_entry_safe (struct vkr_device, dev, &ctx->deferred_devices,
+                             deferred_head) {
+      budget -= vkr_device_flush_deferred_objects(dev, budget);
+      if (!budget)
+         break;
+   }
+}
+
 void
 vkr_device_destroy(struct vkr_context *ctx, struct vkr_device *dev)
 {
    struct vn_device_proc_table *vk = &dev->proc_table;
    VkDevice device = dev->base.handle.device;
 
+   vkr_device_wait_pipeline_jobs(dev);
+   vkr_device_flush_deferred_objects(dev, UINT32_MAX);
+
    if (!LIST_IS_EMPTY(&dev->objects))
       vkr_log("destroying device with valid objects");
 
@@ -261,10 +386,19 @@ vkr_device_destroy(struct vkr_context *ctx, struct vkr_device *dev)
 
    if (!LIST_IS_EMPTY(&dev->objects)) {
       struct vkr_object *obj, *obj_tmp;
-      LIST_FOR_EACH_ENTRY_SAFE (obj, obj_tmp, &dev->objects, track_head)
+      LIST_FOR_EACH_ENTRY_SAFE (obj, obj_tmp, &dev->objects, track_head) {
+         /* keep what the guest caches have learned */
+         if (obj->type == VK_OBJECT_TYPE_PIPELINE_CACHE)
+            vkr_device_merge_host_pipeline_cache(dev, (struct vkr_pipeline_cache *)obj);
          vkr_device_object_destroy(ctx, dev, obj);
+      }
    }
 
+   /* slabs are freed with their last suballocations */
+   assert(list_is_empty(&dev->memory_slabs));
+
+   vkr_device_fini_host_pipeline_cache(dev);
+
    struct vkr_queue *queue, *queue_tmp;
    LIST_FOR_EACH_ENTRY_SAFE (queue, queue_tmp, &dev->queues, base.track_head)
       vkr_queue_destroy(ctx, queue);
@@ -307,9 +441,9 @@ vkr_dispatch_vkGetDeviceGroupPeerMemoryFeatures(
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetDeviceGroupPeerMemoryFeatures_args_handle(args);
-   vk->GetDeviceGroupPeerMemoryFeatures(args->device, args->heapIndex,
-                                        args->localDeviceIndex, args->remoteDeviceIndex,
-                                        args->pPeerMemoryFeatures);
+   VKR_DRIVER_CALL(vk->GetDeviceGroupPeerMemoryFeatures(
+      args->device, args->heapIndex, args->localDeviceIndex, args->remoteDeviceIndex,
+      args->pPeerMemoryFeatures));
 }
 
 static void
@@ -330,9 +464,9 @@ vkr_dispatch_vkGetCalibratedTimestampsEXT(
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetCalibratedTimestampsEXT_args_handle(args);
-   args->ret = vk->GetCalibratedTimestampsEXT(args->device, args->timestampCount,
-                                              args->pTimestampInfos, args->pTimestamps,
-                                              args->pMaxDeviation);
+   VKR_DRIVER_CALL(args->ret = vk->GetCalibratedTimestampsEXT(
+      args->device, args->timestampCount, args->pTimestampInfos, args->pTimestamps,
+      args->pMaxDeviation));
 }
 
 void
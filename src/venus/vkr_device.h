@@ -21,19 +21,58 @@ struct vkr_device {
 
    struct list_head queues;
 
+   /* queue syncs are signaled through per-queue timeline semaphores instead
+    * of a VkFence each
+    */
+   bool timeline_retire;
+
+   /* a cache for the pipelines created without a guest cache, persisted to
+    * VKR_PIPELINE_CACHE_DIR; NULL if not enabled
+    */
+   struct vkr_pipeline_cache *host_pipeline_cache;
+   /* pipeline creations deferred to the compiler threads */
+   struct list_head pipeline_jobs;
+   /* slabs of suballocated host-visible memories */
+   struct list_head memory_slabs;
+   /* memory types with resources whose alignments exceed what suballocations
+    * guarantee
+    */
+   uint32_t unsuballocatable_memory_type_bits;
+
    mtx_t free_sync_mutex;
    struct list_head free_syncs;
 
    struct list_head objects;
+
+   /* With VKR_PERF=deferred_destroy, destroyed objects whose driver handles
+    * are yet to be destroyed.  The device is on vkr_context::deferred_devices
+    * while the list is non-empty.
+    */
+   struct list_head deferred_objects;
+   struct list_head deferred_head;
 };
 VKR_DEFINE_OBJECT_CAST(device, VK_OBJECT_TYPE_DEVICE, VkDevice)
 
+/* the number of deferred objects destroyed at each safe point */
+#define VKR_DEVICE_DEFERRED_DESTROY_BATCH_COUNT 1024
+
 void
 vkr_context_init_device_dispatch(struct vkr_context *ctx);
 
 void
 vkr_device_destroy(struct vkr_context *ctx, struct vkr_device *dev);
 
+void
+vkr_device_object_destroy_driver_handle(struct vkr_device *dev, struct vkr_object *obj);
+
+bool
+vkr_device_defer_object_destroy(struct vkr_context *ctx,
+                                struct vkr_device *dev,
+                                struct vkr_object *obj);
+
+void
+vkr_context_flush_deferred_objects(struct vkr_context *ctx);
+
 static inline bool
 vkr_device_should_track_object(const struct vkr_object *obj)
 {
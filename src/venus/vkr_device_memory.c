@@ -6,12 +6,304 @@
 #include "vkr_device_memory.h"
 
 #include <gbm.h>
+#include <unistd.h>
 
 #include "venus-protocol/vn_protocol_renderer_transport.h"
 
 #include "vkr_device_memory_gen.h"
 #include "vkr_physical_device.h"
 
+/* small host-visible memories are suballocated from slabs of this size */
+#define VKR_DEVICE_MEMORY_SLAB_SIZE (4u * 1024 * 1024)
+#define VKR_DEVICE_MEMORY_SUBALLOCATION_MAX_SIZE (256u * 1024)
+
+/* Suballocations are aligned to this such that each can be mapped on its own
+ * and such that resources bound to them stay aligned in the slab.  Memory
+ * types used by resources requiring more are not suballocated from.  Binds
+ * are still validated because a memory can be allocated before any
+ * requirement is queried.
+ */
+#define VKR_DEVICE_MEMORY_SUBALLOCATION_MAX_ALIGNMENT (64u * 1024)
+/* the smallest page size, which bounds the number of free ranges */
+#define VKR_DEVICE_MEMORY_SUBALLOCATION_MIN_PAGE_SIZE 4096u
+
+struct vkr_device_memory_range {
+   uint64_t offset;
+   uint64_t size;
+};
+
+struct vkr_device_memory_slab {
+   struct vkr_context *context;
+   struct vkr_device *device;
+   uint32_t memory_type_index;
+   VkDeviceMemory memory;
+
+   /* dma_buf of the slab, exported on first use and duplicated for each
+    * exported suballocation
+    */
+   int fd;
+
+   uint32_t suballocation_count;
+
+   /* Sorted by offset and coalesced on free.  Free ranges are separated by
+    * allocated ranges and both are page-aligned, which bounds the count.
+    */
+   struct vkr_device_memory_range
+      free_ranges[VKR_DEVICE_MEMORY_SLAB_SIZE /
+                  VKR_DEVICE_MEMORY_SUBALLOCATION_MIN_PAGE_SIZE / 2 + 1];
+   uint32_t free_range_count;
+
+   /* in vkr_device::memory_slabs */
+   struct list_head head;
+};
+
+static uint64_t
+vkr_device_memory_page_size(void)
+{
+   static uint64_t page_size;
+   if (!page_size) {
+      const long ret = sysconf(_SC_PAGESIZE);
+      page_size = ret > 0 ? (uint64_t)ret : VKR_DEVICE_MEMORY_SUBALLOCATION_MIN_PAGE_SIZE;
+   }
+   return page_size;
+}
+
+static struct vkr_device_memory_slab *
+vkr_device_memory_slab_create(struct vkr_context *ctx,
+                              struct vkr_device *dev,
+                              uint32_t mem_type_index)
+{
+   struct vn_device_proc_table *vk = &dev->proc_table;
+
+   struct vkr_device_memory_slab *slab = calloc(1, sizeof(*slab));
+   if (!slab)
+      return NULL;
+
+   const VkExportMemoryAllocateInfo export_info = {
+      .sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO,
+      .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+   };
+   const VkMemoryAllocateInfo alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+      .pNext = &export_info,
+      .allocationSize = VKR_DEVICE_MEMORY_SLAB_SIZE,
+      .memoryTypeIndex = mem_type_index,
+   };
+   VkResult result;
+   VKR_DRIVER_CALL(result = vk->AllocateMemory(dev->base.handle.device, &alloc_info, NULL,
+                                               &slab->memory));
+   if (result != VK_SUCCESS) {
+      free(slab);
+      return NULL;
+   }
+
+   slab->context = ctx;
+   slab->device = dev;
+   slab->memory_type_index = mem_type_index;
+   slab->fd = -1;
+   slab->free_ranges[0] = (struct vkr_device_memory_range){
+      .offset = 0,
+      .size = VKR_DEVICE_MEMORY_SLAB_SIZE,
+   };
+   slab->free_range_count = 1;
+
+   list_add(&slab->head, &dev->memory_slabs);
+
+   struct vkr_context_memory_stats *stats = &ctx->memory_stats;
+   stats->slab_count++;
+   stats->slab_peak_count = MAX2(stats->slab_peak_count, stats->slab_count);
+   stats->slab_size += VKR_DEVICE_MEMORY_SLAB_SIZE;
+   stats->slab_alloc_count++;
+
+   return slab;
+}
+
+static void
+vkr_device_memory_slab_destroy(struct vkr_device_memory_slab *slab)
+{
+   struct vkr_device *dev = slab->device;
+   struct vn_device_proc_table *vk = &dev->proc_table;
+
+   assert(!slab->suballocation_count);
+   if (slab->fd >= 0)
+      close(slab->fd);
+   vk->FreeMemory(dev->base.handle.device, slab->memory, NULL);
+
+   struct vkr_context_memory_stats *stats = &slab->context->memory_stats;
+   stats->slab_count--;
+   stats->slab_size -= VKR_DEVICE_MEMORY_SLAB_SIZE;
+
+   list_del(&slab->head);
+   free(slab);
+}
+
+static bool
+vkr_device_memory_slab_alloc(struct vkr_device_memory_slab *slab,
+                             uint64_t size,
+                             uint64_t alignment,
+                             uint64_t *out_offset)
+{
+   struct vkr_device_memory_range *ranges = slab->free_ranges;
+
+   /* first fit */
+   for (uint32_t i = 0; i < slab->free_range_count; i++) {
+      const uint64_t offset = align64(ranges[i].offset, alignment);
+      const uint64_t end = ranges[i].offset + ranges[i].size;
+      if (offset + size > end)
+         continue;
+
+      const uint64_t head_size = offset - ranges[i].offset;
+      const uint64_t tail_size = end - offset - size;
+      const uint32_t tail_count = slab->free_range_count - i - 1;
+      if (head_size && tail_size) {
+         assert(slab->free_range_count < ARRAY_SIZE(slab->free_ranges));
+         memmove(&ranges[i + 2], &ranges[i + 1], sizeof(*ranges) * tail_count);
+         ranges[i].size = head_size;
+         ranges[i + 1] = (struct vkr_device_memory_range){
+            .offset = offset + size,
+            .size = tail_size,
+         };
+         slab->free_range_count++;
+      } else if (head_size) {
+         ranges[i].size = head_size;
+      } else if (tail_size) {
+         ranges[i].offset = offset + size;
+         ranges[i].size = tail_size;
+      } else {
+         memmove(&ranges[i], &ranges[i + 1], sizeof(*ranges) * tail_count);
+         slab->free_range_count--;
+      }
+
+      slab->suballocation_count++;
+      *out_offset = offset;
+      return true;
+   }
+
+   return false;
+}
+
+static void
+vkr_device_memory_slab_free(struct vkr_device_memory_slab *slab,
+                            uint64_t offset,
+                            uint64_t size)
+{
+   struct vkr_device_memory_range *ranges = slab->free_ranges;
+
+   uint32_t i = 0;
+   while (i < slab->free_range_count && ranges[i].offset < offset)
+      i++;
+
+   /* coalesce with the neighboring free ranges */
+   const uint32_t tail_count = slab->free_range_count - i;
+   const bool merge_prev = i && ranges[i - 1].offset + ranges[i - 1].size == offset;
+   const bool merge_next = tail_count && offset + size == ranges[i].offset;
+   if (merge_prev && merge_next) {
+      ranges[i - 1].size += size + ranges[i].size;
+      memmove(&ranges[i], &ranges[i + 1], sizeof(*ranges) * (tail_count - 1));
+      slab->free_range_count--;
+   } else if (merge_prev) {
+      ranges[i - 1].size += size;
+   } else if (merge_next) {
+      ranges[i].offset = offset;
+      ranges[i].size += size;
+   } else {
+      assert(slab->free_range_count < ARRAY_SIZE(slab->free_ranges));
+      memmove(&ranges[i + 1], &ranges[i], sizeof(*ranges) * tail_count);
+      ranges[i] = (struct vkr_device_memory_range){
+         .offset = offset,
+         .size = size,
+      };
+      slab->free_range_count++;
+   }
+
+   struct vkr_context_memory_stats *stats = &slab->context->memory_stats;
+   stats->suballocation_count--;
+   stats->suballocation_size -= size;
+
+   assert(slab->suballocation_count);
+   if (!--slab->suballocation_count)
+      vkr_device_memory_slab_destroy(slab);
+}
+
+static bool
+vkr_device_memory_can_suballocate(const struct vkr_device *dev,
+                                  const VkMemoryAllocateInfo *alloc_info,
+                                  uint32_t property_flags)
+{
+   /* Only plain allocations are suballocated.  Anything in pNext (import,
+    * export, dedicated, or device address) needs a memory of its own.  The
+    * slabs are exported as dma_bufs such that the suballocations can be
+    * mapped at their offsets.
+    */
+   return VKR_PERF(SUBALLOCATE_MEMORY) &&
+          (property_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+          dev->physical_device->is_dma_buf_fd_export_supported && !alloc_info->pNext &&
+          alloc_info->allocationSize <= VKR_DEVICE_MEMORY_SUBALLOCATION_MAX_SIZE &&
+          vkr_device_memory_page_size() <= VKR_DEVICE_MEMORY_SUBALLOCATION_MAX_ALIGNMENT &&
+          !(dev->unsuballocatable_memory_type_bits &
+            (1u << alloc_info->memoryTypeIndex));
+}
+
+/* Returns NULL when the memory should be allocated from the driver instead. */
+static struct vkr_device_memory *
+vkr_device_memory_suballocate(struct vkr_context *ctx,
+                              struct vkr_device *dev,
+                              struct vn_command_vkAllocateMemory *args,
+                              uint32_t property_flags)
+{
+   const VkMemoryAllocateInfo *alloc_info = args->pAllocateInfo;
+   const uint64_t page_size = vkr_device_memory_page_size();
+   const uint64_t size = align64(alloc_info->allocationSize, page_size);
+   const uint64_t alignment = VKR_DEVICE_MEMORY_SUBALLOCATION_MAX_ALIGNMENT;
+
+   struct vkr_device_memory *mem = vkr_context_alloc_object(
+      ctx, sizeof(*mem), VK_OBJECT_TYPE_DEVICE_MEMORY, args->pMemory);
+   if (!mem)
+      return NULL;
+
+   struct vkr_device_memory_slab *slab = NULL;
+   uint64_t offset;
+   list_for_each_entry (struct vkr_device_memory_slab, iter, &dev->memory_slabs, head) {
+      if (iter->memory_type_index == alloc_info->memoryTypeIndex &&
+          vkr_device_memory_slab_alloc(iter, size, alignment, &offset)) {
+         slab = iter;
+         break;
+      }
+   }
+
+   if (!slab) {
+      slab = vkr_device_memory_slab_create(ctx, dev, alloc_info->memoryTypeIndex);
+      if (!slab) {
+         free(mem);
+         return NULL;
+      }
+
+      ASSERTED const bool ok =
+         vkr_device_memory_slab_alloc(slab, size, alignment, &offset);
+      assert(ok);
+   }
+
+   mem->base.handle.device_memory = slab->memory;
+   mem->device = dev;
+   mem->property_flags = property_flags;
+   mem->valid_fd_types = 1 << VIRGL_RESOURCE_FD_DMABUF;
+   mem->allocation_size = alloc_info->allocationSize;
+   mem->memory_type_index = alloc_info->memoryTypeIndex;
+   mem->slab = slab;
+   mem->slab_offset = offset;
+
+   vkr_device_add_object(ctx, dev, &mem->base);
+
+   struct vkr_context_memory_stats *stats = &ctx->memory_stats;
+   stats->suballocation_count++;
+   stats->suballocation_peak_count =
+      MAX2(stats->suballocation_peak_count, stats->suballocation_count);
+   stats->suballocation_size += size;
+   stats->suballocation_alloc_count++;
+
+   return mem;
+}
+
 static bool
 vkr_get_fd_info_from_resource_info(struct vkr_context *ctx,
                                    const VkImportMemoryResourceInfoMESA *res_info,
@@ -120,6 +412,14 @@ vkr_dispatch_vkAllocateMemory(struct vn_dispatch_context *dispatch,
    uint32_t valid_fd_types = 0;
    struct gbm_bo *gbm_bo = NULL;
 
+   if (vkr_device_memory_can_suballocate(dev, args->pAllocateInfo, property_flags)) {
+      if (vkr_device_memory_suballocate(ctx, dev, args, property_flags)) {
+         args->ret = VK_SUCCESS;
+         return;
+      }
+      ctx->memory_stats.fallback_count++;
+   }
+
    /* translate VkImportMemoryResourceInfoMESA into VkImportMemoryFdInfoKHR in place */
    prev_of_res_info = vkr_find_prev_struct(
       args->pAllocateInfo, VK_STRUCTURE_TYPE_IMPORT_MEMORY_RESOURCE_INFO_MESA);
@@ -181,8 +481,9 @@ vkr_dispatch_vkAllocateMemory(struct vn_dispatch_context *dispatch,
             export_info = NULL;
          }
 
-         result = vkr_get_fd_info_from_allocation_info(physical_dev, args->pAllocateInfo,
-                                                       &gbm_bo, &local_import_info);
+         result = vkr_get_fd_info_from_allocation_info(dev->physical_device,
+                                                       args->pAllocateInfo, &gbm_bo,
+                                                       &local_import_info);
          if (result != VK_SUCCESS) {
             args->ret = result;
             return;
@@ -222,12 +523,20 @@ static void
 vkr_dispatch_vkFreeMemory(struct vn_dispatch_context *dispatch,
                           struct vn_command_vkFreeMemory *args)
 {
+   struct vkr_context *ctx = dispatch->data;
    struct vkr_device_memory *mem = vkr_device_memory_from_handle(args->memory);
    if (!mem)
       return;
 
+   /* the driver memory of a suballocation belongs to the slab */
+   const bool suballocated = mem->slab;
    vkr_device_memory_release(mem);
-   vkr_device_memory_destroy_and_remove(dispatch->data, args);
+   if (suballocated) {
+      vkr_device_remove_object(ctx, mem->device, &mem->base);
+      return;
+   }
+
+   vkr_device_memory_destroy_and_remove(ctx, args);
 }
 
 static void
@@ -239,8 +548,8 @@ vkr_dispatch_vkGetDeviceMemoryCommitment(
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetDeviceMemoryCommitment_args_handle(args);
-   vk->GetDeviceMemoryCommitment(args->device, args->memory,
-                                 args->pCommittedMemoryInBytes);
+   VKR_DRIVER_CALL(vk->GetDeviceMemoryCommitment(args->device, args->memory,
+                                                 args->pCommittedMemoryInBytes));
 }
 
 static void
@@ -252,7 +561,8 @@ vkr_dispatch_vkGetDeviceMemoryOpaqueCaptureAddress(
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetDeviceMemoryOpaqueCaptureAddress_args_handle(args);
-   args->ret = vk->GetDeviceMemoryOpaqueCaptureAddress(args->device, args->pInfo);
+   VKR_DRIVER_CALL(args->ret = vk->GetDeviceMemoryOpaqueCaptureAddress(args->device,
+                                                                       args->pInfo));
 }
 
 static void
@@ -284,8 +594,8 @@ vkr_dispatch_vkGetMemoryResourcePropertiesMESA(
       .memoryTypeBits = 0,
    };
    vn_replace_vkGetMemoryResourcePropertiesMESA_args_handle(args);
-   args->ret =
-      vk->GetMemoryFdPropertiesKHR(args->device, handle_type, res->u.fd, &mem_fd_props);
+   VKR_DRIVER_CALL(args->ret = vk->GetMemoryFdPropertiesKHR(args->device, handle_type,
+                                                            res->u.fd, &mem_fd_props));
    if (args->ret != VK_SUCCESS)
       return;
 
@@ -323,6 +633,65 @@ vkr_device_memory_release(struct vkr_device_memory *mem)
 {
    if (mem->gbm_bo)
       gbm_bo_destroy(mem->gbm_bo);
+
+   if (mem->slab) {
+      vkr_device_memory_slab_free(
+         mem->slab, mem->slab_offset,
+         align64(mem->allocation_size, vkr_device_memory_page_size()));
+   }
+}
+
+void
+vkr_device_memory_check_requirements(struct vkr_device *dev,
+                                     const VkMemoryRequirements *reqs)
+{
+   /* Suballocations are not aligned enough for such resources.  Memories are
+    * usually allocated after their requirements are queried, so stop
+    * suballocating from the memory types the resources can be bound to.
+    */
+   if (reqs->alignment > VKR_DEVICE_MEMORY_SUBALLOCATION_MAX_ALIGNMENT)
+      dev->unsuballocatable_memory_type_bits |= reqs->memoryTypeBits;
+}
+
+bool
+vkr_device_memory_check_bind(struct vkr_device *dev,
+                             VkDeviceMemory memory,
+                             VkDeviceSize offset,
+                             const VkMemoryRequirements *reqs)
+{
+   const struct vkr_device_memory *mem = vkr_device_memory_from_handle(memory);
+   assert(mem && mem->slab);
+
+   vkr_device_memory_check_requirements(dev, reqs);
+
+   if (offset % reqs->alignment) {
+      vkr_log("suballocated mem at offset %" PRIu64 " is not aligned to %" PRIu64,
+              offset, reqs->alignment);
+      return false;
+   }
+
+   return true;
+}
+
+static bool
+vkr_device_memory_export_slab(struct vkr_device_memory_slab *slab,
+                              VkExternalMemoryHandleTypeFlagBits handle_type,
+                              int *out_fd)
+{
+   struct vn_device_proc_table *vk = &slab->device->proc_table;
+   const VkMemoryGetFdInfoKHR fd_info = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR,
+      .memory = slab->memory,
+      .handleType = handle_type,
+   };
+   const VkResult ret =
+      vk->GetMemoryFdKHR(slab->device->base.handle.device, &fd_info, out_fd);
+   if (ret != VK_SUCCESS) {
+      vkr_log("slab fd export failed (vk ret %d)", ret);
+      return false;
+   }
+
+   return true;
 }
 
 bool
@@ -339,6 +708,21 @@ vkr_device_memory_export_blob(struct vkr_device_memory *mem,
       return false;
    }
 
+   if (mem->slab) {
+      /* the fd refers to the whole slab */
+      if (blob_flags & VIRGL_RENDERER_BLOB_FLAG_USE_CROSS_DEVICE) {
+         vkr_log("suballocated mem cannot be shared cross device");
+         return false;
+      }
+
+      const uint64_t size = align64(mem->allocation_size, vkr_device_memory_page_size());
+      if (blob_size > size) {
+         vkr_log("suballocated mem size %" PRIu64 " < blob_size %" PRIu64, size,
+                 blob_size);
+         return false;
+      }
+   }
+
    uint32_t map_info = VIRGL_RENDERER_MAP_CACHE_NONE;
    if (blob_flags & VIRGL_RENDERER_BLOB_FLAG_USE_MAPPABLE) {
       const bool visible = mem->property_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
@@ -401,6 +785,16 @@ vkr_device_memory_export_blob(struct vkr_device_memory *mem,
          vkr_log("mem gbm_bo_get_fd failed (ret %d)", fd);
          return false;
       }
+   } else if (mem->slab) {
+      if (mem->slab->fd < 0 &&
+          !vkr_device_memory_export_slab(mem->slab, handle_type, &mem->slab->fd))
+         return false;
+
+      fd = os_dupfd_cloexec(mem->slab->fd);
+      if (fd < 0) {
+         vkr_log("failed to dup slab fd");
+         return false;
+      }
    } else {
       struct vn_device_proc_table *vk = &mem->device->proc_table;
       const VkMemoryGetFdInfoKHR fd_info = {
@@ -417,7 +811,7 @@ vkr_device_memory_export_blob(struct vkr_device_memory *mem,
 
    if (fd_type == VIRGL_RESOURCE_FD_DMABUF) {
       const off_t dma_buf_size = lseek(fd, 0, SEEK_END);
-      if (dma_buf_size < 0 || (uint64_t)dma_buf_size < blob_size) {
+      if (dma_buf_size < 0 || (uint64_t)dma_buf_size < mem->slab_offset + blob_size) {
          vkr_log("mem dma_buf_size %lld < blob_size %" PRIu64, (long long)dma_buf_size,
                  blob_size);
          close(fd);
@@ -431,6 +825,8 @@ vkr_device_memory_export_blob(struct vkr_device_memory *mem,
       .type = fd_type,
       .u.fd = fd,
       .map_info = map_info,
+      .map_offset = mem->slab_offset,
+      .suballocated = mem->slab != NULL,
       .vulkan_info = vulkan_info,
    };
 
@@ -9,6 +9,7 @@
 #include "vkr_common.h"
 
 struct gbm_bo;
+struct vkr_device_memory_slab;
 
 struct vkr_device_memory {
    struct vkr_object base;
@@ -23,6 +24,12 @@ struct vkr_device_memory {
    uint64_t allocation_size;
    uint32_t memory_type_index;
 
+   /* when suballocated, base.handle is the VkDeviceMemory of the slab and
+    * offsets into the memory must be adjusted by slab_offset
+    */
+   struct vkr_device_memory_slab *slab;
+   uint64_t slab_offset;
+
    bool exported;
 };
 VKR_DEFINE_OBJECT_CAST(device_memory, VK_OBJECT_TYPE_DEVICE_MEMORY, VkDeviceMemory)
@@ -33,6 +40,36 @@ vkr_context_init_device_memory_dispatch(struct vkr_context *ctx);
 void
 vkr_device_memory_release(struct vkr_device_memory *mem);
 
+void
+vkr_device_memory_check_requirements(struct vkr_device *dev,
+                                     const VkMemoryRequirements *reqs);
+
+/* Check a bind to a suballocated memory against the requirements of the
+ * resource.  offset must be adjusted already.
+ */
+bool
+vkr_device_memory_check_bind(struct vkr_device *dev,
+                             VkDeviceMemory memory,
+                             VkDeviceSize offset,
+                             const VkMemoryRequirements *reqs);
+
+static inline bool
+vkr_device_memory_is_suballocated(VkDeviceMemory memory)
+{
+   /* memory is still a vkr_device_memory before the handles are replaced */
+   const struct vkr_device_memory *mem = vkr_device_memory_from_handle(memory);
+   return mem && mem->slab;
+}
+
+static inline void
+vkr_device_memory_adjust_offset(VkDeviceMemory memory, VkDeviceSize *offset)
+{
+   /* memory is still a vkr_device_memory before the handles are replaced */
+   const struct vkr_device_memory *mem = vkr_device_memory_from_handle(memory);
+   if (mem)
+      *offset += mem->slab_offset;
+}
+
 bool
 vkr_device_memory_export_blob(struct vkr_device_memory *mem,
                               uint64_t blob_size,
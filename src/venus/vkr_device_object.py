@@ -18,8 +18,8 @@ vkr_{create_func_name}_create_driver_handle(
 
    /* handles in args are replaced */
    vn_replace_{create_cmd}_args_handle(args);
-   args->ret = vk->{proc_create}(args->device, args->{create_info}, NULL,
-      &obj->base.handle.{vkr_type});
+   VKR_DRIVER_CALL(args->ret = vk->{proc_create}(args->device,
+      args->{create_info}, NULL, &obj->base.handle.{vkr_type}));
    return args->ret;
 }}
 '''
@@ -39,8 +39,8 @@ VkResult vkr_{create_func_name}_create_driver_handles(
 
    /* handles in args are replaced */
    vn_replace_{create_cmd}_args_handle(args);
-   args->ret = vk->{proc_create}(args->device, args->{create_info},
-      arr->handle_storage);
+   VKR_DRIVER_CALL(args->ret = vk->{proc_create}(args->device,
+      args->{create_info}, arr->handle_storage));
    return args->ret;
 }}
 '''
@@ -58,9 +58,9 @@ vkr_{create_func_name}_create_driver_handles(
 
    /* handles in args are replaced */
    vn_replace_{create_cmd}_args_handle(args);
-   args->ret = vk->{proc_create}(args->device, args->{create_cache},
-      args->{create_count}, args->{create_info}, NULL,
-      arr->handle_storage);
+   VKR_DRIVER_CALL(args->ret = vk->{proc_create}(args->device,
+      args->{create_cache}, args->{create_count}, args->{create_info}, NULL,
+      arr->handle_storage));
    return args->ret;
 }}
 '''
@@ -77,7 +77,7 @@ vkr_{destroy_func_name}_destroy_driver_handle(
 
    /* handles in args are replaced */
    vn_replace_{destroy_cmd}_args_handle(args);
-   vk->{proc_destroy}(args->device, args->{destroy_obj}, NULL);
+   VKR_DRIVER_CALL(vk->{proc_destroy}(args->device, args->{destroy_obj}, NULL));
 }}
 '''
 
@@ -107,8 +107,8 @@ vkr_{destroy_func_name}_destroy_driver_handles(
 
    /* handles in args are replaced */
    vn_replace_{destroy_cmd}_args_handle(args);
-   vk->{proc_destroy}(args->device, args->{destroy_pool},
-      args->{destroy_count}, args->{destroy_objs});
+   VKR_DRIVER_CALL(vk->{proc_destroy}(args->device, args->{destroy_pool},
+      args->{destroy_count}, args->{destroy_objs}));
 }}
 '''
 
@@ -274,6 +274,10 @@ vkr_{destroy_func_name}_destroy_and_remove(
    if (!obj)
       return;
 
+   /* the driver handle might be destroyed later in a batch */
+   if (vkr_device_defer_object_destroy(ctx, dev, &obj->base))
+      return;
+
    vkr_{destroy_func_name}_destroy_driver_handle(ctx, args);
 
    vkr_device_remove_object(ctx, dev, &obj->base);
@@ -5,6 +5,7 @@
 
 #include "vkr_image.h"
 
+#include "vkr_device_memory.h"
 #include "vkr_image_gen.h"
 #include "vkr_physical_device.h"
 
@@ -50,7 +51,9 @@ vkr_dispatch_vkGetImageMemoryRequirements(
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetImageMemoryRequirements_args_handle(args);
-   vk->GetImageMemoryRequirements(args->device, args->image, args->pMemoryRequirements);
+   VKR_DRIVER_CALL(vk->GetImageMemoryRequirements(args->device, args->image,
+                                                  args->pMemoryRequirements));
+   vkr_device_memory_check_requirements(dev, args->pMemoryRequirements);
 }
 
 static void
@@ -62,7 +65,10 @@ vkr_dispatch_vkGetImageMemoryRequirements2(
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetImageMemoryRequirements2_args_handle(args);
-   vk->GetImageMemoryRequirements2(args->device, args->pInfo, args->pMemoryRequirements);
+   VKR_DRIVER_CALL(vk->GetImageMemoryRequirements2(args->device, args->pInfo,
+                                                   args->pMemoryRequirements));
+   vkr_device_memory_check_requirements(dev,
+                                        &args->pMemoryRequirements->memoryRequirements);
 }
 
 static void
@@ -74,9 +80,9 @@ vkr_dispatch_vkGetImageSparseMemoryRequirements(
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetImageSparseMemoryRequirements_args_handle(args);
-   vk->GetImageSparseMemoryRequirements(args->device, args->image,
-                                        args->pSparseMemoryRequirementCount,
-                                        args->pSparseMemoryRequirements);
+   VKR_DRIVER_CALL(vk->GetImageSparseMemoryRequirements(
+      args->device, args->image, args->pSparseMemoryRequirementCount,
+      args->pSparseMemoryRequirements));
 }
 
 static void
@@ -88,9 +94,43 @@ vkr_dispatch_vkGetImageSparseMemoryRequirements2(
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetImageSparseMemoryRequirements2_args_handle(args);
-   vk->GetImageSparseMemoryRequirements2(args->device, args->pInfo,
-                                         args->pSparseMemoryRequirementCount,
-                                         args->pSparseMemoryRequirements);
+   VKR_DRIVER_CALL(vk->GetImageSparseMemoryRequirements2(
+      args->device, args->pInfo, args->pSparseMemoryRequirementCount,
+      args->pSparseMemoryRequirements));
+}
+
+/* info->memoryOffset must be adjusted already */
+static bool
+vkr_image_check_bind(struct vkr_device *dev, const VkBindImageMemoryInfo *info)
+{
+   struct vn_device_proc_table *vk = &dev->proc_table;
+
+   if (!vkr_device_memory_is_suballocated(info->memory))
+      return true;
+
+   /* planes of disjoint images are bound separately */
+   const VkBindImagePlaneMemoryInfo *plane_info =
+      vkr_find_struct(info->pNext, VK_STRUCTURE_TYPE_BIND_IMAGE_PLANE_MEMORY_INFO);
+   const VkImagePlaneMemoryRequirementsInfo plane_reqs_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_PLANE_MEMORY_REQUIREMENTS_INFO,
+      .planeAspect = plane_info ? plane_info->planeAspect : 0,
+   };
+
+   /* handles in info are not replaced yet */
+   const struct vkr_image *img = vkr_image_from_handle(info->image);
+   const VkImageMemoryRequirementsInfo2 reqs_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2,
+      .pNext = plane_info ? &plane_reqs_info : NULL,
+      .image = img->base.handle.image,
+   };
+   VkMemoryRequirements2 reqs = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+   };
+   VKR_DRIVER_CALL(
+      vk->GetImageMemoryRequirements2(dev->base.handle.device, &reqs_info, &reqs));
+
+   return vkr_device_memory_check_bind(dev, info->memory, info->memoryOffset,
+                                       &reqs.memoryRequirements);
 }
 
 static void
@@ -100,9 +140,22 @@ vkr_dispatch_vkBindImageMemory(UNUSED struct vn_dispatch_context *dispatch,
    struct vkr_device *dev = vkr_device_from_handle(args->device);
    struct vn_device_proc_table *vk = &dev->proc_table;
 
+   vkr_device_memory_adjust_offset(args->memory, &args->memoryOffset);
+
+   const VkBindImageMemoryInfo info = {
+      .sType = VK_STRUCTURE_TYPE_BIND_IMAGE_MEMORY_INFO,
+      .image = args->image,
+      .memory = args->memory,
+      .memoryOffset = args->memoryOffset,
+   };
+   if (!vkr_image_check_bind(dev, &info)) {
+      args->ret = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+      return;
+   }
+
    vn_replace_vkBindImageMemory_args_handle(args);
-   args->ret =
-      vk->BindImageMemory(args->device, args->image, args->memory, args->memoryOffset);
+   VKR_DRIVER_CALL(args->ret = vk->BindImageMemory(args->device, args->image,
+                                                   args->memory, args->memoryOffset));
 }
 
 static void
@@ -112,8 +165,18 @@ vkr_dispatch_vkBindImageMemory2(UNUSED struct vn_dispatch_context *dispatch,
    struct vkr_device *dev = vkr_device_from_handle(args->device);
    struct vn_device_proc_table *vk = &dev->proc_table;
 
+   for (uint32_t i = 0; i < args->bindInfoCount; i++) {
+      VkBindImageMemoryInfo *info = (VkBindImageMemoryInfo *)&args->pBindInfos[i];
+      vkr_device_memory_adjust_offset(info->memory, &info->memoryOffset);
+      if (!vkr_image_check_bind(dev, info)) {
+         args->ret = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+         return;
+      }
+   }
+
    vn_replace_vkBindImageMemory2_args_handle(args);
-   args->ret = vk->BindImageMemory2(args->device, args->bindInfoCount, args->pBindInfos);
+   VKR_DRIVER_CALL(args->ret = vk->BindImageMemory2(args->device, args->bindInfoCount,
+                                                    args->pBindInfos));
 }
 
 static void
@@ -125,8 +188,8 @@ vkr_dispatch_vkGetImageSubresourceLayout(
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetImageSubresourceLayout_args_handle(args);
-   vk->GetImageSubresourceLayout(args->device, args->image, args->pSubresource,
-                                 args->pLayout);
+   VKR_DRIVER_CALL(vk->GetImageSubresourceLayout(args->device, args->image,
+                                                 args->pSubresource, args->pLayout));
 }
 
 static void
@@ -138,8 +201,8 @@ vkr_dispatch_vkGetImageDrmFormatModifierPropertiesEXT(
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetImageDrmFormatModifierPropertiesEXT_args_handle(args);
-   args->ret = vk->GetImageDrmFormatModifierPropertiesEXT(args->device, args->image,
-                                                          args->pProperties);
+   VKR_DRIVER_CALL(args->ret = vk->GetImageDrmFormatModifierPropertiesEXT(
+      args->device, args->image, args->pProperties));
 }
 
 static void
@@ -195,8 +258,10 @@ vkr_dispatch_vkGetDeviceImageMemoryRequirements(
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetDeviceImageMemoryRequirements_args_handle(args);
-   vk->GetDeviceImageMemoryRequirements(args->device, args->pInfo,
-                                        args->pMemoryRequirements);
+   VKR_DRIVER_CALL(vk->GetDeviceImageMemoryRequirements(args->device, args->pInfo,
+                                                        args->pMemoryRequirements));
+   vkr_device_memory_check_requirements(dev,
+                                        &args->pMemoryRequirements->memoryRequirements);
 }
 
 static void
@@ -208,9 +273,9 @@ vkr_dispatch_vkGetDeviceImageSparseMemoryRequirements(
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetDeviceImageSparseMemoryRequirements_args_handle(args);
-   vk->GetDeviceImageSparseMemoryRequirements(args->device, args->pInfo,
-                                              args->pSparseMemoryRequirementCount,
-                                              args->pSparseMemoryRequirements);
+   VKR_DRIVER_CALL(vk->GetDeviceImageSparseMemoryRequirements(
+      args->device, args->pInfo, args->pSparseMemoryRequirementCount,
+      args->pSparseMemoryRequirements));
 }
 
 void
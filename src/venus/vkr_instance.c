@@ -17,7 +17,7 @@ vkr_dispatch_vkEnumerateInstanceVersion(UNUSED struct vn_dispatch_context *dispa
    vn_replace_vkEnumerateInstanceVersion_args_handle(args);
 
    uint32_t version = 0;
-   args->ret = vkEnumerateInstanceVersion(&version);
+   VKR_DRIVER_CALL(args->ret = vkEnumerateInstanceVersion(&version));
    if (args->ret == VK_SUCCESS)
       version = vkr_api_version_cap_minor(version, VKR_MAX_API_VERSION);
 
@@ -100,7 +100,7 @@ vkr_dispatch_vkCreateInstance(struct vn_dispatch_context *dispatch,
    }
 
    uint32_t instance_version;
-   args->ret = vkEnumerateInstanceVersion(&instance_version);
+   VKR_DRIVER_CALL(args->ret = vkEnumerateInstanceVersion(&instance_version));
    if (args->ret != VK_SUCCESS)
       return;
 
@@ -195,7 +195,8 @@ vkr_dispatch_vkCreateInstance(struct vn_dispatch_context *dispatch,
    instance->api_version = app_info.apiVersion;
 
    vn_replace_vkCreateInstance_args_handle(args);
-   args->ret = vkCreateInstance(create_info, NULL, &instance->base.handle.instance);
+   VKR_DRIVER_CALL(args->ret = vkCreateInstance(create_info, NULL,
+                                                &instance->base.handle.instance));
    if (args->ret != VK_SUCCESS) {
       free(instance);
       return;
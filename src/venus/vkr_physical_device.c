@@ -5,6 +5,8 @@
 
 #include "vkr_physical_device.h"
 
+#define XXH_INLINE_ALL
+#include "util/xxhash.h"
 #include "venus-protocol/vn_protocol_renderer_device.h"
 #include "vrend_winsys_gbm.h"
 
@@ -12,6 +14,382 @@
 #include "vkr_device.h"
 #include "vkr_instance.h"
 
+/* format caches stop growing at this many entries */
+#define VKR_FORMAT_CACHE_MAX_ENTRY_COUNT 4096
+
+enum vkr_format_query {
+   VKR_FORMAT_QUERY_FORMAT_PROPERTIES = 1,
+   VKR_FORMAT_QUERY_IMAGE_FORMAT_PROPERTIES,
+};
+
+/* output structs that can be cached */
+enum vkr_format_cache_out_struct {
+   VKR_FORMAT_CACHE_OUT_FORMAT_PROPERTIES_3 = 1 << 0,
+   VKR_FORMAT_CACHE_OUT_EXTERNAL_IMAGE_FORMAT_PROPERTIES = 1 << 1,
+   VKR_FORMAT_CACHE_OUT_SAMPLER_YCBCR_CONVERSION_IMAGE_FORMAT_PROPERTIES = 1 << 2,
+};
+
+/* all fields are 32-bit such that there is no padding to hash */
+struct vkr_format_cache_key {
+   uint32_t query;
+   uint32_t out_structs;
+
+   uint32_t format;
+   uint32_t type;
+   uint32_t tiling;
+   uint32_t usage;
+   uint32_t flags;
+   /* VkPhysicalDeviceExternalImageFormatInfo */
+   uint32_t handle_type;
+   /* VkImageStencilUsageCreateInfo */
+   uint32_t stencil_usage;
+};
+
+struct vkr_format_cache_entry {
+   struct vkr_format_cache_key key;
+
+   VkResult result;
+   VkFormatProperties format_props;
+   VkFormatProperties3 format_props3;
+   VkImageFormatProperties image_format_props;
+   VkExternalMemoryProperties external_memory_props;
+   uint32_t combined_image_sampler_descriptor_count;
+};
+
+/* Format queries are answered from a cache shared by the vkr_physical_devices
+ * of all contexts in the process that refer to the same driver device.
+ */
+struct vkr_format_cache {
+   uint32_t vendor_id;
+   uint32_t device_id;
+   uint32_t driver_version;
+   uint8_t device_uuid[VK_UUID_SIZE];
+   uint8_t driver_uuid[VK_UUID_SIZE];
+
+   /* vkr_format_cache_entry keyed by vkr_format_cache_key */
+   struct hash_table *entries;
+
+   struct list_head head;
+};
+
+static struct {
+   bool initialized;
+
+   /* protects the caches and their entries */
+   mtx_t mutex;
+   struct list_head caches;
+} vkr_format_caches;
+
+bool
+vkr_format_cache_init(void)
+{
+   if (mtx_init(&vkr_format_caches.mutex, mtx_plain) != thrd_success)
+      return false;
+
+   list_inithead(&vkr_format_caches.caches);
+   vkr_format_caches.initialized = true;
+
+   return true;
+}
+
+static void
+vkr_format_cache_free_entry(struct hash_entry *entry)
+{
+   free(entry->data);
+}
+
+void
+vkr_format_cache_fini(void)
+{
+   if (!vkr_format_caches.initialized)
+      return;
+
+   list_for_each_entry_safe (struct vkr_format_cache, cache, &vkr_format_caches.caches,
+                             head) {
+      _mesa_hash_table_destroy(cache->entries, vkr_format_cache_free_entry);
+      free(cache);
+   }
+
+   mtx_destroy(&vkr_format_caches.mutex);
+   vkr_format_caches.initialized = false;
+}
+
+static uint32_t
+vkr_format_cache_hash_key(const void *key)
+{
+   return XXH32(key, sizeof(struct vkr_format_cache_key), 0);
+}
+
+static bool
+vkr_format_cache_key_equal(const void *key1, const void *key2)
+{
+   return !memcmp(key1, key2, sizeof(struct vkr_format_cache_key));
+}
+
+static struct vkr_format_cache *
+vkr_format_cache_get(const struct vkr_physical_device *physical_dev)
+{
+   if (!vkr_format_caches.initialized)
+      return NULL;
+
+   const VkPhysicalDeviceProperties *props = &physical_dev->properties;
+   const VkPhysicalDeviceIDProperties *id_props = &physical_dev->id_properties;
+
+   mtx_lock(&vkr_format_caches.mutex);
+
+   list_for_each_entry (struct vkr_format_cache, cache, &vkr_format_caches.caches,
+                        head) {
+      if (cache->vendor_id == props->vendorID && cache->device_id == props->deviceID &&
+          cache->driver_version == props->driverVersion &&
+          !memcmp(cache->device_uuid, id_props->deviceUUID, VK_UUID_SIZE) &&
+          !memcmp(cache->driver_uuid, id_props->driverUUID, VK_UUID_SIZE)) {
+         mtx_unlock(&vkr_format_caches.mutex);
+         return cache;
+      }
+   }
+
+   struct vkr_format_cache *cache = calloc(1, sizeof(*cache));
+   if (cache) {
+      cache->entries = _mesa_hash_table_create(NULL, vkr_format_cache_hash_key,
+                                               vkr_format_cache_key_equal);
+      if (!cache->entries) {
+         free(cache);
+         cache = NULL;
+      }
+   }
+
+   if (cache) {
+      cache->vendor_id = props->vendorID;
+      cache->device_id = props->deviceID;
+      cache->driver_version = props->driverVersion;
+      memcpy(cache->device_uuid, id_props->deviceUUID, VK_UUID_SIZE);
+      memcpy(cache->driver_uuid, id_props->driverUUID, VK_UUID_SIZE);
+      list_add(&cache->head, &vkr_format_caches.caches);
+   }
+
+   mtx_unlock(&vkr_format_caches.mutex);
+
+   return cache;
+}
+
+/* Returns false if an output struct cannot be cached. */
+static bool
+vkr_format_cache_get_out_structs(const void *chain, uint32_t *out_structs)
+{
+   *out_structs = 0;
+   for (const VkBaseOutStructure *s = chain; s; s = s->pNext) {
+      switch (s->sType) {
+      case VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_3:
+         *out_structs |= VKR_FORMAT_CACHE_OUT_FORMAT_PROPERTIES_3;
+         break;
+      case VK_STRUCTURE_TYPE_EXTERNAL_IMAGE_FORMAT_PROPERTIES:
+         *out_structs |= VKR_FORMAT_CACHE_OUT_EXTERNAL_IMAGE_FORMAT_PROPERTIES;
+         break;
+      case VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_IMAGE_FORMAT_PROPERTIES:
+         *out_structs |=
+            VKR_FORMAT_CACHE_OUT_SAMPLER_YCBCR_CONVERSION_IMAGE_FORMAT_PROPERTIES;
+         break;
+      default:
+         return false;
+      }
+   }
+   return true;
+}
+
+static void
+vkr_format_cache_store_out_structs(struct vkr_format_cache_entry *entry,
+                                   const void *chain)
+{
+   for (const VkBaseOutStructure *s = chain; s; s = s->pNext) {
+      switch (s->sType) {
+      case VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_3:
+         entry->format_props3 = *(const VkFormatProperties3 *)s;
+         break;
+      case VK_STRUCTURE_TYPE_EXTERNAL_IMAGE_FORMAT_PROPERTIES:
+         entry->external_memory_props =
+            ((const VkExternalImageFormatProperties *)s)->externalMemoryProperties;
+         break;
+      case VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_IMAGE_FORMAT_PROPERTIES:
+         entry->combined_image_sampler_descriptor_count =
+            ((const VkSamplerYcbcrConversionImageFormatProperties *)s)
+               ->combinedImageSamplerDescriptorCount;
+         break;
+      default:
+         unreachable("uncached output struct");
+      }
+   }
+}
+
+static void
+vkr_format_cache_load_out_structs(const struct vkr_format_cache_entry *entry,
+                                  void *chain)
+{
+   for (VkBaseOutStructure *s = chain; s; s = s->pNext) {
+      switch (s->sType) {
+      case VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_3: {
+         VkFormatProperties3 *props3 = (VkFormatProperties3 *)s;
+         props3->linearTilingFeatures = entry->format_props3.linearTilingFeatures;
+         props3->optimalTilingFeatures = entry->format_props3.optimalTilingFeatures;
+         props3->bufferFeatures = entry->format_props3.bufferFeatures;
+         break;
+      }
+      case VK_STRUCTURE_TYPE_EXTERNAL_IMAGE_FORMAT_PROPERTIES:
+         ((VkExternalImageFormatProperties *)s)->externalMemoryProperties =
+            entry->external_memory_props;
+         break;
+      case VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_IMAGE_FORMAT_PROPERTIES:
+         ((VkSamplerYcbcrConversionImageFormatProperties *)s)
+            ->combinedImageSamplerDescriptorCount =
+            entry->combined_image_sampler_descriptor_count;
+         break;
+      default:
+         unreachable("uncached output struct");
+      }
+   }
+}
+
+/* Returns false if an input struct cannot be cached. */
+static bool
+vkr_format_cache_init_image_format_key(const VkPhysicalDeviceImageFormatInfo2 *info,
+                                       const void *out_chain,
+                                       struct vkr_format_cache_key *key)
+{
+   *key = (struct vkr_format_cache_key){
+      .query = VKR_FORMAT_QUERY_IMAGE_FORMAT_PROPERTIES,
+      .format = info->format,
+      .type = info->type,
+      .tiling = info->tiling,
+      .usage = info->usage,
+      .flags = info->flags,
+   };
+
+   for (const VkBaseInStructure *s = info->pNext; s; s = s->pNext) {
+      switch (s->sType) {
+      case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_IMAGE_FORMAT_INFO:
+         key->handle_type =
+            ((const VkPhysicalDeviceExternalImageFormatInfo *)s)->handleType;
+         break;
+      case VK_STRUCTURE_TYPE_IMAGE_STENCIL_USAGE_CREATE_INFO:
+         key->stencil_usage = ((const VkImageStencilUsageCreateInfo *)s)->stencilUsage;
+         break;
+      default:
+         return false;
+      }
+   }
+
+   return vkr_format_cache_get_out_structs(out_chain, &key->out_structs);
+}
+
+static const struct vkr_format_cache_entry *
+vkr_format_cache_lookup_locked(struct vkr_format_cache *cache,
+                               const struct vkr_format_cache_key *key)
+{
+   const struct hash_entry *entry = _mesa_hash_table_search(cache->entries, key);
+   return entry ? entry->data : NULL;
+}
+
+static void
+vkr_format_cache_insert_locked(struct vkr_format_cache *cache,
+                               const struct vkr_format_cache_entry *entry)
+{
+   /* do not cache transient failures */
+   if (entry->result == VK_ERROR_OUT_OF_HOST_MEMORY ||
+       entry->result == VK_ERROR_OUT_OF_DEVICE_MEMORY)
+      return;
+
+   if (cache->entries->entries >= VKR_FORMAT_CACHE_MAX_ENTRY_COUNT)
+      return;
+
+   /* another context might have missed on the same key concurrently, and
+    * _mesa_hash_table_insert would replace and leak its entry
+    */
+   if (vkr_format_cache_lookup_locked(cache, &entry->key))
+      return;
+
+   struct vkr_format_cache_entry *copy = malloc(sizeof(*copy));
+   if (!copy)
+      return;
+
+   *copy = *entry;
+   if (!_mesa_hash_table_insert(cache->entries, &copy->key, copy))
+      free(copy);
+}
+
+static void
+vkr_format_cache_get_format_properties(struct vkr_physical_device *physical_dev,
+                                       VkFormat format,
+                                       VkFormatProperties2 *props2)
+{
+   struct vkr_format_cache *cache = physical_dev->format_cache;
+   struct vkr_format_cache_entry entry = {
+      .key = {
+         .query = VKR_FORMAT_QUERY_FORMAT_PROPERTIES,
+         .format = format,
+      },
+   };
+   ASSERTED const bool cacheable =
+      vkr_format_cache_get_out_structs(props2->pNext, &entry.key.out_structs);
+   assert(cacheable);
+
+   mtx_lock(&vkr_format_caches.mutex);
+   const struct vkr_format_cache_entry *cached =
+      vkr_format_cache_lookup_locked(cache, &entry.key);
+   if (cached) {
+      props2->formatProperties = cached->format_props;
+      vkr_format_cache_load_out_structs(cached, props2->pNext);
+      mtx_unlock(&vkr_format_caches.mutex);
+      return;
+   }
+   mtx_unlock(&vkr_format_caches.mutex);
+
+   VKR_DRIVER_CALL(vkGetPhysicalDeviceFormatProperties2(
+      physical_dev->base.handle.physical_device, format, props2));
+
+   entry.result = VK_SUCCESS;
+   entry.format_props = props2->formatProperties;
+   vkr_format_cache_store_out_structs(&entry, props2->pNext);
+
+   mtx_lock(&vkr_format_caches.mutex);
+   vkr_format_cache_insert_locked(cache, &entry);
+   mtx_unlock(&vkr_format_caches.mutex);
+}
+
+static VkResult
+vkr_format_cache_get_image_format_properties(
+   struct vkr_physical_device *physical_dev,
+   const struct vkr_format_cache_key *key,
+   const VkPhysicalDeviceImageFormatInfo2 *info,
+   VkImageFormatProperties2 *props2)
+{
+   struct vkr_format_cache *cache = physical_dev->format_cache;
+
+   mtx_lock(&vkr_format_caches.mutex);
+   const struct vkr_format_cache_entry *cached =
+      vkr_format_cache_lookup_locked(cache, key);
+   if (cached) {
+      const VkResult result = cached->result;
+      props2->imageFormatProperties = cached->image_format_props;
+      vkr_format_cache_load_out_structs(cached, props2->pNext);
+      mtx_unlock(&vkr_format_caches.mutex);
+      return result;
+   }
+   mtx_unlock(&vkr_format_caches.mutex);
+
+   struct vkr_format_cache_entry entry = {
+      .key = *key,
+   };
+   VKR_DRIVER_CALL(entry.result = vkGetPhysicalDeviceImageFormatProperties2(
+                      physical_dev->base.handle.physical_device, info, props2));
+   entry.image_format_props = props2->imageFormatProperties;
+   vkr_format_cache_store_out_structs(&entry, props2->pNext);
+
+   mtx_lock(&vkr_format_caches.mutex);
+   vkr_format_cache_insert_locked(cache, &entry);
+   mtx_unlock(&vkr_format_caches.mutex);
+
+   return entry.result;
+}
+
 /* TODO open render node and create gbm_device per vkr_physical_device */
 static struct gbm_device *vkr_gbm_dev;
 
@@ -318,6 +696,7 @@ vkr_dispatch_vkEnumeratePhysicalDevices(struct vn_dispatch_context *dispatch,
       vkr_physical_device_init_extensions(physical_dev, instance);
       vkr_physical_device_init_memory_properties(physical_dev);
       vkr_physical_device_init_id_properties(physical_dev);
+      physical_dev->format_cache = vkr_format_cache_get(physical_dev);
 
       list_inithead(&physical_dev->devices);
 
@@ -371,9 +750,9 @@ vkr_dispatch_vkEnumeratePhysicalDeviceGroups(
    }
 
    vn_replace_vkEnumeratePhysicalDeviceGroups_args_handle(args);
-   args->ret =
-      vkEnumeratePhysicalDeviceGroups(args->instance, args->pPhysicalDeviceGroupCount,
-                                      args->pPhysicalDeviceGroupProperties);
+   VKR_DRIVER_CALL(args->ret = vkEnumeratePhysicalDeviceGroups(
+      args->instance, args->pPhysicalDeviceGroupCount,
+      args->pPhysicalDeviceGroupProperties));
    if (args->ret != VK_SUCCESS)
       return;
 
@@ -440,7 +819,7 @@ vkr_dispatch_vkGetPhysicalDeviceFeatures(
    struct vn_command_vkGetPhysicalDeviceFeatures *args)
 {
    vn_replace_vkGetPhysicalDeviceFeatures_args_handle(args);
-   vkGetPhysicalDeviceFeatures(args->physicalDevice, args->pFeatures);
+   VKR_DRIVER_CALL(vkGetPhysicalDeviceFeatures(args->physicalDevice, args->pFeatures));
 }
 
 static void
@@ -460,9 +839,9 @@ vkr_dispatch_vkGetPhysicalDeviceQueueFamilyProperties(
    struct vn_command_vkGetPhysicalDeviceQueueFamilyProperties *args)
 {
    vn_replace_vkGetPhysicalDeviceQueueFamilyProperties_args_handle(args);
-   vkGetPhysicalDeviceQueueFamilyProperties(args->physicalDevice,
-                                            args->pQueueFamilyPropertyCount,
-                                            args->pQueueFamilyProperties);
+   VKR_DRIVER_CALL(vkGetPhysicalDeviceQueueFamilyProperties(
+      args->physicalDevice, args->pQueueFamilyPropertyCount,
+      args->pQueueFamilyProperties));
 }
 
 static void
@@ -480,9 +859,21 @@ vkr_dispatch_vkGetPhysicalDeviceFormatProperties(
    UNUSED struct vn_dispatch_context *dispatch,
    struct vn_command_vkGetPhysicalDeviceFormatProperties *args)
 {
+   struct vkr_physical_device *physical_dev =
+      vkr_physical_device_from_handle(args->physicalDevice);
+
+   if (physical_dev->format_cache) {
+      VkFormatProperties2 props2 = {
+         .sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2,
+      };
+      vkr_format_cache_get_format_properties(physical_dev, args->format, &props2);
+      *args->pFormatProperties = props2.formatProperties;
+      return;
+   }
+
    vn_replace_vkGetPhysicalDeviceFormatProperties_args_handle(args);
-   vkGetPhysicalDeviceFormatProperties(args->physicalDevice, args->format,
-                                       args->pFormatProperties);
+   VKR_DRIVER_CALL(vkGetPhysicalDeviceFormatProperties(args->physicalDevice, args->format,
+                                                       args->pFormatProperties));
 }
 
 static void
@@ -490,10 +881,36 @@ vkr_dispatch_vkGetPhysicalDeviceImageFormatProperties(
    UNUSED struct vn_dispatch_context *dispatch,
    struct vn_command_vkGetPhysicalDeviceImageFormatProperties *args)
 {
+   struct vkr_physical_device *physical_dev =
+      vkr_physical_device_from_handle(args->physicalDevice);
+
+   if (physical_dev->format_cache) {
+      const VkPhysicalDeviceImageFormatInfo2 info = {
+         .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2,
+         .format = args->format,
+         .type = args->type,
+         .tiling = args->tiling,
+         .usage = args->usage,
+         .flags = args->flags,
+      };
+      VkImageFormatProperties2 props2 = {
+         .sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2,
+      };
+      struct vkr_format_cache_key key;
+      ASSERTED const bool cacheable =
+         vkr_format_cache_init_image_format_key(&info, NULL, &key);
+      assert(cacheable);
+
+      args->ret =
+         vkr_format_cache_get_image_format_properties(physical_dev, &key, &info, &props2);
+      *args->pImageFormatProperties = props2.imageFormatProperties;
+      return;
+   }
+
    vn_replace_vkGetPhysicalDeviceImageFormatProperties_args_handle(args);
-   args->ret = vkGetPhysicalDeviceImageFormatProperties(
+   VKR_DRIVER_CALL(args->ret = vkGetPhysicalDeviceImageFormatProperties(
       args->physicalDevice, args->format, args->type, args->tiling, args->usage,
-      args->flags, args->pImageFormatProperties);
+      args->flags, args->pImageFormatProperties));
 }
 
 static void
@@ -502,9 +919,9 @@ vkr_dispatch_vkGetPhysicalDeviceSparseImageFormatProperties(
    struct vn_command_vkGetPhysicalDeviceSparseImageFormatProperties *args)
 {
    vn_replace_vkGetPhysicalDeviceSparseImageFormatProperties_args_handle(args);
-   vkGetPhysicalDeviceSparseImageFormatProperties(
+   VKR_DRIVER_CALL(vkGetPhysicalDeviceSparseImageFormatProperties(
       args->physicalDevice, args->format, args->type, args->samples, args->usage,
-      args->tiling, args->pPropertyCount, args->pProperties);
+      args->tiling, args->pPropertyCount, args->pProperties));
 }
 
 static void
@@ -513,7 +930,7 @@ vkr_dispatch_vkGetPhysicalDeviceFeatures2(
    struct vn_command_vkGetPhysicalDeviceFeatures2 *args)
 {
    vn_replace_vkGetPhysicalDeviceFeatures2_args_handle(args);
-   vkGetPhysicalDeviceFeatures2(args->physicalDevice, args->pFeatures);
+   VKR_DRIVER_CALL(vkGetPhysicalDeviceFeatures2(args->physicalDevice, args->pFeatures));
 }
 
 static void
@@ -522,7 +939,8 @@ vkr_dispatch_vkGetPhysicalDeviceProperties2(
    struct vn_command_vkGetPhysicalDeviceProperties2 *args)
 {
    vn_replace_vkGetPhysicalDeviceProperties2_args_handle(args);
-   vkGetPhysicalDeviceProperties2(args->physicalDevice, args->pProperties);
+   VKR_DRIVER_CALL(vkGetPhysicalDeviceProperties2(args->physicalDevice,
+                                                  args->pProperties));
 }
 
 static void
@@ -531,9 +949,9 @@ vkr_dispatch_vkGetPhysicalDeviceQueueFamilyProperties2(
    struct vn_command_vkGetPhysicalDeviceQueueFamilyProperties2 *args)
 {
    vn_replace_vkGetPhysicalDeviceQueueFamilyProperties2_args_handle(args);
-   vkGetPhysicalDeviceQueueFamilyProperties2(args->physicalDevice,
-                                             args->pQueueFamilyPropertyCount,
-                                             args->pQueueFamilyProperties);
+   VKR_DRIVER_CALL(vkGetPhysicalDeviceQueueFamilyProperties2(
+      args->physicalDevice, args->pQueueFamilyPropertyCount,
+      args->pQueueFamilyProperties));
 }
 
 static void
@@ -552,6 +970,17 @@ vkr_dispatch_vkGetPhysicalDeviceFormatProperties2(
    struct vn_command_vkGetPhysicalDeviceFormatProperties2 *args)
 {
    struct vkr_context *ctx = dispatch->data;
+   struct vkr_physical_device *physical_dev =
+      vkr_physical_device_from_handle(args->physicalDevice);
+
+   /* queries with DRM format modifier lists are not cached */
+   uint32_t out_structs;
+   if (physical_dev->format_cache &&
+       vkr_format_cache_get_out_structs(args->pFormatProperties->pNext, &out_structs)) {
+      vkr_format_cache_get_format_properties(physical_dev, args->format,
+                                             args->pFormatProperties);
+      return;
+   }
 
    vn_replace_vkGetPhysicalDeviceFormatProperties2_args_handle(args);
 
@@ -598,8 +1027,8 @@ vkr_dispatch_vkGetPhysicalDeviceFormatProperties2(
       }
    }
 
-   vkGetPhysicalDeviceFormatProperties2(args->physicalDevice, args->format,
-                                        args->pFormatProperties);
+   VKR_DRIVER_CALL(vkGetPhysicalDeviceFormatProperties2(
+      args->physicalDevice, args->format, args->pFormatProperties));
 
    if (modifier_list2) {
       modifier_list2->drmFormatModifierCount = local_modifier_list.drmFormatModifierCount;
@@ -630,9 +1059,21 @@ vkr_dispatch_vkGetPhysicalDeviceImageFormatProperties2(
    UNUSED struct vn_dispatch_context *dispatch,
    struct vn_command_vkGetPhysicalDeviceImageFormatProperties2 *args)
 {
+   struct vkr_physical_device *physical_dev =
+      vkr_physical_device_from_handle(args->physicalDevice);
+
+   struct vkr_format_cache_key key;
+   if (physical_dev->format_cache &&
+       vkr_format_cache_init_image_format_key(
+          args->pImageFormatInfo, args->pImageFormatProperties->pNext, &key)) {
+      args->ret = vkr_format_cache_get_image_format_properties(
+         physical_dev, &key, args->pImageFormatInfo, args->pImageFormatProperties);
+      return;
+   }
+
    vn_replace_vkGetPhysicalDeviceImageFormatProperties2_args_handle(args);
-   args->ret = vkGetPhysicalDeviceImageFormatProperties2(
-      args->physicalDevice, args->pImageFormatInfo, args->pImageFormatProperties);
+   VKR_DRIVER_CALL(args->ret = vkGetPhysicalDeviceImageFormatProperties2(
+      args->physicalDevice, args->pImageFormatInfo, args->pImageFormatProperties));
 }
 
 static void
@@ -641,8 +1082,8 @@ vkr_dispatch_vkGetPhysicalDeviceSparseImageFormatProperties2(
    struct vn_command_vkGetPhysicalDeviceSparseImageFormatProperties2 *args)
 {
    vn_replace_vkGetPhysicalDeviceSparseImageFormatProperties2_args_handle(args);
-   vkGetPhysicalDeviceSparseImageFormatProperties2(
-      args->physicalDevice, args->pFormatInfo, args->pPropertyCount, args->pProperties);
+   VKR_DRIVER_CALL(vkGetPhysicalDeviceSparseImageFormatProperties2(
+      args->physicalDevice, args->pFormatInfo, args->pPropertyCount, args->pProperties));
 }
 
 static void
@@ -651,8 +1092,8 @@ vkr_dispatch_vkGetPhysicalDeviceExternalBufferProperties(
    struct vn_command_vkGetPhysicalDeviceExternalBufferProperties *args)
 {
    vn_replace_vkGetPhysicalDeviceExternalBufferProperties_args_handle(args);
-   vkGetPhysicalDeviceExternalBufferProperties(
-      args->physicalDevice, args->pExternalBufferInfo, args->pExternalBufferProperties);
+   VKR_DRIVER_CALL(vkGetPhysicalDeviceExternalBufferProperties(
+      args->physicalDevice, args->pExternalBufferInfo, args->pExternalBufferProperties));
 }
 
 static void
@@ -661,9 +1102,9 @@ vkr_dispatch_vkGetPhysicalDeviceExternalSemaphoreProperties(
    struct vn_command_vkGetPhysicalDeviceExternalSemaphoreProperties *args)
 {
    vn_replace_vkGetPhysicalDeviceExternalSemaphoreProperties_args_handle(args);
-   vkGetPhysicalDeviceExternalSemaphoreProperties(args->physicalDevice,
-                                                  args->pExternalSemaphoreInfo,
-                                                  args->pExternalSemaphoreProperties);
+   VKR_DRIVER_CALL(vkGetPhysicalDeviceExternalSemaphoreProperties(
+      args->physicalDevice, args->pExternalSemaphoreInfo,
+      args->pExternalSemaphoreProperties));
 }
 
 static void
@@ -672,8 +1113,8 @@ vkr_dispatch_vkGetPhysicalDeviceExternalFenceProperties(
    struct vn_command_vkGetPhysicalDeviceExternalFenceProperties *args)
 {
    vn_replace_vkGetPhysicalDeviceExternalFenceProperties_args_handle(args);
-   vkGetPhysicalDeviceExternalFenceProperties(
-      args->physicalDevice, args->pExternalFenceInfo, args->pExternalFenceProperties);
+   VKR_DRIVER_CALL(vkGetPhysicalDeviceExternalFenceProperties(
+      args->physicalDevice, args->pExternalFenceInfo, args->pExternalFenceProperties));
 }
 
 static void
@@ -686,8 +1127,8 @@ vkr_dispatch_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(
    struct vn_physical_device_proc_table *vk = &physical_dev->proc_table;
 
    vn_replace_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT_args_handle(args);
-   args->ret = vk->GetPhysicalDeviceCalibrateableTimeDomainsEXT(
-      args->physicalDevice, args->pTimeDomainCount, args->pTimeDomains);
+   VKR_DRIVER_CALL(args->ret = vk->GetPhysicalDeviceCalibrateableTimeDomainsEXT(
+      args->physicalDevice, args->pTimeDomainCount, args->pTimeDomains));
 }
 
 void
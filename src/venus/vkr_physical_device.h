@@ -11,6 +11,7 @@
 #include "venus-protocol/vn_protocol_renderer_util.h"
 
 struct gbm_device;
+struct vkr_format_cache;
 
 struct vkr_physical_device {
    struct vkr_object base;
@@ -35,10 +36,19 @@ struct vkr_physical_device {
    bool is_opaque_fd_export_supported;
    struct gbm_device *gbm_device;
 
+   /* shared with other contexts; NULL unless VKR_PERF=format_cache */
+   struct vkr_format_cache *format_cache;
+
    struct list_head devices;
 };
 VKR_DEFINE_OBJECT_CAST(physical_device, VK_OBJECT_TYPE_PHYSICAL_DEVICE, VkPhysicalDevice)
 
+bool
+vkr_format_cache_init(void);
+
+void
+vkr_format_cache_fini(void);
+
 void
 vkr_context_init_physical_device_dispatch(struct vkr_context *ctx);
 
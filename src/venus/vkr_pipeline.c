@@ -5,8 +5,617 @@
 
 #include "vkr_pipeline.h"
 
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "util/u_debug.h"
+
+#include "vkr_physical_device.h"
 #include "vkr_pipeline_gen.h"
 
+/* larger cache files are ignored */
+#define VKR_HOST_PIPELINE_CACHE_MAX_SIZE (256u * 1024 * 1024)
+
+#define VKR_PIPELINE_COMPILER_MAX_THREADS 4
+
+/* A pipeline creation deferred to the compiler threads.
+ *
+ * The command is copied and decoded again with a decoder owned by the job
+ * such that the args stay valid after the context decoder moves on.  The
+ * vkr_pipelines are added to the device right away and their handles are
+ * set by vkr_pipeline_job_finish.
+ *
+ * Objects the job might reference are not destroyed until it is finished.
+ * See vkr_device_defer_pipeline_job_object.
+ */
+struct vkr_pipeline_job {
+   struct vkr_device *device;
+
+   void *stream;
+   struct vkr_cs_decoder decoder;
+
+   bool graphics;
+   union {
+      struct vn_command_vkCreateGraphicsPipelines graphics;
+      struct vn_command_vkCreateComputePipelines compute;
+   } args;
+   struct object_array arr;
+   VkResult result;
+
+   /* protected by vkr_pipeline_compiler.mutex */
+   bool running;
+   bool done;
+   struct list_head head;
+
+   /* in vkr_device::pipeline_jobs */
+   struct list_head device_head;
+
+   /* destroyed objects kept until this and all older jobs are finished */
+   struct list_head deferred_objects;
+};
+
+static struct {
+   bool enabled;
+
+   mtx_t mutex;
+   /* signaled when a job is queued or the threads should exit */
+   cnd_t cond;
+   /* signaled when a job is done */
+   cnd_t done_cond;
+   bool join;
+   struct list_head jobs;
+
+   thrd_t threads[VKR_PIPELINE_COMPILER_MAX_THREADS];
+   uint32_t thread_count;
+} vkr_pipeline_compiler;
+
+static bool
+vkr_host_pipeline_cache_get_path(const struct vkr_physical_device *physical_dev,
+                                 char *path,
+                                 size_t path_size)
+{
+   const char *dir = debug_get_option("VKR_PIPELINE_CACHE_DIR", NULL);
+   if (!dir || !*dir)
+      return false;
+
+   /* pipelineCacheUUID alone should be enough but drivers get it wrong */
+   const VkPhysicalDeviceProperties *props = &physical_dev->properties;
+   char uuid[VK_UUID_SIZE * 2 + 1];
+   for (uint32_t i = 0; i < VK_UUID_SIZE; i++)
+      snprintf(uuid + i * 2, 3, "%02x", props->pipelineCacheUUID[i]);
+
+   const int len =
+      snprintf(path, path_size, "%s/vkr-%04x-%04x-%08x-%s.bin", dir, props->vendorID,
+               props->deviceID, props->driverVersion, uuid);
+   return len > 0 && (size_t)len < path_size;
+}
+
+static void *
+vkr_host_pipeline_cache_read_file(const char *path, size_t *out_size)
+{
+   FILE *file = fopen(path, "rbe");
+   if (!file)
+      return NULL;
+
+   void *data = NULL;
+   long size = 0;
+   if (!fseek(file, 0, SEEK_END))
+      size = ftell(file);
+   if (size > 0 && (unsigned long)size <= VKR_HOST_PIPELINE_CACHE_MAX_SIZE &&
+       !fseek(file, 0, SEEK_SET)) {
+      data = malloc(size);
+      if (data && fread(data, size, 1, file) != 1) {
+         free(data);
+         data = NULL;
+      }
+   }
+
+   fclose(file);
+
+   *out_size = data ? (size_t)size : 0;
+   return data;
+}
+
+static void
+vkr_host_pipeline_cache_write_file(const char *path, const void *data, size_t size)
+{
+   /* write to a temporary file and rename it such that concurrent readers
+    * never see a partial file
+    */
+   char tmp_path[PATH_MAX];
+   const int len = snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int)getpid());
+   if (len <= 0 || (size_t)len >= sizeof(tmp_path))
+      return;
+
+   FILE *file = fopen(tmp_path, "wbe");
+   if (!file) {
+      vkr_log("failed to create pipeline cache file %s", tmp_path);
+      return;
+   }
+
+   const bool ok = fwrite(data, size, 1, file) == 1;
+   if (fclose(file) || !ok || rename(tmp_path, path)) {
+      vkr_log("failed to write pipeline cache file %s", path);
+      unlink(tmp_path);
+   }
+}
+
+/* create a driver VkPipelineCache initialized from the cache file */
+static VkPipelineCache
+vkr_host_pipeline_cache_create_driver_handle(struct vkr_device *dev, const char *path)
+{
+   struct vn_device_proc_table *vk = &dev->proc_table;
+
+   size_t size;
+   void *data = vkr_host_pipeline_cache_read_file(path, &size);
+
+   /* the driver ignores incompatible initial data */
+   const VkPipelineCacheCreateInfo create_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+      .initialDataSize = size,
+      .pInitialData = data,
+   };
+   VkPipelineCache cache;
+   const VkResult result =
+      vk->CreatePipelineCache(dev->base.handle.device, &create_info, NULL, &cache);
+
+   free(data);
+
+   return result == VK_SUCCESS ? cache : VK_NULL_HANDLE;
+}
+
+void
+vkr_device_init_host_pipeline_cache(struct vkr_device *dev)
+{
+   char path[PATH_MAX];
+   if (!vkr_host_pipeline_cache_get_path(dev->physical_device, path, sizeof(path)))
+      return;
+
+   /* pipeline creation expects a vkr_object rather than a driver handle */
+   struct vkr_pipeline_cache *cache =
+      vkr_object_alloc(sizeof(*cache), VK_OBJECT_TYPE_PIPELINE_CACHE, UINT64_MAX);
+   if (!cache)
+      return;
+
+   cache->base.handle.pipeline_cache =
+      vkr_host_pipeline_cache_create_driver_handle(dev, path);
+   if (cache->base.handle.pipeline_cache == VK_NULL_HANDLE) {
+      free(cache);
+      return;
+   }
+
+   dev->host_pipeline_cache = cache;
+}
+
+void
+vkr_device_fini_host_pipeline_cache(struct vkr_device *dev)
+{
+   struct vn_device_proc_table *vk = &dev->proc_table;
+   VkDevice device = dev->base.handle.device;
+   struct vkr_pipeline_cache *cache = dev->host_pipeline_cache;
+
+   if (!cache)
+      return;
+
+   char path[PATH_MAX];
+   if (vkr_host_pipeline_cache_get_path(dev->physical_device, path, sizeof(path))) {
+      /* pick up what other devices have saved in the meantime */
+      VkPipelineCache saved = vkr_host_pipeline_cache_create_driver_handle(dev, path);
+      if (saved != VK_NULL_HANDLE) {
+         vk->MergePipelineCaches(device, cache->base.handle.pipeline_cache, 1, &saved);
+         vk->DestroyPipelineCache(device, saved, NULL);
+      }
+
+      size_t size = 0;
+      VkResult result = vk->GetPipelineCacheData(
+         device, cache->base.handle.pipeline_cache, &size, NULL);
+      void *data = result == VK_SUCCESS && size ? malloc(size) : NULL;
+      if (data) {
+         result = vk->GetPipelineCacheData(device, cache->base.handle.pipeline_cache,
+                                           &size, data);
+         if (result == VK_SUCCESS)
+            vkr_host_pipeline_cache_write_file(path, data, size);
+         free(data);
+      }
+   }
+
+   vk->DestroyPipelineCache(device, cache->base.handle.pipeline_cache, NULL);
+   free(cache);
+
+   dev->host_pipeline_cache = NULL;
+}
+
+void
+vkr_device_merge_host_pipeline_cache(struct vkr_device *dev,
+                                     struct vkr_pipeline_cache *cache)
+{
+   struct vn_device_proc_table *vk = &dev->proc_table;
+   struct vkr_pipeline_cache *host_cache = dev->host_pipeline_cache;
+
+   if (!host_cache)
+      return;
+
+   /* the host cache is the destination and must not be in use */
+   assert(list_is_empty(&dev->pipeline_jobs));
+
+   const VkResult result = vk->MergePipelineCaches(
+      dev->base.handle.device, host_cache->base.handle.pipeline_cache, 1,
+      &cache->base.handle.pipeline_cache);
+   if (result != VK_SUCCESS)
+      vkr_log("failed to merge a pipeline cache into the host cache");
+}
+
+static void
+vkr_pipeline_job_run(struct vkr_pipeline_job *job)
+{
+   TRACE_FUNC();
+
+   struct vn_device_proc_table *vk = &job->device->proc_table;
+
+   if (job->graphics) {
+      const struct vn_command_vkCreateGraphicsPipelines *args = &job->args.graphics;
+      VKR_DRIVER_CALL(job->result = vk->CreateGraphicsPipelines(
+         args->device, args->pipelineCache, args->createInfoCount, args->pCreateInfos,
+         NULL, job->arr.handle_storage));
+   } else {
+      const struct vn_command_vkCreateComputePipelines *args = &job->args.compute;
+      VKR_DRIVER_CALL(job->result = vk->CreateComputePipelines(
+         args->device, args->pipelineCache, args->createInfoCount, args->pCreateInfos,
+         NULL, job->arr.handle_storage));
+   }
+}
+
+static int
+vkr_pipeline_compiler_thread(UNUSED void *arg)
+{
+   u_thread_setname("vkr-pipeline");
+
+   mtx_lock(&vkr_pipeline_compiler.mutex);
+   while (true) {
+      while (!vkr_pipeline_compiler.join && list_is_empty(&vkr_pipeline_compiler.jobs))
+         cnd_wait(&vkr_pipeline_compiler.cond, &vkr_pipeline_compiler.mutex);
+      if (vkr_pipeline_compiler.join)
+         break;
+
+      struct vkr_pipeline_job *job = list_first_entry(&vkr_pipeline_compiler.jobs,
+                                                      struct vkr_pipeline_job, head);
+      list_del(&job->head);
+      job->running = true;
+      mtx_unlock(&vkr_pipeline_compiler.mutex);
+
+      vkr_pipeline_job_run(job);
+
+      mtx_lock(&vkr_pipeline_compiler.mutex);
+      job->done = true;
+      cnd_broadcast(&vkr_pipeline_compiler.done_cond);
+   }
+   mtx_unlock(&vkr_pipeline_compiler.mutex);
+
+   return 0;
+}
+
+static void
+vkr_pipeline_compiler_stop_threads(void)
+{
+   mtx_lock(&vkr_pipeline_compiler.mutex);
+   vkr_pipeline_compiler.join = true;
+   cnd_broadcast(&vkr_pipeline_compiler.cond);
+   mtx_unlock(&vkr_pipeline_compiler.mutex);
+
+   for (uint32_t i = 0; i < vkr_pipeline_compiler.thread_count; i++)
+      thrd_join(vkr_pipeline_compiler.threads[i], NULL);
+   vkr_pipeline_compiler.thread_count = 0;
+}
+
+bool
+vkr_pipeline_compiler_init(void)
+{
+   const long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+   const uint32_t thread_count =
+      CLAMP(cpu_count - 1, 1, VKR_PIPELINE_COMPILER_MAX_THREADS);
+
+   if (mtx_init(&vkr_pipeline_compiler.mutex, mtx_plain) != thrd_success)
+      return false;
+   if (cnd_init(&vkr_pipeline_compiler.cond) != thrd_success)
+      goto fail_cond;
+   if (cnd_init(&vkr_pipeline_compiler.done_cond) != thrd_success)
+      goto fail_done_cond;
+
+   vkr_pipeline_compiler.join = false;
+   list_inithead(&vkr_pipeline_compiler.jobs);
+
+   for (uint32_t i = 0; i < thread_count; i++) {
+      if (thrd_create(&vkr_pipeline_compiler.threads[i], vkr_pipeline_compiler_thread,
+                      NULL) != thrd_success)
+         break;
+      vkr_pipeline_compiler.thread_count++;
+   }
+   if (!vkr_pipeline_compiler.thread_count)
+      goto fail_threads;
+
+   vkr_pipeline_compiler.enabled = true;
+
+   return true;
+
+fail_threads:
+   cnd_destroy(&vkr_pipeline_compiler.done_cond);
+fail_done_cond:
+   cnd_destroy(&vkr_pipeline_compiler.cond);
+fail_cond:
+   mtx_destroy(&vkr_pipeline_compiler.mutex);
+   return false;
+}
+
+void
+vkr_pipeline_compiler_fini(void)
+{
+   if (!vkr_pipeline_compiler.enabled)
+      return;
+
+   /* all devices have been destroyed and there is no job left */
+   assert(list_is_empty(&vkr_pipeline_compiler.jobs));
+   vkr_pipeline_compiler_stop_threads();
+
+   cnd_destroy(&vkr_pipeline_compiler.done_cond);
+   cnd_destroy(&vkr_pipeline_compiler.cond);
+   mtx_destroy(&vkr_pipeline_compiler.mutex);
+
+   vkr_pipeline_compiler.enabled = false;
+}
+
+static void
+vkr_pipeline_job_destroy(struct vkr_pipeline_job *job)
+{
+   vkr_cs_decoder_fini(&job->decoder);
+   free(job->stream);
+   free(job);
+}
+
+static void
+vkr_pipeline_job_finish(struct vkr_pipeline_job *job)
+{
+   struct vkr_device *dev = job->device;
+   const VkPipeline *handles = job->arr.handle_storage;
+
+   if (job->result < VK_SUCCESS)
+      vkr_log("deferred pipeline creation failed(%d)", job->result);
+
+   /* failed pipelines keep VK_NULL_HANDLE; see vkr_pipeline_wait */
+   for (uint32_t i = 0; i < job->arr.count; i++) {
+      struct vkr_pipeline *pipeline = job->arr.objects[i];
+      pipeline->base.handle.pipeline = handles[i];
+      pipeline->job = NULL;
+   }
+
+   job->arr.objects_stolen = true;
+   object_array_fini(&job->arr);
+
+   /* jobs can finish in any order and older jobs might reference the
+    * deferred objects as well
+    */
+   if (job->device_head.prev != &dev->pipeline_jobs) {
+      struct vkr_pipeline_job *older =
+         LIST_ENTRY(struct vkr_pipeline_job, job->device_head.prev, device_head);
+      list_splicetail(&job->deferred_objects, &older->deferred_objects);
+   } else {
+      list_for_each_entry_safe (struct vkr_object, obj, &job->deferred_objects,
+                                track_head) {
+         vkr_device_object_destroy_driver_handle(dev, obj);
+         free(obj);
+      }
+   }
+
+   list_del(&job->device_head);
+   vkr_pipeline_job_destroy(job);
+}
+
+/* finish the jobs that are done without waiting for the others */
+static void
+vkr_device_retire_pipeline_jobs(struct vkr_device *dev)
+{
+   list_for_each_entry_safe (struct vkr_pipeline_job, job, &dev->pipeline_jobs,
+                             device_head) {
+      mtx_lock(&vkr_pipeline_compiler.mutex);
+      const bool done = job->done;
+      mtx_unlock(&vkr_pipeline_compiler.mutex);
+
+      if (done)
+         vkr_pipeline_job_finish(job);
+   }
+}
+
+static void
+vkr_pipeline_job_wait(struct vkr_pipeline_job *job)
+{
+   TRACE_FUNC();
+
+   mtx_lock(&vkr_pipeline_compiler.mutex);
+
+   /* run the job here rather than waiting for a compiler thread */
+   const bool run = !job->running && !job->done;
+   if (run)
+      list_del(&job->head);
+
+   while (!run && !job->done)
+      cnd_wait(&vkr_pipeline_compiler.done_cond, &vkr_pipeline_compiler.mutex);
+
+   mtx_unlock(&vkr_pipeline_compiler.mutex);
+
+   if (run)
+      vkr_pipeline_job_run(job);
+
+   vkr_pipeline_job_finish(job);
+}
+
+void
+vkr_device_wait_pipeline_jobs(struct vkr_device *dev)
+{
+   list_for_each_entry_safe (struct vkr_pipeline_job, job, &dev->pipeline_jobs,
+                             device_head)
+      vkr_pipeline_job_wait(job);
+}
+
+/* Keep an object being destroyed until the pending jobs of the device are
+ * finished, rather than waiting for them.  The object id is released right
+ * away.  It returns false when no job can reference the object.
+ */
+bool
+vkr_device_defer_pipeline_job_object(struct vkr_context *ctx,
+                                     struct vkr_device *dev,
+                                     struct vkr_object *obj)
+{
+   /* objects that pipeline creation takes */
+   switch (obj->type) {
+   case VK_OBJECT_TYPE_SHADER_MODULE:
+   case VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT:
+   case VK_OBJECT_TYPE_PIPELINE_LAYOUT:
+   case VK_OBJECT_TYPE_RENDER_PASS:
+   case VK_OBJECT_TYPE_PIPELINE_CACHE:
+   case VK_OBJECT_TYPE_PIPELINE:
+      break;
+   default:
+      return false;
+   }
+
+   vkr_device_retire_pipeline_jobs(dev);
+   if (list_is_empty(&dev->pipeline_jobs))
+      return false;
+
+   struct vkr_pipeline_job *newest =
+      list_last_entry(&dev->pipeline_jobs, struct vkr_pipeline_job, device_head);
+
+   list_del(&obj->track_head);
+   vkr_context_detach_object(ctx, obj);
+   list_addtail(&obj->track_head, &newest->deferred_objects);
+
+   return true;
+}
+
+bool
+vkr_pipeline_wait(struct vkr_context *ctx, struct vkr_pipeline *pipeline)
+{
+   if (pipeline->job)
+      vkr_pipeline_job_wait(pipeline->job);
+
+   if (pipeline->base.handle.pipeline == VK_NULL_HANDLE) {
+      /* the guest does not expect the deferred creation to fail */
+      vkr_log("pipeline %" PRIu64 " was not created", pipeline->base.id);
+      vkr_cs_decoder_set_fatal(&ctx->decoder);
+      return false;
+   }
+
+   return true;
+}
+
+static bool
+vkr_pipeline_job_decode(struct vkr_pipeline_job *job, struct vkr_context *ctx)
+{
+   const size_t size = ctx->decoder.cur - ctx->command_begin;
+   job->stream = malloc(size);
+   if (!job->stream)
+      return false;
+   memcpy(job->stream, ctx->command_begin, size);
+
+   vkr_cs_decoder_init(&job->decoder, ctx->object_table);
+   vkr_cs_decoder_set_stream(&job->decoder, job->stream, size);
+
+   struct vn_cs_decoder *dec = (struct vn_cs_decoder *)&job->decoder;
+   VkCommandTypeEXT cmd_type;
+   VkCommandFlagsEXT cmd_flags;
+   vn_decode_VkCommandTypeEXT(dec, &cmd_type);
+   vn_decode_VkFlags(dec, &cmd_flags);
+
+   if (job->graphics)
+      vn_decode_vkCreateGraphicsPipelines_args_temp(dec, &job->args.graphics);
+   else
+      vn_decode_vkCreateComputePipelines_args_temp(dec, &job->args.compute);
+
+   return !vkr_cs_decoder_get_fatal(&job->decoder);
+}
+
+/* Defer the creation of the pipelines being dispatched to the compiler
+ * threads.  This must be called before the handles in args are replaced.  It
+ * returns false when the pipelines should be created synchronously.
+ */
+static bool
+vkr_pipeline_defer_creation(struct vkr_context *ctx,
+                            struct vkr_device *dev,
+                            bool graphics)
+{
+   /* the guest expects the real result */
+   if (!vkr_pipeline_compiler.enabled ||
+       (ctx->command_flags & VK_COMMAND_GENERATE_REPLY_BIT_EXT))
+      return false;
+
+   struct vkr_pipeline_job *job = calloc(1, sizeof(*job));
+   if (!job)
+      return false;
+
+   job->device = dev;
+   job->graphics = graphics;
+   list_inithead(&job->deferred_objects);
+   if (!vkr_pipeline_job_decode(job, ctx)) {
+      vkr_pipeline_job_destroy(job);
+      return false;
+   }
+
+   uint32_t count;
+   VkPipelineCache *cache;
+   VkPipeline *ids;
+   if (graphics) {
+      struct vn_command_vkCreateGraphicsPipelines *args = &job->args.graphics;
+      for (uint32_t i = 0; i < args->createInfoCount; i++) {
+         struct vkr_pipeline *base =
+            (struct vkr_pipeline *)(uintptr_t)args->pCreateInfos[i].basePipelineHandle;
+         if (base && base->job)
+            vkr_pipeline_job_wait(base->job);
+      }
+      count = args->createInfoCount;
+      cache = &args->pipelineCache;
+      ids = args->pPipelines;
+   } else {
+      struct vn_command_vkCreateComputePipelines *args = &job->args.compute;
+      for (uint32_t i = 0; i < args->createInfoCount; i++) {
+         struct vkr_pipeline *base =
+            (struct vkr_pipeline *)(uintptr_t)args->pCreateInfos[i].basePipelineHandle;
+         if (base && base->job)
+            vkr_pipeline_job_wait(base->job);
+      }
+      count = args->createInfoCount;
+      cache = &args->pipelineCache;
+      ids = args->pPipelines;
+   }
+
+   if (!*cache && dev->host_pipeline_cache)
+      *cache = (VkPipelineCache)(uintptr_t)dev->host_pipeline_cache;
+
+   if (!object_array_init(ctx, &job->arr, count, VK_OBJECT_TYPE_PIPELINE,
+                          sizeof(struct vkr_pipeline), sizeof(*ids), ids)) {
+      vkr_pipeline_job_destroy(job);
+      return false;
+   }
+
+   if (graphics)
+      vn_replace_vkCreateGraphicsPipelines_args_handle(&job->args.graphics);
+   else
+      vn_replace_vkCreateComputePipelines_args_handle(&job->args.compute);
+
+   for (uint32_t i = 0; i < count; i++) {
+      struct vkr_pipeline *pipeline = job->arr.objects[i];
+      pipeline->job = job;
+      vkr_device_add_object(ctx, dev, &pipeline->base);
+   }
+   list_addtail(&job->device_head, &dev->pipeline_jobs);
+
+   mtx_lock(&vkr_pipeline_compiler.mutex);
+   list_addtail(&job->head, &vkr_pipeline_compiler.jobs);
+   cnd_signal(&vkr_pipeline_compiler.cond);
+   mtx_unlock(&vkr_pipeline_compiler.mutex);
+
+   return true;
+}
+
 static void
 vkr_dispatch_vkCreateShaderModule(struct vn_dispatch_context *dispatch,
                                   struct vn_command_vkCreateShaderModule *args)
@@ -39,13 +648,44 @@ static void
 vkr_dispatch_vkCreatePipelineCache(struct vn_dispatch_context *dispatch,
                                    struct vn_command_vkCreatePipelineCache *args)
 {
-   vkr_pipeline_cache_create_and_add(dispatch->data, args);
+   struct vkr_device *dev = vkr_device_from_handle(args->device);
+   struct vn_device_proc_table *vk = &dev->proc_table;
+
+   /* compiler threads can use the cache concurrently */
+   if (vkr_pipeline_compiler.enabled) {
+      ((VkPipelineCacheCreateInfo *)args->pCreateInfo)->flags &=
+         ~VK_PIPELINE_CACHE_CREATE_EXTERNALLY_SYNCHRONIZED_BIT;
+   }
+
+   struct vkr_pipeline_cache *cache =
+      vkr_pipeline_cache_create_and_add(dispatch->data, args);
+   if (!cache || !dev->host_pipeline_cache)
+      return;
+
+   /* Guest caches are separate driver caches.  They are seeded with the host
+    * cache here and merged back into it when destroyed.  The source cache of
+    * vkMergePipelineCaches needs no external synchronization.
+    */
+   VkResult result;
+   VKR_DRIVER_CALL(result = vk->MergePipelineCaches(
+                      dev->base.handle.device, cache->base.handle.pipeline_cache, 1,
+                      &dev->host_pipeline_cache->base.handle.pipeline_cache));
+   if (result != VK_SUCCESS)
+      vkr_log("failed to seed a pipeline cache with the host cache");
 }
 
 static void
 vkr_dispatch_vkDestroyPipelineCache(struct vn_dispatch_context *dispatch,
                                     struct vn_command_vkDestroyPipelineCache *args)
 {
+   struct vkr_device *dev = vkr_device_from_handle(args->device);
+   struct vkr_pipeline_cache *cache = vkr_pipeline_cache_from_handle(args->pipelineCache);
+
+   if (cache && dev->host_pipeline_cache) {
+      vkr_device_wait_pipeline_jobs(dev);
+      VKR_DRIVER_CALL(vkr_device_merge_host_pipeline_cache(dev, cache));
+   }
+
    vkr_pipeline_cache_destroy_and_remove(dispatch->data, args);
 }
 
@@ -56,9 +696,11 @@ vkr_dispatch_vkGetPipelineCacheData(UNUSED struct vn_dispatch_context *dispatch,
    struct vkr_device *dev = vkr_device_from_handle(args->device);
    struct vn_device_proc_table *vk = &dev->proc_table;
 
+   vkr_device_wait_pipeline_jobs(dev);
+
    vn_replace_vkGetPipelineCacheData_args_handle(args);
-   args->ret = vk->GetPipelineCacheData(args->device, args->pipelineCache,
-                                        args->pDataSize, args->pData);
+   VKR_DRIVER_CALL(args->ret = vk->GetPipelineCacheData(args->device, args->pipelineCache,
+                                                        args->pDataSize, args->pData));
 }
 
 static void
@@ -68,9 +710,11 @@ vkr_dispatch_vkMergePipelineCaches(UNUSED struct vn_dispatch_context *dispatch,
    struct vkr_device *dev = vkr_device_from_handle(args->device);
    struct vn_device_proc_table *vk = &dev->proc_table;
 
+   vkr_device_wait_pipeline_jobs(dev);
+
    vn_replace_vkMergePipelineCaches_args_handle(args);
-   args->ret = vk->MergePipelineCaches(args->device, args->dstCache, args->srcCacheCount,
-                                       args->pSrcCaches);
+   VKR_DRIVER_CALL(args->ret = vk->MergePipelineCaches(
+      args->device, args->dstCache, args->srcCacheCount, args->pSrcCaches));
 }
 
 static void
@@ -81,6 +725,15 @@ vkr_dispatch_vkCreateGraphicsPipelines(struct vn_dispatch_context *dispatch,
    struct vkr_device *dev = vkr_device_from_handle(args->device);
    struct object_array arr;
 
+   if (vkr_pipeline_defer_creation(ctx, dev, true)) {
+      args->ret = VK_SUCCESS;
+      return;
+   }
+
+   /* handles in args are vkr_objects until they are replaced */
+   if (!args->pipelineCache && dev->host_pipeline_cache)
+      args->pipelineCache = (VkPipelineCache)(uintptr_t)dev->host_pipeline_cache;
+
    if (vkr_graphics_pipeline_create_array(ctx, args, &arr) < VK_SUCCESS)
       return;
 
@@ -95,6 +748,15 @@ vkr_dispatch_vkCreateComputePipelines(struct vn_dispatch_context *dispatch,
    struct vkr_device *dev = vkr_device_from_handle(args->device);
    struct object_array arr;
 
+   if (vkr_pipeline_defer_creation(ctx, dev, false)) {
+      args->ret = VK_SUCCESS;
+      return;
+   }
+
+   /* handles in args are vkr_objects until they are replaced */
+   if (!args->pipelineCache && dev->host_pipeline_cache)
+      args->pipelineCache = (VkPipelineCache)(uintptr_t)dev->host_pipeline_cache;
+
    if (vkr_compute_pipeline_create_array(ctx, args, &arr) < VK_SUCCESS)
       return;
 
@@ -105,7 +767,24 @@ static void
 vkr_dispatch_vkDestroyPipeline(struct vn_dispatch_context *dispatch,
                                struct vn_command_vkDestroyPipeline *args)
 {
-   vkr_pipeline_destroy_and_remove(dispatch->data, args);
+   struct vkr_context *ctx = dispatch->data;
+   struct vkr_device *dev = vkr_device_from_handle(args->device);
+
+   /* pipelines are not accessed through vkr_pipeline_from_handle until ready */
+   struct vkr_pipeline *pipeline = (struct vkr_pipeline *)(uintptr_t)args->pipeline;
+   if (!pipeline)
+      return;
+
+   if (pipeline->job)
+      vkr_pipeline_job_wait(pipeline->job);
+
+   /* a failed deferred creation leaves no driver pipeline to destroy */
+   if (pipeline->base.handle.pipeline == VK_NULL_HANDLE) {
+      vkr_device_remove_object(ctx, dev, &pipeline->base);
+      return;
+   }
+
+   vkr_pipeline_destroy_and_remove(ctx, args);
 }
 
 void
@@ -25,9 +25,40 @@ VKR_DEFINE_OBJECT_CAST(pipeline_cache, VK_OBJECT_TYPE_PIPELINE_CACHE, VkPipeline
 
 struct vkr_pipeline {
    struct vkr_object base;
+
+   /* non-NULL while the creation is deferred to the compiler threads */
+   struct vkr_pipeline_job *job;
 };
 VKR_DEFINE_OBJECT_CAST(pipeline, VK_OBJECT_TYPE_PIPELINE, VkPipeline)
 
+bool
+vkr_pipeline_compiler_init(void);
+
+void
+vkr_pipeline_compiler_fini(void);
+
+void
+vkr_device_wait_pipeline_jobs(struct vkr_device *dev);
+
+bool
+vkr_device_defer_pipeline_job_object(struct vkr_context *ctx,
+                                     struct vkr_device *dev,
+                                     struct vkr_object *obj);
+
+bool
+vkr_pipeline_wait(struct vkr_context *ctx, struct vkr_pipeline *pipeline);
+
+void
+vkr_device_init_host_pipeline_cache(struct vkr_device *dev);
+
+void
+vkr_device_fini_host_pipeline_cache(struct vkr_device *dev);
+
+/* merge a guest cache into the host cache; no pipeline job may be pending */
+void
+vkr_device_merge_host_pipeline_cache(struct vkr_device *dev,
+                                     struct vkr_pipeline_cache *cache);
+
 void
 vkr_context_init_shader_module_dispatch(struct vkr_context *ctx);
 
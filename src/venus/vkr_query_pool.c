@@ -29,9 +29,9 @@ vkr_dispatch_vkGetQueryPoolResults(UNUSED struct vn_dispatch_context *dispatch,
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetQueryPoolResults_args_handle(args);
-   args->ret = vk->GetQueryPoolResults(args->device, args->queryPool, args->firstQuery,
-                                       args->queryCount, args->dataSize, args->pData,
-                                       args->stride, args->flags);
+   VKR_DRIVER_CALL(args->ret = vk->GetQueryPoolResults(
+      args->device, args->queryPool, args->firstQuery, args->queryCount, args->dataSize,
+      args->pData, args->stride, args->flags));
 }
 
 static void
@@ -42,7 +42,8 @@ vkr_dispatch_vkResetQueryPool(UNUSED struct vn_dispatch_context *dispatch,
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkResetQueryPool_args_handle(args);
-   vk->ResetQueryPool(args->device, args->queryPool, args->firstQuery, args->queryCount);
+   VKR_DRIVER_CALL(vk->ResetQueryPool(args->device, args->queryPool, args->firstQuery,
+                                      args->queryCount));
 }
 
 void
@@ -5,9 +5,12 @@
 
 #include "vkr_queue.h"
 
+#include <sys/epoll.h>
+
 #include "venus-protocol/vn_protocol_renderer_queue.h"
 
 #include "vkr_context.h"
+#include "vkr_device_memory.h"
 #include "vkr_physical_device.h"
 #include "vkr_queue_gen.h"
 
@@ -28,30 +31,38 @@ vkr_device_alloc_queue_sync(struct vkr_device *dev,
       if (!sync)
          return NULL;
 
-      const VkExportFenceCreateInfo export_info = {
-         .sType = VK_STRUCTURE_TYPE_EXPORT_FENCE_CREATE_INFO,
-         .handleTypes = VK_EXTERNAL_FENCE_HANDLE_TYPE_SYNC_FD_BIT,
-      };
-      const struct VkFenceCreateInfo create_info = {
-         .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-         .pNext = dev->physical_device->KHR_external_fence_fd ? &export_info : NULL,
-      };
-      VkResult result =
-         vk->CreateFence(dev->base.handle.device, &create_info, NULL, &sync->fence);
-      if (result != VK_SUCCESS) {
-         free(sync);
-         vkr_log("failed to create sync fence for fence_id %" PRIu64, fence_id);
-         return NULL;
+      sync->fence = VK_NULL_HANDLE;
+      if (!dev->timeline_retire) {
+         const VkExportFenceCreateInfo export_info = {
+            .sType = VK_STRUCTURE_TYPE_EXPORT_FENCE_CREATE_INFO,
+            .handleTypes = VK_EXTERNAL_FENCE_HANDLE_TYPE_SYNC_FD_BIT,
+         };
+         const struct VkFenceCreateInfo create_info = {
+            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+            .pNext = dev->physical_device->KHR_external_fence_fd ? &export_info : NULL,
+         };
+         VkResult result =
+            vk->CreateFence(dev->base.handle.device, &create_info, NULL, &sync->fence);
+         if (result != VK_SUCCESS) {
+            free(sync);
+            vkr_log("failed to create sync fence for fence_id %" PRIu64, fence_id);
+            return NULL;
+         }
       }
    } else {
       sync = LIST_ENTRY(struct vkr_queue_sync, dev->free_syncs.next, head);
       list_del(&sync->head);
       mtx_unlock(&dev->free_sync_mutex);
 
-      vk->ResetFences(dev->base.handle.device, 1, &sync->fence);
+      if (sync->fence != VK_NULL_HANDLE)
+         vk->ResetFences(dev->base.handle.device, 1, &sync->fence);
    }
 
+   sync->timeline_value = 0;
    sync->device_lost = false;
+   sync->queue = NULL;
+   sync->sync_fd = -1;
+   sync->reactor_key = 0;
    sync->flags = fence_flags;
    sync->ring_idx = ring_idx;
    sync->fence_id = fence_id;
@@ -59,6 +70,25 @@ vkr_device_alloc_queue_sync(struct vkr_device *dev,
    return sync;
 }
 
+/* A process-wide thread polling the sync_fds exported from the sync fences of
+ * all queues. It replaces the per-queue threads when VKR_PERF=fence_reactor.
+ */
+struct vkr_queue_reactor {
+   bool enabled;
+   int epoll_fd;
+   int wake_fd;
+   thrd_t thread;
+
+   /* protects the members below and the pending_syncs of reactor queues */
+   mtx_t mutex;
+   bool join;
+   /* maps reactor_key to vkr_queue_sync; key 0 is reserved for wake_fd */
+   struct hash_table_u64 *syncs;
+   uint64_t next_key;
+};
+
+static struct vkr_queue_reactor vkr_queue_reactor;
+
 static void
 vkr_device_free_queue_sync(struct vkr_device *dev, struct vkr_queue_sync *sync)
 {
@@ -74,6 +104,271 @@ vkr_queue_sync_retire(struct vkr_queue *queue, struct vkr_queue_sync *sync)
    vkr_device_free_queue_sync(queue->device, sync);
 }
 
+static void
+vkr_queue_reactor_remove_sync(struct vkr_queue_sync *sync)
+{
+   struct vkr_queue_reactor *reactor = &vkr_queue_reactor;
+
+   if (sync->sync_fd < 0)
+      return;
+
+   epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, sync->sync_fd, NULL);
+   close(sync->sync_fd);
+   sync->sync_fd = -1;
+
+   _mesa_hash_table_u64_remove(reactor->syncs, sync->reactor_key);
+}
+
+/* called with both the reactor mutex and queue->mutex held */
+static void
+vkr_queue_reactor_retire_syncs(struct vkr_queue *queue)
+{
+   /* syncs on a queue signal in submission order; when one of them has
+    * signaled, all of its predecessors have as well
+    */
+   struct vkr_queue_sync *last = NULL;
+   list_for_each_entry (struct vkr_queue_sync, sync, &queue->pending_syncs, head) {
+      if (sync->sync_fd < 0)
+         last = sync;
+   }
+   if (!last)
+      return;
+
+   struct vkr_queue_sync *sync, *tmp;
+   LIST_FOR_EACH_ENTRY_SAFE (sync, tmp, &queue->pending_syncs, head) {
+      const bool done = sync == last;
+
+      vkr_queue_reactor_remove_sync(sync);
+      list_del(&sync->head);
+      vkr_queue_sync_retire(queue, sync);
+
+      if (done)
+         break;
+   }
+}
+
+static void
+vkr_queue_reactor_add_sync(struct vkr_queue *queue, struct vkr_queue_sync *sync)
+{
+   struct vkr_queue_reactor *reactor = &vkr_queue_reactor;
+   struct vkr_device *dev = queue->device;
+   struct vn_device_proc_table *vk = &dev->proc_table;
+   int fd = -1;
+
+   if (!sync->device_lost) {
+      const VkFenceGetFdInfoKHR info = {
+         .sType = VK_STRUCTURE_TYPE_FENCE_GET_FD_INFO_KHR,
+         .fence = sync->fence,
+         .handleType = VK_EXTERNAL_FENCE_HANDLE_TYPE_SYNC_FD_BIT,
+      };
+      VkResult result = vk->GetFenceFdKHR(dev->base.handle.device, &info, &fd);
+      if (result != VK_SUCCESS) {
+         /* this is rare; wait here rather than lose the fence */
+         vkr_log("failed to export sync_fd for fence_id %" PRIu64, sync->fence_id);
+         vk->WaitForFences(dev->base.handle.device, 1, &sync->fence, true, UINT64_MAX);
+         fd = -1;
+      }
+   }
+
+   mtx_lock(&reactor->mutex);
+
+   /* fd is -1 when the fence has already signaled */
+   if (fd >= 0) {
+      const uint64_t key = reactor->next_key++;
+      struct epoll_event ev = {
+         .events = EPOLLIN,
+         .data.u64 = key,
+      };
+      if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+         vkr_log("failed to poll sync_fd for fence_id %" PRIu64, sync->fence_id);
+         vk->WaitForFences(dev->base.handle.device, 1, &sync->fence, true, UINT64_MAX);
+         close(fd);
+         fd = -1;
+      } else {
+         _mesa_hash_table_u64_insert(reactor->syncs, key, sync);
+         sync->reactor_key = key;
+      }
+   }
+
+   sync->queue = queue;
+   sync->sync_fd = fd;
+
+   mtx_lock(&queue->mutex);
+   list_addtail(&sync->head, &queue->pending_syncs);
+   if (fd < 0)
+      vkr_queue_reactor_retire_syncs(queue);
+   mtx_unlock(&queue->mutex);
+
+   mtx_unlock(&reactor->mutex);
+}
+
+static int
+vkr_queue_reactor_thread(UNUSED void *arg)
+{
+   struct vkr_queue_reactor *reactor = &vkr_queue_reactor;
+   struct epoll_event events[32];
+
+   u_thread_setname("vkr-reactor");
+   vkr_thread_apply_affinity();
+
+   while (true) {
+      const int count =
+         epoll_wait(reactor->epoll_fd, events, ARRAY_SIZE(events), -1 /* timeout */);
+      if (count < 0) {
+         if (errno == EINTR)
+            continue;
+         vkr_log("fence reactor failed to wait: %s", strerror(errno));
+         break;
+      }
+
+      mtx_lock(&reactor->mutex);
+
+      if (reactor->join) {
+         mtx_unlock(&reactor->mutex);
+         break;
+      }
+
+      for (int i = 0; i < count; i++) {
+         const uint64_t key = events[i].data.u64;
+         if (!key) {
+            flush_eventfd(reactor->wake_fd);
+            continue;
+         }
+
+         /* the sync might have been retired already */
+         struct vkr_queue_sync *sync = _mesa_hash_table_u64_search(reactor->syncs, key);
+         if (!sync)
+            continue;
+
+         struct vkr_queue *queue = sync->queue;
+         mtx_lock(&queue->mutex);
+         vkr_queue_reactor_remove_sync(sync);
+         vkr_queue_reactor_retire_syncs(queue);
+         mtx_unlock(&queue->mutex);
+      }
+
+      mtx_unlock(&reactor->mutex);
+   }
+
+   return 0;
+}
+
+bool
+vkr_queue_reactor_init(void)
+{
+   struct vkr_queue_reactor *reactor = &vkr_queue_reactor;
+
+   reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+   if (reactor->epoll_fd < 0)
+      return false;
+
+   reactor->wake_fd = create_eventfd(0);
+   if (reactor->wake_fd < 0)
+      goto fail_wake_fd;
+
+   struct epoll_event ev = {
+      .events = EPOLLIN,
+      .data.u64 = 0,
+   };
+   if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->wake_fd, &ev))
+      goto fail_syncs;
+
+   reactor->syncs = _mesa_hash_table_u64_create(NULL);
+   if (!reactor->syncs)
+      goto fail_syncs;
+
+   if (mtx_init(&reactor->mutex, mtx_plain) != thrd_success)
+      goto fail_mutex;
+
+   reactor->join = false;
+   reactor->next_key = 1;
+
+   if (thrd_create(&reactor->thread, vkr_queue_reactor_thread, NULL) != thrd_success)
+      goto fail_thread;
+
+   reactor->enabled = true;
+
+   return true;
+
+fail_thread:
+   mtx_destroy(&reactor->mutex);
+fail_mutex:
+   _mesa_hash_table_u64_destroy(reactor->syncs);
+fail_syncs:
+   close(reactor->wake_fd);
+fail_wake_fd:
+   close(reactor->epoll_fd);
+   return false;
+}
+
+void
+vkr_queue_reactor_fini(void)
+{
+   struct vkr_queue_reactor *reactor = &vkr_queue_reactor;
+
+   if (!reactor->enabled)
+      return;
+
+   mtx_lock(&reactor->mutex);
+   reactor->join = true;
+   mtx_unlock(&reactor->mutex);
+
+   write_eventfd(reactor->wake_fd, 1);
+   thrd_join(reactor->thread, NULL);
+
+   /* all queues have been destroyed */
+   mtx_destroy(&reactor->mutex);
+   _mesa_hash_table_u64_destroy(reactor->syncs);
+   close(reactor->wake_fd);
+   close(reactor->epoll_fd);
+
+   reactor->enabled = false;
+}
+
+static VkResult
+vkr_queue_submit_timeline(struct vkr_queue *queue, uint64_t value)
+{
+   struct vn_device_proc_table *vk = &queue->device->proc_table;
+
+   const VkTimelineSemaphoreSubmitInfo timeline_info = {
+      .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+      .signalSemaphoreValueCount = 1,
+      .pSignalSemaphoreValues = &value,
+   };
+   const VkSubmitInfo submit_info = {
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .pNext = &timeline_info,
+      .signalSemaphoreCount = 1,
+      .pSignalSemaphores = &queue->timeline,
+   };
+
+   return vk->QueueSubmit(queue->base.handle.queue, 1, &submit_info, VK_NULL_HANDLE);
+}
+
+static VkResult
+vkr_queue_wait_timeline(struct vkr_queue *queue,
+                        uint64_t value,
+                        uint64_t timeout,
+                        uint64_t *out_value)
+{
+   struct vkr_device *dev = queue->device;
+   struct vn_device_proc_table *vk = &dev->proc_table;
+
+   const VkSemaphoreWaitInfo wait_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+      .semaphoreCount = 1,
+      .pSemaphores = &queue->timeline,
+      .pValues = &value,
+   };
+   VkResult result = vk->WaitSemaphores(dev->base.handle.device, &wait_info, timeout);
+   if (result != VK_SUCCESS)
+      return result;
+
+   /* later syncs might have been signaled as well */
+   return vk->GetSemaphoreCounterValue(dev->base.handle.device, queue->timeline,
+                                       out_value);
+}
+
 bool
 vkr_queue_sync_submit(struct vkr_queue *queue,
                       uint32_t flags,
@@ -88,7 +383,19 @@ vkr_queue_sync_submit(struct vkr_queue *queue,
    if (!sync)
       return false;
 
-   VkResult result = vk->QueueSubmit(queue->base.handle.queue, 0, NULL, sync->fence);
+   VkResult result;
+   if (queue->timeline != VK_NULL_HANDLE) {
+      sync->timeline_value = queue->timeline_value + 1;
+      result = vkr_queue_submit_timeline(queue, sync->timeline_value);
+      /* a failed submit signals nothing and leaves the value to the next sync,
+       * such that no later sync waits for a value that is never reached
+       */
+      if (result == VK_SUCCESS)
+         queue->timeline_value = sync->timeline_value;
+   } else {
+      result = vk->QueueSubmit(queue->base.handle.queue, 0, NULL, sync->fence);
+   }
+
    if (result == VK_ERROR_DEVICE_LOST) {
       sync->device_lost = true;
       vkr_log("sync submit hit device lost for fence_id %" PRIu64, fence_id);
@@ -98,8 +405,15 @@ vkr_queue_sync_submit(struct vkr_queue *queue,
       return false;
    }
 
+   if (queue->use_reactor) {
+      vkr_queue_reactor_add_sync(queue, sync);
+      return true;
+   }
+
    mtx_lock(&queue->mutex);
    list_addtail(&sync->head, &queue->pending_syncs);
+   if (sync->device_lost)
+      queue->device_lost = true;
    mtx_unlock(&queue->mutex);
    cnd_signal(&queue->cond);
 
@@ -109,6 +423,20 @@ vkr_queue_sync_submit(struct vkr_queue *queue,
 static void
 vkr_queue_retire_all_syncs(struct vkr_queue *queue)
 {
+   struct vkr_queue_sync *sync, *tmp;
+
+   if (queue->use_reactor) {
+      mtx_lock(&vkr_queue_reactor.mutex);
+      mtx_lock(&queue->mutex);
+      LIST_FOR_EACH_ENTRY_SAFE (sync, tmp, &queue->pending_syncs, head) {
+         vkr_queue_reactor_remove_sync(sync);
+         vkr_queue_sync_retire(queue, sync);
+      }
+      mtx_unlock(&queue->mutex);
+      mtx_unlock(&vkr_queue_reactor.mutex);
+      return;
+   }
+
    mtx_lock(&queue->mutex);
    queue->join = true;
    mtx_unlock(&queue->mutex);
@@ -116,7 +444,6 @@ vkr_queue_retire_all_syncs(struct vkr_queue *queue)
    cnd_signal(&queue->cond);
    thrd_join(queue->thread, NULL);
 
-   struct vkr_queue_sync *sync, *tmp;
    LIST_FOR_EACH_ENTRY_SAFE (sync, tmp, &queue->pending_syncs, head)
       vkr_queue_sync_retire(queue, sync);
 }
@@ -127,6 +454,11 @@ vkr_queue_destroy(struct vkr_context *ctx, struct vkr_queue *queue)
    /* vkDeviceWaitIdle has been called */
    vkr_queue_retire_all_syncs(queue);
 
+   if (queue->timeline != VK_NULL_HANDLE) {
+      struct vkr_device *dev = queue->device;
+      dev->proc_table.DestroySemaphore(dev->base.handle.device, queue->timeline, NULL);
+   }
+
    mtx_destroy(&queue->mutex);
    cnd_destroy(&queue->cond);
 
@@ -153,6 +485,7 @@ vkr_queue_thread(void *arg)
 
    snprintf(thread_name, ARRAY_SIZE(thread_name), "vkr-queue-%d", ctx->ctx_id);
    u_thread_setname(thread_name);
+   vkr_thread_apply_affinity();
 
    mtx_lock(&queue->mutex);
    while (true) {
@@ -162,14 +495,30 @@ vkr_queue_thread(void *arg)
       if (queue->join)
          break;
 
+      /* the syncs pending before the lost one would otherwise be waited for
+       * with timeouts forever
+       */
+      if (queue->device_lost) {
+         struct vkr_queue_sync *sync, *tmp;
+         LIST_FOR_EACH_ENTRY_SAFE (sync, tmp, &queue->pending_syncs, head) {
+            list_del(&sync->head);
+            vkr_queue_sync_retire(queue, sync);
+         }
+         continue;
+      }
+
       struct vkr_queue_sync *sync =
          LIST_ENTRY(struct vkr_queue_sync, queue->pending_syncs.next, head);
 
       mtx_unlock(&queue->mutex);
 
       VkResult result;
+      uint64_t timeline_value = 0;
       if (sync->device_lost) {
          result = VK_ERROR_DEVICE_LOST;
+      } else if (queue->timeline != VK_NULL_HANDLE) {
+         result = vkr_queue_wait_timeline(queue, sync->timeline_value, ns_per_sec * 3,
+                                          &timeline_value);
       } else {
          result = vk->WaitForFences(dev->base.handle.device, 1, &sync->fence, true,
                                     ns_per_sec * 3);
@@ -180,6 +529,18 @@ vkr_queue_thread(void *arg)
       if (result == VK_TIMEOUT)
          continue;
 
+      if (queue->timeline != VK_NULL_HANDLE && result == VK_SUCCESS) {
+         struct vkr_queue_sync *tmp;
+         LIST_FOR_EACH_ENTRY_SAFE (sync, tmp, &queue->pending_syncs, head) {
+            if (!sync->device_lost && sync->timeline_value > timeline_value)
+               break;
+
+            list_del(&sync->head);
+            vkr_queue_sync_retire(queue, sync);
+         }
+         continue;
+      }
+
       list_del(&sync->head);
 
       vkr_queue_sync_retire(queue, sync);
@@ -227,8 +588,37 @@ vkr_queue_create(struct vkr_context *ctx,
       return NULL;
    }
 
-   ret = thrd_create(&queue->thread, vkr_queue_thread, queue);
+   if (dev->timeline_retire) {
+      const VkSemaphoreTypeCreateInfo type_info = {
+         .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+         .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+         .initialValue = 0,
+      };
+      const VkSemaphoreCreateInfo create_info = {
+         .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+         .pNext = &type_info,
+      };
+      VkResult result = dev->proc_table.CreateSemaphore(
+         dev->base.handle.device, &create_info, NULL, &queue->timeline);
+      if (result != VK_SUCCESS) {
+         vkr_log("failed to create queue timeline (vk ret %d)", result);
+         mtx_destroy(&queue->mutex);
+         cnd_destroy(&queue->cond);
+         free(queue);
+         return NULL;
+      }
+   }
+
+   queue->use_reactor = vkr_queue_reactor.enabled && !dev->timeline_retire &&
+                        dev->physical_device->KHR_external_fence_fd;
+
+   ret = queue->use_reactor ? thrd_success
+                            : thrd_create(&queue->thread, vkr_queue_thread, queue);
    if (ret != thrd_success) {
+      if (queue->timeline != VK_NULL_HANDLE) {
+         dev->proc_table.DestroySemaphore(dev->base.handle.device, queue->timeline,
+                                          NULL);
+      }
       mtx_destroy(&queue->mutex);
       cnd_destroy(&queue->cond);
       free(queue);
@@ -335,16 +725,271 @@ vkr_dispatch_vkGetDeviceQueue2(struct vn_dispatch_context *dispatch,
    vkr_queue_assign_object_id(ctx, queue, id);
 }
 
+/* a submit batch is flushed when it has this many VkSubmitInfo* */
+#define VKR_QUEUE_SUBMIT_BATCH_MAX_COUNT 64
+
+struct vkr_queue_submit_batch *
+vkr_queue_submit_batch_create(void)
+{
+   struct vkr_queue_submit_batch *batch = calloc(1, sizeof(*batch));
+   if (!batch)
+      return NULL;
+
+   const size_t submit_size = MAX2(sizeof(VkSubmitInfo), sizeof(VkSubmitInfo2));
+   batch->submits = malloc(submit_size * VKR_QUEUE_SUBMIT_BATCH_MAX_COUNT);
+   batch->storage = calloc(VKR_QUEUE_SUBMIT_BATCH_MAX_COUNT, sizeof(*batch->storage));
+   if (!batch->submits || !batch->storage) {
+      free(batch->submits);
+      free(batch->storage);
+      free(batch);
+      return NULL;
+   }
+
+   return batch;
+}
+
+void
+vkr_queue_submit_batch_destroy(struct vkr_queue_submit_batch *batch)
+{
+   /* batches are flushed at the end of every command stream */
+   assert(!batch->count);
+
+   free(batch->submits);
+   free(batch->storage);
+   free(batch);
+}
+
+static VkResult
+vkr_queue_submit_batch_flush_with_fence(struct vkr_queue_submit_batch *batch,
+                                        VkFence fence)
+{
+   if (!batch->count && fence == VK_NULL_HANDLE)
+      return VK_SUCCESS;
+
+   struct vkr_queue *queue = batch->queue;
+   struct vn_device_proc_table *vk = &queue->device->proc_table;
+
+   VkResult result;
+   if (batch->submit2)
+      VKR_DRIVER_CALL(result = vk->QueueSubmit2(queue->base.handle.queue, batch->count,
+                                                batch->submits, fence));
+   else
+      VKR_DRIVER_CALL(result = vk->QueueSubmit(queue->base.handle.queue, batch->count,
+                                               batch->submits, fence));
+   batch->issued_count++;
+
+   for (uint32_t i = 0; i < batch->count; i++)
+      free(batch->storage[i]);
+   batch->queue = NULL;
+   batch->count = 0;
+
+   return result;
+}
+
+void
+vkr_queue_submit_batch_flush(struct vkr_queue_submit_batch *batch)
+{
+   const VkResult result = vkr_queue_submit_batch_flush_with_fence(batch, VK_NULL_HANDLE);
+   /* the guest did not ask for the result */
+   if (result != VK_SUCCESS)
+      vkr_log("coalesced queue submit failed (vk ret %d)", result);
+}
+
+static inline void *
+vkr_queue_submit_batch_copy_array(uint8_t **ptr, const void *src, size_t size)
+{
+   if (!size)
+      return NULL;
+
+   void *dst = *ptr;
+   memcpy(dst, src, size);
+   *ptr += size;
+   return dst;
+}
+
+static bool
+vkr_queue_submit_batch_copy_submit(const VkSubmitInfo *src,
+                                   VkSubmitInfo *dst,
+                                   void **out_storage)
+{
+   const VkTimelineSemaphoreSubmitInfo *timeline_info = NULL;
+   if (src->pNext) {
+      const VkBaseInStructure *s = src->pNext;
+      if (s->sType != VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO || s->pNext)
+         return false;
+      timeline_info = (const VkTimelineSemaphoreSubmitInfo *)s;
+   }
+
+   const size_t wait_size = sizeof(VkSemaphore) * src->waitSemaphoreCount;
+   const size_t stage_size = sizeof(VkPipelineStageFlags) * src->waitSemaphoreCount;
+   const size_t cmd_size = sizeof(VkCommandBuffer) * src->commandBufferCount;
+   const size_t signal_size = sizeof(VkSemaphore) * src->signalSemaphoreCount;
+   size_t size = wait_size + stage_size + cmd_size + signal_size;
+
+   size_t wait_value_size = 0;
+   size_t signal_value_size = 0;
+   if (timeline_info) {
+      wait_value_size = sizeof(uint64_t) * timeline_info->waitSemaphoreValueCount;
+      signal_value_size = sizeof(uint64_t) * timeline_info->signalSemaphoreValueCount;
+      size += sizeof(*timeline_info) + wait_value_size + signal_value_size;
+   }
+
+   uint8_t *storage = malloc(size ? size : 1);
+   if (!storage)
+      return false;
+   uint8_t *ptr = storage;
+
+   /* copied in the order of alignment */
+   *dst = *src;
+   if (timeline_info) {
+      VkTimelineSemaphoreSubmitInfo *timeline_copy =
+         vkr_queue_submit_batch_copy_array(&ptr, timeline_info, sizeof(*timeline_info));
+      timeline_copy->pWaitSemaphoreValues = vkr_queue_submit_batch_copy_array(
+         &ptr, timeline_info->pWaitSemaphoreValues, wait_value_size);
+      timeline_copy->pSignalSemaphoreValues = vkr_queue_submit_batch_copy_array(
+         &ptr, timeline_info->pSignalSemaphoreValues, signal_value_size);
+      dst->pNext = timeline_copy;
+   }
+   dst->pWaitSemaphores =
+      vkr_queue_submit_batch_copy_array(&ptr, src->pWaitSemaphores, wait_size);
+   dst->pCommandBuffers =
+      vkr_queue_submit_batch_copy_array(&ptr, src->pCommandBuffers, cmd_size);
+   dst->pSignalSemaphores =
+      vkr_queue_submit_batch_copy_array(&ptr, src->pSignalSemaphores, signal_size);
+   dst->pWaitDstStageMask =
+      vkr_queue_submit_batch_copy_array(&ptr, src->pWaitDstStageMask, stage_size);
+
+   *out_storage = storage;
+   return true;
+}
+
+static bool
+vkr_queue_submit_batch_copy_submit2(const VkSubmitInfo2 *src,
+                                    VkSubmitInfo2 *dst,
+                                    void **out_storage)
+{
+   if (src->pNext)
+      return false;
+   for (uint32_t i = 0; i < src->waitSemaphoreInfoCount; i++) {
+      if (src->pWaitSemaphoreInfos[i].pNext)
+         return false;
+   }
+   for (uint32_t i = 0; i < src->commandBufferInfoCount; i++) {
+      if (src->pCommandBufferInfos[i].pNext)
+         return false;
+   }
+   for (uint32_t i = 0; i < src->signalSemaphoreInfoCount; i++) {
+      if (src->pSignalSemaphoreInfos[i].pNext)
+         return false;
+   }
+
+   const size_t wait_size = sizeof(VkSemaphoreSubmitInfo) * src->waitSemaphoreInfoCount;
+   const size_t cmd_size =
+      sizeof(VkCommandBufferSubmitInfo) * src->commandBufferInfoCount;
+   const size_t signal_size =
+      sizeof(VkSemaphoreSubmitInfo) * src->signalSemaphoreInfoCount;
+   const size_t size = wait_size + cmd_size + signal_size;
+
+   uint8_t *storage = malloc(size ? size : 1);
+   if (!storage)
+      return false;
+   uint8_t *ptr = storage;
+
+   *dst = *src;
+   dst->pWaitSemaphoreInfos =
+      vkr_queue_submit_batch_copy_array(&ptr, src->pWaitSemaphoreInfos, wait_size);
+   dst->pCommandBufferInfos =
+      vkr_queue_submit_batch_copy_array(&ptr, src->pCommandBufferInfos, cmd_size);
+   dst->pSignalSemaphoreInfos =
+      vkr_queue_submit_batch_copy_array(&ptr, src->pSignalSemaphoreInfos, signal_size);
+
+   *out_storage = storage;
+   return true;
+}
+
+/* Adds the submits to the batch and flushes the batch if the command needs the
+ * result or has a fence.  Returns false if the submits must be submitted
+ * directly after the pending ones have been flushed.
+ */
+static bool
+vkr_queue_submit_batch_add(struct vkr_queue_submit_batch *batch,
+                           struct vkr_context *ctx,
+                           struct vkr_queue *queue,
+                           bool submit2,
+                           uint32_t submit_count,
+                           const void *submits,
+                           VkFence fence,
+                           VkResult *out_result)
+{
+   batch->received_count++;
+
+   if (submit_count > VKR_QUEUE_SUBMIT_BATCH_MAX_COUNT) {
+      /* keep the order of the submits and their semaphore operations */
+      vkr_queue_submit_batch_flush(batch);
+      return false;
+   }
+
+   if (batch->count && (batch->queue != queue || batch->submit2 != submit2 ||
+                        batch->count + submit_count > VKR_QUEUE_SUBMIT_BATCH_MAX_COUNT))
+      vkr_queue_submit_batch_flush(batch);
+
+   const uint32_t old_count = batch->count;
+   for (uint32_t i = 0; i < submit_count; i++) {
+      void **storage = &batch->storage[batch->count];
+      bool ok;
+      if (submit2) {
+         ok = vkr_queue_submit_batch_copy_submit2(
+            &((const VkSubmitInfo2 *)submits)[i],
+            &((VkSubmitInfo2 *)batch->submits)[batch->count], storage);
+      } else {
+         ok = vkr_queue_submit_batch_copy_submit(
+            &((const VkSubmitInfo *)submits)[i],
+            &((VkSubmitInfo *)batch->submits)[batch->count], storage);
+      }
+
+      if (!ok) {
+         /* drop the partial copy and flush what was pending before */
+         while (batch->count > old_count)
+            free(batch->storage[--batch->count]);
+         vkr_queue_submit_batch_flush(batch);
+         return false;
+      }
+
+      batch->count++;
+   }
+
+   batch->queue = queue;
+   batch->submit2 = submit2;
+
+   const bool need_result = ctx->command_flags & VK_COMMAND_GENERATE_REPLY_BIT_EXT;
+   if (fence != VK_NULL_HANDLE || need_result)
+      *out_result = vkr_queue_submit_batch_flush_with_fence(batch, fence);
+   else
+      *out_result = VK_SUCCESS;
+
+   return true;
+}
+
 static void
-vkr_dispatch_vkQueueSubmit(UNUSED struct vn_dispatch_context *dispatch,
+vkr_dispatch_vkQueueSubmit(struct vn_dispatch_context *dispatch,
                            struct vn_command_vkQueueSubmit *args)
 {
+   struct vkr_context *ctx = dispatch->data;
    struct vkr_queue *queue = vkr_queue_from_handle(args->queue);
    struct vn_device_proc_table *vk = &queue->device->proc_table;
 
    vn_replace_vkQueueSubmit_args_handle(args);
-   args->ret =
-      vk->QueueSubmit(args->queue, args->submitCount, args->pSubmits, args->fence);
+
+   if (ctx->submit_batch) {
+      if (vkr_queue_submit_batch_add(ctx->submit_batch, ctx, queue, false,
+                                     args->submitCount, args->pSubmits, args->fence,
+                                     &args->ret))
+         return;
+      ctx->submit_batch->issued_count++;
+   }
+
+   VKR_DRIVER_CALL(args->ret = vk->QueueSubmit(args->queue, args->submitCount,
+                                               args->pSubmits, args->fence));
 }
 
 static void
@@ -354,9 +999,35 @@ vkr_dispatch_vkQueueBindSparse(UNUSED struct vn_dispatch_context *dispatch,
    struct vkr_queue *queue = vkr_queue_from_handle(args->queue);
    struct vn_device_proc_table *vk = &queue->device->proc_table;
 
+   for (uint32_t i = 0; i < args->bindInfoCount; i++) {
+      const VkBindSparseInfo *info = &args->pBindInfo[i];
+
+      for (uint32_t j = 0; j < info->bufferBindCount; j++) {
+         const VkSparseBufferMemoryBindInfo *bind = &info->pBufferBinds[j];
+         for (uint32_t k = 0; k < bind->bindCount; k++) {
+            VkSparseMemoryBind *b = (VkSparseMemoryBind *)&bind->pBinds[k];
+            vkr_device_memory_adjust_offset(b->memory, &b->memoryOffset);
+         }
+      }
+      for (uint32_t j = 0; j < info->imageOpaqueBindCount; j++) {
+         const VkSparseImageOpaqueMemoryBindInfo *bind = &info->pImageOpaqueBinds[j];
+         for (uint32_t k = 0; k < bind->bindCount; k++) {
+            VkSparseMemoryBind *b = (VkSparseMemoryBind *)&bind->pBinds[k];
+            vkr_device_memory_adjust_offset(b->memory, &b->memoryOffset);
+         }
+      }
+      for (uint32_t j = 0; j < info->imageBindCount; j++) {
+         const VkSparseImageMemoryBindInfo *bind = &info->pImageBinds[j];
+         for (uint32_t k = 0; k < bind->bindCount; k++) {
+            VkSparseImageMemoryBind *b = (VkSparseImageMemoryBind *)&bind->pBinds[k];
+            vkr_device_memory_adjust_offset(b->memory, &b->memoryOffset);
+         }
+      }
+   }
+
    vn_replace_vkQueueBindSparse_args_handle(args);
-   args->ret =
-      vk->QueueBindSparse(args->queue, args->bindInfoCount, args->pBindInfo, args->fence);
+   VKR_DRIVER_CALL(args->ret = vk->QueueBindSparse(args->queue, args->bindInfoCount,
+                                                   args->pBindInfo, args->fence));
 }
 
 static void
@@ -369,15 +1040,24 @@ vkr_dispatch_vkQueueWaitIdle(struct vn_dispatch_context *dispatch,
 }
 
 static void
-vkr_dispatch_vkQueueSubmit2(UNUSED struct vn_dispatch_context *dispatch,
+vkr_dispatch_vkQueueSubmit2(struct vn_dispatch_context *dispatch,
                             struct vn_command_vkQueueSubmit2 *args)
 {
+   struct vkr_context *ctx = dispatch->data;
    struct vkr_queue *queue = vkr_queue_from_handle(args->queue);
    struct vn_device_proc_table *vk = &queue->device->proc_table;
 
    vn_replace_vkQueueSubmit2_args_handle(args);
-   args->ret =
-      vk->QueueSubmit2(args->queue, args->submitCount, args->pSubmits, args->fence);
+
+   if (ctx->submit_batch) {
+      if (vkr_queue_submit_batch_add(ctx->submit_batch, ctx, queue, true,
+                                     args->submitCount, args->pSubmits, args->fence,
+                                     &args->ret))
+         return;
+      ctx->submit_batch->issued_count++;
+   }
+   VKR_DRIVER_CALL(args->ret = vk->QueueSubmit2(args->queue, args->submitCount,
+                                                args->pSubmits, args->fence));
 }
 
 static void
@@ -402,7 +1082,8 @@ vkr_dispatch_vkResetFences(UNUSED struct vn_dispatch_context *dispatch,
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkResetFences_args_handle(args);
-   args->ret = vk->ResetFences(args->device, args->fenceCount, args->pFences);
+   VKR_DRIVER_CALL(args->ret = vk->ResetFences(args->device, args->fenceCount,
+                                               args->pFences));
 }
 
 static void
@@ -413,7 +1094,7 @@ vkr_dispatch_vkGetFenceStatus(UNUSED struct vn_dispatch_context *dispatch,
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetFenceStatus_args_handle(args);
-   args->ret = vk->GetFenceStatus(args->device, args->fence);
+   VKR_DRIVER_CALL(args->ret = vk->GetFenceStatus(args->device, args->fence));
 }
 
 static void
@@ -425,8 +1106,8 @@ vkr_dispatch_vkWaitForFences(struct vn_dispatch_context *dispatch,
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkWaitForFences_args_handle(args);
-   args->ret = vk->WaitForFences(args->device, args->fenceCount, args->pFences,
-                                 args->waitAll, args->timeout);
+   VKR_DRIVER_CALL(args->ret = vk->WaitForFences(
+      args->device, args->fenceCount, args->pFences, args->waitAll, args->timeout));
 
    if (args->ret == VK_ERROR_DEVICE_LOST)
       vkr_cs_decoder_set_fatal(&ctx->decoder);
@@ -449,7 +1130,8 @@ vkr_dispatch_vkResetFenceResource100000MESA(
       .fence = args->fence,
       .handleType = VK_EXTERNAL_FENCE_HANDLE_TYPE_SYNC_FD_BIT,
    };
-   VkResult result = vk->GetFenceFdKHR(args->device, &info, &fd);
+   VkResult result;
+   VKR_DRIVER_CALL(result = vk->GetFenceFdKHR(args->device, &info, &fd));
    if (result != VK_SUCCESS) {
       vkr_cs_decoder_set_fatal(&ctx->decoder);
       return;
@@ -481,7 +1163,8 @@ vkr_dispatch_vkGetSemaphoreCounterValue(UNUSED struct vn_dispatch_context *dispa
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetSemaphoreCounterValue_args_handle(args);
-   args->ret = vk->GetSemaphoreCounterValue(args->device, args->semaphore, args->pValue);
+   VKR_DRIVER_CALL(args->ret = vk->GetSemaphoreCounterValue(args->device, args->semaphore,
+                                                            args->pValue));
 }
 
 static void
@@ -493,7 +1176,8 @@ vkr_dispatch_vkWaitSemaphores(struct vn_dispatch_context *dispatch,
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkWaitSemaphores_args_handle(args);
-   args->ret = vk->WaitSemaphores(args->device, args->pWaitInfo, args->timeout);
+   VKR_DRIVER_CALL(args->ret = vk->WaitSemaphores(args->device, args->pWaitInfo,
+                                                  args->timeout));
 
    if (args->ret == VK_ERROR_DEVICE_LOST)
       vkr_cs_decoder_set_fatal(&ctx->decoder);
@@ -507,7 +1191,7 @@ vkr_dispatch_vkSignalSemaphore(UNUSED struct vn_dispatch_context *dispatch,
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkSignalSemaphore_args_handle(args);
-   args->ret = vk->SignalSemaphore(args->device, args->pSignalInfo);
+   VKR_DRIVER_CALL(args->ret = vk->SignalSemaphore(args->device, args->pSignalInfo));
 }
 
 static void
@@ -527,7 +1211,8 @@ vkr_dispatch_vkWaitSemaphoreResource100000MESA(
       .semaphore = args->semaphore,
       .handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT,
    };
-   VkResult result = vk->GetSemaphoreFdKHR(args->device, &info, &fd);
+   VkResult result;
+   VKR_DRIVER_CALL(result = vk->GetSemaphoreFdKHR(args->device, &info, &fd));
    if (result != VK_SUCCESS) {
       vkr_cs_decoder_set_fatal(&ctx->decoder);
       return;
@@ -561,7 +1246,9 @@ vkr_dispatch_vkImportSemaphoreResource100000MESA(
       .handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT,
       .fd = -1,
    };
-   if (vk->ImportSemaphoreFdKHR(args->device, &import_info) != VK_SUCCESS)
+   VkResult result;
+   VKR_DRIVER_CALL(result = vk->ImportSemaphoreFdKHR(args->device, &import_info));
+   if (result != VK_SUCCESS)
       vkr_cs_decoder_set_fatal(&ctx->decoder);
 }
 
@@ -587,7 +1274,7 @@ vkr_dispatch_vkGetEventStatus(UNUSED struct vn_dispatch_context *dispatch,
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetEventStatus_args_handle(args);
-   args->ret = vk->GetEventStatus(args->device, args->event);
+   VKR_DRIVER_CALL(args->ret = vk->GetEventStatus(args->device, args->event));
 }
 
 static void
@@ -598,7 +1285,7 @@ vkr_dispatch_vkSetEvent(UNUSED struct vn_dispatch_context *dispatch,
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkSetEvent_args_handle(args);
-   args->ret = vk->SetEvent(args->device, args->event);
+   VKR_DRIVER_CALL(args->ret = vk->SetEvent(args->device, args->event));
 }
 
 static void
@@ -609,7 +1296,7 @@ vkr_dispatch_vkResetEvent(UNUSED struct vn_dispatch_context *dispatch,
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkResetEvent_args_handle(args);
-   args->ret = vk->ResetEvent(args->device, args->event);
+   VKR_DRIVER_CALL(args->ret = vk->ResetEvent(args->device, args->event));
 }
 
 void
@@ -9,9 +9,17 @@
 #include "vkr_common.h"
 
 struct vkr_queue_sync {
+   /* VK_NULL_HANDLE when the device uses timeline retirement */
    VkFence fence;
+   /* the value vkr_queue::timeline reaches when the sync is signaled */
+   uint64_t timeline_value;
    bool device_lost;
 
+   /* only used with the fence reactor; sync_fd is -1 once signaled */
+   struct vkr_queue *queue;
+   int sync_fd;
+   uint64_t reactor_key;
+
    uint32_t flags;
    uint32_t ring_idx;
    uint64_t fence_id;
@@ -32,9 +40,27 @@ struct vkr_queue {
    /* only used when client driver uses multiple timelines */
    uint32_t ring_idx;
 
+   /* With vkr_device::timeline_retire, each sync submit signals the next value
+    * of this timeline semaphore rather than a VkFence of its own.
+    */
+   VkSemaphore timeline;
+   uint64_t timeline_value;
+
+   /* set once a sync submit hits device lost; nothing signals the pending
+    * syncs afterwards and the thread retires them without waiting
+    */
+   bool device_lost;
+
+   /* With the fence reactor, there is no per-queue thread. The sync_fds of the
+    * pending syncs are polled by the reactor thread instead.
+    */
+   bool use_reactor;
+
    /* Submitted fences are added to pending_syncs first. With required
     * VKR_RENDERER_THREAD_SYNC and VKR_RENDERER_ASYNC_FENCE_CB in render server, the sync
     * thread calls vkWaitForFences and retires signaled fences in pending_syncs in order.
+    * In timeline mode, it waits for the oldest pending value and then retires every
+    * sync the semaphore counter has reached in one go.
     */
    thrd_t thread;
    mtx_t mutex;
@@ -44,6 +70,25 @@ struct vkr_queue {
 };
 VKR_DEFINE_OBJECT_CAST(queue, VK_OBJECT_TYPE_QUEUE, VkQueue)
 
+/* With VKR_PERF=coalesce_submits, consecutive vkQueueSubmit or vkQueueSubmit2
+ * commands to the same queue are merged into a single driver call.  The
+ * batches of a submission execute in order like separate submissions do, and
+ * any other command flushes the pending batches before it is dispatched.
+ */
+struct vkr_queue_submit_batch {
+   struct vkr_queue *queue;
+   bool submit2;
+
+   uint32_t count;
+   /* VkSubmitInfo or VkSubmitInfo2 depending on submit2 */
+   void *submits;
+   /* a malloc'ed block per submit for its arrays and pNext chain */
+   void **storage;
+
+   uint64_t received_count;
+   uint64_t issued_count;
+};
+
 struct vkr_fence {
    struct vkr_object base;
 };
@@ -59,6 +104,12 @@ struct vkr_event {
 };
 VKR_DEFINE_OBJECT_CAST(event, VK_OBJECT_TYPE_EVENT, VkEvent)
 
+bool
+vkr_queue_reactor_init(void);
+
+void
+vkr_queue_reactor_fini(void);
+
 void
 vkr_context_init_queue_dispatch(struct vkr_context *ctx);
 
@@ -82,6 +133,15 @@ vkr_queue_create(struct vkr_context *ctx,
 void
 vkr_queue_destroy(struct vkr_context *ctx, struct vkr_queue *queue);
 
+struct vkr_queue_submit_batch *
+vkr_queue_submit_batch_create(void);
+
+void
+vkr_queue_submit_batch_destroy(struct vkr_queue_submit_batch *batch);
+
+void
+vkr_queue_submit_batch_flush(struct vkr_queue_submit_batch *batch);
+
 bool
 vkr_queue_sync_submit(struct vkr_queue *queue,
                       uint32_t flags,
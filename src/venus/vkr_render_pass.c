@@ -30,8 +30,8 @@ vkr_dispatch_vkCreateRenderPass2(struct vn_dispatch_context *dispatch,
    }
 
    vn_replace_vkCreateRenderPass2_args_handle(args);
-   args->ret = vk->CreateRenderPass2(args->device, args->pCreateInfo, NULL,
-                                     &pass->base.handle.render_pass);
+   VKR_DRIVER_CALL(args->ret = vk->CreateRenderPass2(
+      args->device, args->pCreateInfo, NULL, &pass->base.handle.render_pass));
    if (args->ret != VK_SUCCESS) {
       free(pass);
       return;
@@ -55,7 +55,8 @@ vkr_dispatch_vkGetRenderAreaGranularity(UNUSED struct vn_dispatch_context *dispa
    struct vn_device_proc_table *vk = &dev->proc_table;
 
    vn_replace_vkGetRenderAreaGranularity_args_handle(args);
-   vk->GetRenderAreaGranularity(args->device, args->renderPass, args->pGranularity);
+   VKR_DRIVER_CALL(vk->GetRenderAreaGranularity(args->device, args->renderPass,
+                                                args->pGranularity));
 }
 
 static void
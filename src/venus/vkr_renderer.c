@@ -8,7 +8,11 @@
 #include "venus-protocol/vn_protocol_renderer_info.h"
 #include "virglrenderer_hw.h"
 
+#include "vkr_capture.h"
 #include "vkr_context.h"
+#include "vkr_physical_device.h"
+#include "vkr_pipeline.h"
+#include "vkr_queue.h"
 
 struct vkr_renderer_state {
    const struct vkr_renderer_callbacks *cbs;
@@ -66,8 +70,18 @@ vkr_renderer_init(uint32_t flags, const struct vkr_renderer_callbacks *cbs)
       return false;
 
    vkr_debug_init();
+   vkr_thread_affinity_init();
    virgl_log_set_logger(cbs->debug_logger);
 
+   if (VKR_PERF(FENCE_REACTOR) && !vkr_queue_reactor_init())
+      vkr_log("failed to start fence reactor; using per-queue threads");
+   if (VKR_PERF(ASYNC_PIPELINE) && !vkr_pipeline_compiler_init())
+      vkr_log("failed to start pipeline compiler threads");
+   if (VKR_PERF(FORMAT_CACHE) && !vkr_format_cache_init())
+      vkr_log("failed to initialize format caches");
+
+   vkr_capture_init();
+
    vkr_state.cbs = cbs;
    list_inithead(&vkr_state.contexts);
 
@@ -83,6 +97,11 @@ vkr_renderer_fini(void)
 
    list_inithead(&vkr_state.contexts);
 
+   vkr_queue_reactor_fini();
+   vkr_pipeline_compiler_fini();
+   vkr_format_cache_fini();
+   vkr_capture_fini();
+
    vkr_state.cbs = NULL;
 }
 
@@ -123,6 +142,15 @@ vkr_renderer_create_context(uint32_t ctx_id,
 
    list_addtail(&ctx->head, &vkr_state.contexts);
 
+   if (vkr_capture_is_enabled()) {
+      const struct vkr_capture_context info = {
+         .ctx_flags = ctx_flags,
+         .name_len = nlen,
+      };
+      vkr_capture_write(VKR_CAPTURE_RECORD_CONTEXT_CREATE, ctx_id, &info, sizeof(info),
+                        name, nlen);
+   }
+
    return true;
 }
 
@@ -137,6 +165,8 @@ vkr_renderer_destroy_context(uint32_t ctx_id)
 
    list_del(&ctx->head);
    vkr_context_destroy(ctx);
+
+   vkr_capture_write(VKR_CAPTURE_RECORD_CONTEXT_DESTROY, ctx_id, NULL, 0, NULL, 0);
 }
 
 bool
@@ -164,6 +194,16 @@ vkr_renderer_submit_fence(uint32_t ctx_id,
       return false;
 
    assert(vkr_state.cbs->retire_fence);
+
+   if (vkr_capture_is_enabled()) {
+      const struct vkr_capture_fence info = {
+         .flags = flags,
+         .ring_idx = ring_idx,
+         .fence_id = fence_id,
+      };
+      vkr_capture_write(VKR_CAPTURE_RECORD_FENCE, ctx_id, &info, sizeof(info), NULL, 0);
+   }
+
    return vkr_context_submit_fence(ctx, flags, ring_idx, fence_id);
 }
 
@@ -176,6 +216,8 @@ vkr_renderer_create_resource(uint32_t ctx_id,
                              enum virgl_resource_fd_type *out_fd_type,
                              int *out_res_fd,
                              uint32_t *out_map_info,
+                             uint64_t *out_map_offset,
+                             bool *out_suballocated,
                              struct virgl_resource_vulkan_info *out_vulkan_info)
 {
    TRACE_FUNC();
@@ -197,12 +239,26 @@ vkr_renderer_create_resource(uint32_t ctx_id,
    *out_fd_type = blob.type;
    *out_res_fd = blob.u.fd;
    *out_map_info = blob.map_info;
+   *out_map_offset = blob.map_offset;
+   *out_suballocated = blob.suballocated;
 
    if (blob.type == VIRGL_RESOURCE_FD_OPAQUE) {
       assert(out_vulkan_info);
       *out_vulkan_info = blob.vulkan_info;
    }
 
+   if (vkr_capture_is_enabled()) {
+      const struct vkr_capture_resource info = {
+         .res_id = res_id,
+         .blob_flags = blob_flags,
+         .blob_id = blob_id,
+         .blob_size = blob_size,
+         .fd_type = blob.type,
+      };
+      vkr_capture_write(VKR_CAPTURE_RECORD_RESOURCE_CREATE, ctx_id, &info, sizeof(info),
+                        NULL, 0);
+   }
+
    return true;
 }
 
@@ -224,7 +280,20 @@ vkr_renderer_import_resource(uint32_t ctx_id,
    if (!ctx)
       return false;
 
-   return vkr_context_import_resource(ctx, res_id, fd_type, fd, size);
+   if (!vkr_context_import_resource(ctx, res_id, fd_type, fd, size))
+      return false;
+
+   if (vkr_capture_is_enabled()) {
+      const struct vkr_capture_resource info = {
+         .res_id = res_id,
+         .blob_size = size,
+         .fd_type = fd_type,
+      };
+      vkr_capture_write(VKR_CAPTURE_RECORD_RESOURCE_IMPORT, ctx_id, &info, sizeof(info),
+                        NULL, 0);
+   }
+
+   return true;
 }
 
 void
@@ -233,6 +302,30 @@ vkr_renderer_destroy_resource(uint32_t ctx_id, uint32_t res_id)
    TRACE_FUNC();
 
    struct vkr_context *ctx = vkr_renderer_lookup_context(ctx_id);
-   if (ctx)
-      vkr_context_destroy_resource(ctx, res_id);
+   if (!ctx)
+      return;
+
+   vkr_context_destroy_resource(ctx, res_id);
+
+   if (vkr_capture_is_enabled()) {
+      const struct vkr_capture_resource info = {
+         .res_id = res_id,
+      };
+      vkr_capture_write(VKR_CAPTURE_RECORD_RESOURCE_DESTROY, ctx_id, &info, sizeof(info),
+                        NULL, 0);
+   }
+}
+
+uint32_t
+vkr_renderer_get_command_stats(uint32_t ctx_id,
+                               struct virgl_renderer_command_stat *stats,
+                               uint32_t max_count)
+{
+   TRACE_FUNC();
+
+   struct vkr_context *ctx = vkr_renderer_lookup_context(ctx_id);
+   if (!ctx)
+      return 0;
+
+   return vkr_context_get_command_stats(ctx, stats, max_count);
 }
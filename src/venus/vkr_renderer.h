@@ -62,6 +62,8 @@ vkr_renderer_create_resource(uint32_t ctx_id,
                              enum virgl_resource_fd_type *out_fd_type,
                              int *out_res_fd,
                              uint32_t *out_map_info,
+                             uint64_t *out_map_offset,
+                             bool *out_suballocated,
                              struct virgl_resource_vulkan_info *out_vulkan_info);
 
 bool
@@ -74,4 +76,9 @@ vkr_renderer_import_resource(uint32_t ctx_id,
 void
 vkr_renderer_destroy_resource(uint32_t ctx_id, uint32_t res_id);
 
+uint32_t
+vkr_renderer_get_command_stats(uint32_t ctx_id,
+                               struct virgl_renderer_command_stat *stats,
+                               uint32_t max_count);
+
 #endif /* VKR_RENDERER_H */
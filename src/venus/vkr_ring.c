@@ -207,6 +207,14 @@ vkr_ring_thread(void *arg)
    snprintf(thread_name, ARRAY_SIZE(thread_name), "vkr-ring-%d", ctx->ctx_id);
    u_thread_setname(thread_name);
 
+   if (vkr_thread_affinity_is_enabled()) {
+      vkr_thread_apply_affinity();
+      /* fault in the command buffer from the pinned thread to keep its pages
+       * on the local node
+       */
+      memset(ring->cmd, 0, ring->buffer.size);
+   }
+
    uint64_t last_submit = vkr_ring_now();
    uint32_t relax_iter = 0;
    int ret = 0;
@@ -8,6 +8,7 @@
 #include "venus-protocol/vn_protocol_renderer_dispatches.h"
 #include "venus-protocol/vn_protocol_renderer_transport.h"
 
+#include "vkr_capture.h"
 #include "vkr_context.h"
 #include "vkr_ring.h"
 
@@ -81,10 +82,19 @@ vkr_dispatch_vkExecuteCommandStreamsMESA(
          break;
       }
 
+      if (vkr_capture_is_enabled()) {
+         const struct vkr_capture_stream info = {
+            .res_id = stream->resourceId,
+            .offset = stream->offset,
+         };
+         vkr_capture_write(VKR_CAPTURE_RECORD_STREAM, ctx->ctx_id, &info, sizeof(info),
+                           res->u.data + stream->offset, stream->size);
+      }
+
       vkr_cs_decoder_set_stream(&ctx->decoder, res->u.data + stream->offset,
                                 stream->size);
       while (vkr_cs_decoder_has_command(&ctx->decoder)) {
-         vn_dispatch_command(&ctx->dispatch);
+         vkr_context_dispatch_command(ctx);
          if (vkr_cs_decoder_get_fatal(&ctx->decoder))
             break;
       }
@@ -33,6 +33,7 @@
 #include "virgl_resource.h"
 
 struct vrend_transfer_info;
+struct virgl_renderer_command_stat;
 struct pipe_resource;
 
 struct virgl_context_blob {
@@ -45,6 +46,10 @@ struct virgl_context_blob {
    } u;
 
    uint32_t map_info;
+   /* offset of the blob in the fd, when the fd is shared by several blobs */
+   uint64_t map_offset;
+   /* the fd refers to a larger storage shared with other blobs */
+   bool suballocated;
 
    struct virgl_resource_vulkan_info vulkan_info;
 };
@@ -122,6 +127,11 @@ struct virgl_context {
                        uint32_t flags,
                        uint32_t ring_idx,
                        uint64_t fence_id);
+
+   /* optional; see virgl_renderer_context_get_command_stats */
+   int (*get_command_stats)(struct virgl_context *ctx,
+                            struct virgl_renderer_command_stat *stats,
+                            uint32_t *count);
 };
 
 struct virgl_context_foreach_args {
@@ -260,6 +260,10 @@ virgl_resource_export_fd(struct virgl_resource *res, int *fd)
 
       return ctx->export_opaque_handle(ctx, res, fd);
    } else if (res->fd_type != VIRGL_RESOURCE_FD_INVALID) {
+      /* the fd refers to a larger storage that the importer cannot tell */
+      if (res->suballocated)
+         return VIRGL_RESOURCE_FD_INVALID;
+
       *fd = os_dupfd_cloexec(res->fd);
       return *fd >= 0 ? res->fd_type : VIRGL_RESOURCE_FD_INVALID;
    } else if (res->pipe_resource) {
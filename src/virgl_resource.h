@@ -25,6 +25,7 @@
 #ifndef VIRGL_RESOURCE_H
 #define VIRGL_RESOURCE_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 struct iovec;
@@ -99,6 +100,10 @@ struct virgl_resource {
    uint32_t map_info;
 
    uint64_t map_size;
+   /* the offset of the resource in fd */
+   uint64_t map_offset;
+   /* the fd is shared with other resources and cannot be exported */
+   bool suballocated;
    void *mapped;
 
    struct virgl_resource_vulkan_info vulkan_info;
@@ -434,6 +434,23 @@ int virgl_renderer_context_get_poll_fd(uint32_t ctx_id)
    return ctx->get_fencing_fd(ctx);
 }
 
+int virgl_renderer_context_get_command_stats(uint32_t ctx_id,
+                                             struct virgl_renderer_command_stat *stats,
+                                             uint32_t *count)
+{
+   TRACE_FUNC();
+   struct virgl_context *ctx = virgl_context_lookup(ctx_id);
+   if (!ctx)
+      return -EINVAL;
+
+   if (!ctx->get_command_stats) {
+      *count = 0;
+      return 0;
+   }
+
+   return ctx->get_command_stats(ctx, stats, count);
+}
+
 void virgl_renderer_force_ctx_0(void)
 {
    if (state.vrend_initialized)
@@ -923,7 +940,7 @@ int virgl_renderer_resource_create_blob(const struct virgl_renderer_resource_cre
    TRACE_FUNC();
    struct virgl_resource *res;
    struct virgl_context *ctx;
-   struct virgl_context_blob blob;
+   struct virgl_context_blob blob = { 0 };
    bool has_host_storage;
    bool has_guest_storage;
    int ret;
@@ -1012,6 +1029,8 @@ int virgl_renderer_resource_create_blob(const struct virgl_renderer_resource_cre
 
    res->map_info = blob.map_info;
    res->map_size = args->size;
+   res->map_offset = blob.map_offset;
+   res->suballocated = blob.suballocated;
 
    return 0;
 }
@@ -1034,7 +1053,8 @@ int virgl_renderer_resource_map(uint32_t res_handle, void **out_map, uint64_t *o
       switch (res->fd_type) {
       case VIRGL_RESOURCE_FD_DMABUF:
       case VIRGL_RESOURCE_FD_SHM:
-         map = mmap(NULL, res->map_size, PROT_WRITE | PROT_READ, MAP_SHARED, res->fd, 0);
+         map = mmap(NULL, res->map_size, PROT_WRITE | PROT_READ, MAP_SHARED, res->fd,
+                    res->map_offset);
          map_size = res->map_size;
          break;
       case VIRGL_RESOURCE_FD_OPAQUE:
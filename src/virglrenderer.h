@@ -391,6 +391,33 @@ VIRGL_EXPORT int virgl_renderer_context_create_fence(uint32_t ctx_id,
 VIRGL_EXPORT void virgl_renderer_context_poll(uint32_t ctx_id); /* force fences */
 VIRGL_EXPORT int virgl_renderer_context_get_poll_fd(uint32_t ctx_id);
 
+struct virgl_renderer_command_stat
+{
+   uint32_t command_type;
+   uint32_t padding;
+   char name[64];
+   uint64_t count;
+   /* bytes decoded for the command itself; the commands in the streams
+    * executed by vkExecuteCommandStreamsMESA are counted separately
+    */
+   uint64_t bytes;
+   /* time spent in the command, including the commands it executes */
+   uint64_t ns;
+   /* the part of ns spent in driver calls */
+   uint64_t driver_ns;
+};
+
+/*
+ * Get the per-command counters of a context, sorted by the time spent in
+ * each command.  On input, *count is the capacity of stats.  On output, it is
+ * the number of stats written.  Counters are only collected by venus contexts
+ * when VKR_DEBUG=command_stats is set.
+ */
+VIRGL_EXPORT int
+virgl_renderer_context_get_command_stats(uint32_t ctx_id,
+                                         struct virgl_renderer_command_stat *stats,
+                                         uint32_t *count);
+
 #endif /* VIRGL_RENDERER_UNSTABLE_APIS */
 
 #endif
@@ -0,0 +1,149 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * virgl_renderer_context_get_command_stats tests.  Only venus contexts
+ * collect counters; the other contexts report none.
+ */
+
+#include "config.h"
+
+#include <check.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <virglrenderer.h>
+
+#include "testvirgl.h"
+
+START_TEST(virgl_command_stats_no_ctx)
+{
+   struct virgl_renderer_command_stat stats[4];
+   uint32_t count = 4;
+   int ret;
+
+   ret = testvirgl_init_single_ctx();
+   ck_assert_int_eq(ret, 0);
+
+   ret = virgl_renderer_context_get_command_stats(2, stats, &count);
+   ck_assert_int_eq(ret, -EINVAL);
+
+   testvirgl_fini_single_ctx();
+}
+END_TEST
+
+START_TEST(virgl_command_stats_destroyed_ctx)
+{
+   struct virgl_renderer_command_stat stats[4];
+   uint32_t count = 4;
+   int ret;
+
+   ret = testvirgl_init_single_ctx();
+   ck_assert_int_eq(ret, 0);
+
+   virgl_renderer_context_destroy(1);
+
+   ret = virgl_renderer_context_get_command_stats(1, stats, &count);
+   ck_assert_int_eq(ret, -EINVAL);
+
+   testvirgl_fini_single_ctx();
+}
+END_TEST
+
+START_TEST(virgl_command_stats_vrend_ctx)
+{
+   struct virgl_renderer_command_stat stats[4];
+   uint32_t count = 4;
+   int ret;
+
+   ret = testvirgl_init_single_ctx();
+   ck_assert_int_eq(ret, 0);
+
+   memset(stats, 0xff, sizeof(stats));
+
+   ret = virgl_renderer_context_get_command_stats(1, stats, &count);
+   ck_assert_int_eq(ret, 0);
+   ck_assert_int_eq(count, 0);
+
+   /* nothing is written when there are no counters */
+   ck_assert_int_eq(stats[0].command_type, 0xffffffff);
+
+   testvirgl_fini_single_ctx();
+}
+END_TEST
+
+START_TEST(virgl_command_stats_vrend_ctx_no_capacity)
+{
+   uint32_t count = 0;
+   int ret;
+
+   ret = testvirgl_init_single_ctx();
+   ck_assert_int_eq(ret, 0);
+
+   ret = virgl_renderer_context_get_command_stats(1, NULL, &count);
+   ck_assert_int_eq(ret, 0);
+   ck_assert_int_eq(count, 0);
+
+   testvirgl_fini_single_ctx();
+}
+END_TEST
+
+static Suite *virgl_command_stats_suite(void)
+{
+   Suite *s;
+   TCase *tc_core;
+
+   s = suite_create("virgl_command_stats");
+   tc_core = tcase_create("command_stats");
+
+   tcase_add_test(tc_core, virgl_command_stats_no_ctx);
+   tcase_add_test(tc_core, virgl_command_stats_destroyed_ctx);
+   tcase_add_test(tc_core, virgl_command_stats_vrend_ctx);
+   tcase_add_test(tc_core, virgl_command_stats_vrend_ctx_no_capacity);
+
+   suite_add_tcase(s, tc_core);
+
+   return s;
+}
+
+int main(void)
+{
+   Suite *s;
+   SRunner *sr;
+   int number_failed;
+
+   if (getenv("VRENDTEST_USE_EGL_SURFACELESS"))
+      context_flags |= VIRGL_RENDERER_USE_SURFACELESS;
+   if (getenv("VRENDTEST_USE_EGL_GLES"))
+      context_flags |= VIRGL_RENDERER_USE_GLES;
+
+   s = virgl_command_stats_suite();
+   sr = srunner_create(s);
+
+   srunner_run_all(sr, CK_NORMAL);
+   number_failed = srunner_ntests_failed(sr);
+   srunner_free(sr);
+
+   return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
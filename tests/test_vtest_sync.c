@@ -0,0 +1,376 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * vtest sync wait tests: ANY and ALL waits, and waits that time out.
+ */
+
+#include "config.h"
+
+#include <check.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "testvtest.h"
+#include "vtest_protocol.h"
+
+#ifndef ARRAY_SIZE
+#  define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+#endif
+
+/* long enough to not expire while a test runs */
+#define LONG_TIMEOUT_MS 60000
+
+static struct testvtest_client client;
+
+static void sync_setup(void)
+{
+   testvtest_init_renderer();
+   testvtest_create_client(&client);
+}
+
+static void sync_teardown(void)
+{
+   testvtest_destroy_client(&client);
+   testvtest_fini_renderer();
+}
+
+static uint32_t create_sync(uint64_t value)
+{
+   const uint32_t args[VCMD_SYNC_CREATE_SIZE] = {
+      [VCMD_SYNC_CREATE_VALUE_LO] = (uint32_t)value,
+      [VCMD_SYNC_CREATE_VALUE_HI] = (uint32_t)(value >> 32),
+   };
+   uint32_t sync_id;
+   int ret;
+
+   ret = testvtest_dispatch(&client, vtest_sync_create, args, ARRAY_SIZE(args));
+   ck_assert_int_eq(ret, 0);
+   testvtest_read_reply(&client, VCMD_SYNC_CREATE, &sync_id, 1);
+
+   return sync_id;
+}
+
+static void write_sync(uint32_t sync_id, uint64_t value)
+{
+   const uint32_t args[VCMD_SYNC_WRITE_SIZE] = {
+      [VCMD_SYNC_WRITE_ID] = sync_id,
+      [VCMD_SYNC_WRITE_VALUE_LO] = (uint32_t)value,
+      [VCMD_SYNC_WRITE_VALUE_HI] = (uint32_t)(value >> 32),
+   };
+   int ret;
+
+   ret = testvtest_dispatch(&client, vtest_sync_write, args, ARRAY_SIZE(args));
+   ck_assert_int_eq(ret, 0);
+}
+
+/* returns the fd that becomes readable when the wait completes */
+static int wait_syncs(uint32_t flags,
+                      uint32_t timeout,
+                      const uint32_t *sync_ids,
+                      const uint64_t *values,
+                      uint32_t count)
+{
+   uint32_t args[VCMD_SYNC_WAIT_SIZE(4)];
+   uint32_t i;
+   int ret;
+
+   ck_assert_int_le(count, 4);
+
+   args[VCMD_SYNC_WAIT_FLAGS] = flags;
+   args[VCMD_SYNC_WAIT_TIMEOUT] = timeout;
+   for (i = 0; i < count; i++) {
+      args[VCMD_SYNC_WAIT_ID(i)] = sync_ids[i];
+      args[VCMD_SYNC_WAIT_VALUE_LO(i)] = (uint32_t)values[i];
+      args[VCMD_SYNC_WAIT_VALUE_HI(i)] = (uint32_t)(values[i] >> 32);
+   }
+
+   ret = testvtest_dispatch(&client, vtest_sync_wait, args,
+                            VCMD_SYNC_WAIT_SIZE(count));
+   ck_assert_int_eq(ret, 0);
+   testvtest_read_reply(&client, VCMD_SYNC_WAIT, NULL, 0);
+
+   return testvtest_receive_fd(&client);
+}
+
+static bool is_signaled(int fd)
+{
+   struct pollfd pollfd = {
+      .fd = fd,
+      .events = POLLIN,
+   };
+   int ret;
+
+   ret = poll(&pollfd, 1, 0);
+   ck_assert_int_ge(ret, 0);
+
+   return ret && (pollfd.revents & POLLIN);
+}
+
+static uint64_t sync_wait_count(void)
+{
+   return vtest_get_context_stats(client.ctx)->sync_wait_count;
+}
+
+START_TEST(vtest_sync_wait_all)
+{
+   const uint32_t syncs[2] = { create_sync(0), create_sync(0) };
+   const uint64_t values[2] = { 1, 2 };
+   int fd;
+
+   fd = wait_syncs(0, LONG_TIMEOUT_MS, syncs, values, 2);
+   ck_assert(!is_signaled(fd));
+
+   write_sync(syncs[0], 1);
+   ck_assert(!is_signaled(fd));
+
+   write_sync(syncs[1], 1);
+   ck_assert(!is_signaled(fd));
+
+   write_sync(syncs[1], 2);
+   ck_assert(is_signaled(fd));
+   ck_assert_int_eq(sync_wait_count(), 1);
+
+   close(fd);
+}
+END_TEST
+
+START_TEST(vtest_sync_wait_all_signaled)
+{
+   const uint32_t syncs[2] = { create_sync(1), create_sync(2) };
+   const uint64_t values[2] = { 1, 2 };
+   int fd;
+
+   fd = wait_syncs(0, LONG_TIMEOUT_MS, syncs, values, 2);
+   ck_assert(is_signaled(fd));
+   ck_assert_int_eq(sync_wait_count(), 1);
+
+   close(fd);
+}
+END_TEST
+
+START_TEST(vtest_sync_wait_any)
+{
+   const uint32_t syncs[2] = { create_sync(0), create_sync(0) };
+   const uint64_t values[2] = { 1, 1 };
+   int fd;
+
+   fd = wait_syncs(VCMD_SYNC_WAIT_FLAG_ANY, LONG_TIMEOUT_MS, syncs, values, 2);
+   ck_assert(!is_signaled(fd));
+
+   write_sync(syncs[1], 1);
+   ck_assert(is_signaled(fd));
+   ck_assert_int_eq(sync_wait_count(), 1);
+
+   /* the wait is gone */
+   write_sync(syncs[0], 1);
+   ck_assert_int_eq(sync_wait_count(), 1);
+
+   close(fd);
+}
+END_TEST
+
+START_TEST(vtest_sync_wait_any_signaled)
+{
+   const uint32_t syncs[2] = { create_sync(0), create_sync(5) };
+   const uint64_t values[2] = { 1, 1 };
+   int fd;
+
+   fd = wait_syncs(VCMD_SYNC_WAIT_FLAG_ANY, LONG_TIMEOUT_MS, syncs, values, 2);
+   ck_assert(is_signaled(fd));
+
+   close(fd);
+}
+END_TEST
+
+START_TEST(vtest_sync_wait_many)
+{
+   const uint32_t sync = create_sync(0);
+   int fds[4];
+   int i;
+
+   /* waits on the same sync complete in value order */
+   for (i = 0; i < 4; i++) {
+      const uint64_t value = 4 - i;
+      fds[i] = wait_syncs(0, LONG_TIMEOUT_MS, &sync, &value, 1);
+   }
+
+   write_sync(sync, 2);
+   ck_assert(!is_signaled(fds[0]));
+   ck_assert(!is_signaled(fds[1]));
+   ck_assert(is_signaled(fds[2]));
+   ck_assert(is_signaled(fds[3]));
+
+   write_sync(sync, 4);
+   ck_assert(is_signaled(fds[0]));
+   ck_assert(is_signaled(fds[1]));
+   ck_assert_int_eq(sync_wait_count(), 4);
+
+   for (i = 0; i < 4; i++)
+      close(fds[i]);
+}
+END_TEST
+
+START_TEST(vtest_sync_wait_no_timeout)
+{
+   const uint32_t sync = create_sync(0);
+   const uint64_t value = 1;
+   int fd;
+
+   /* a poll; the wait is not queued */
+   fd = wait_syncs(0, 0, &sync, &value, 1);
+   ck_assert(!is_signaled(fd));
+
+   write_sync(sync, 1);
+   ck_assert(!is_signaled(fd));
+   ck_assert_int_eq(sync_wait_count(), 0);
+
+   close(fd);
+}
+END_TEST
+
+START_TEST(vtest_sync_wait_timeout_poll)
+{
+   const uint32_t sync = create_sync(0);
+   const uint64_t value = 1;
+   int fd;
+
+   fd = wait_syncs(0, 1, &sync, &value, 1);
+   usleep(10 * 1000);
+
+   /* the context poll collects the expired wait */
+   vtest_poll_context(client.ctx);
+
+   write_sync(sync, 1);
+   ck_assert(!is_signaled(fd));
+   ck_assert_int_eq(sync_wait_count(), 0);
+
+   close(fd);
+}
+END_TEST
+
+START_TEST(vtest_sync_wait_timeout_signal)
+{
+   const uint32_t sync = create_sync(0);
+   const uint64_t expired_value = 2;
+   const uint64_t value = 1;
+   int expired_fd;
+   int fd;
+
+   expired_fd = wait_syncs(0, 1, &sync, &expired_value, 1);
+   fd = wait_syncs(0, LONG_TIMEOUT_MS, &sync, &value, 1);
+   usleep(10 * 1000);
+
+   /* the signal completes the pending wait and collects the expired one */
+   write_sync(sync, 1);
+   ck_assert(is_signaled(fd));
+   ck_assert(!is_signaled(expired_fd));
+
+   write_sync(sync, 2);
+   ck_assert(!is_signaled(expired_fd));
+   ck_assert_int_eq(sync_wait_count(), 1);
+
+   close(expired_fd);
+   close(fd);
+}
+END_TEST
+
+START_TEST(vtest_sync_wait_timeout_any)
+{
+   const uint32_t syncs[2] = { create_sync(0), create_sync(0) };
+   const uint64_t values[2] = { 1, 1 };
+   int fd;
+
+   fd = wait_syncs(VCMD_SYNC_WAIT_FLAG_ANY, 1, syncs, values, 2);
+   usleep(10 * 1000);
+
+   write_sync(syncs[0], 1);
+   ck_assert(!is_signaled(fd));
+   write_sync(syncs[1], 1);
+   ck_assert(!is_signaled(fd));
+   ck_assert_int_eq(sync_wait_count(), 0);
+
+   close(fd);
+}
+END_TEST
+
+START_TEST(vtest_sync_wait_invalid)
+{
+   const uint32_t sync = create_sync(0);
+   const uint32_t args[VCMD_SYNC_WAIT_SIZE(1)] = {
+      [VCMD_SYNC_WAIT_FLAGS] = 0,
+      [VCMD_SYNC_WAIT_TIMEOUT] = LONG_TIMEOUT_MS,
+      [VCMD_SYNC_WAIT_ID(0)] = sync + 1,
+      [VCMD_SYNC_WAIT_VALUE_LO(0)] = 1,
+   };
+   int ret;
+
+   ret = testvtest_dispatch(&client, vtest_sync_wait, args, ARRAY_SIZE(args));
+   ck_assert_int_eq(ret, -EEXIST);
+}
+END_TEST
+
+static Suite *vtest_sync_suite(void)
+{
+   Suite *s;
+   TCase *tc_core;
+
+   s = suite_create("vtest_sync");
+   tc_core = tcase_create("sync_wait");
+
+   tcase_add_checked_fixture(tc_core, sync_setup, sync_teardown);
+   tcase_add_test(tc_core, vtest_sync_wait_all);
+   tcase_add_test(tc_core, vtest_sync_wait_all_signaled);
+   tcase_add_test(tc_core, vtest_sync_wait_any);
+   tcase_add_test(tc_core, vtest_sync_wait_any_signaled);
+   tcase_add_test(tc_core, vtest_sync_wait_many);
+   tcase_add_test(tc_core, vtest_sync_wait_no_timeout);
+   tcase_add_test(tc_core, vtest_sync_wait_timeout_poll);
+   tcase_add_test(tc_core, vtest_sync_wait_timeout_signal);
+   tcase_add_test(tc_core, vtest_sync_wait_timeout_any);
+   tcase_add_test(tc_core, vtest_sync_wait_invalid);
+
+   suite_add_tcase(s, tc_core);
+
+   return s;
+}
+
+int main(void)
+{
+   Suite *s;
+   SRunner *sr;
+   int number_failed;
+
+   s = vtest_sync_suite();
+   sr = srunner_create(s);
+
+   srunner_run_all(sr, CK_NORMAL);
+   number_failed = srunner_ntests_failed(sr);
+   srunner_free(sr);
+
+   return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,318 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * vtest trace recording, loading, and shm replay tests.
+ */
+
+#include "config.h"
+
+#include <check.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "testvtest.h"
+#include "vtest_protocol.h"
+#include "vtest_trace.h"
+
+static char trace_dir[PATH_MAX];
+static char trace_path[PATH_MAX];
+
+static void trace_setup(void)
+{
+   snprintf(trace_dir, sizeof(trace_dir), "/tmp/vtest-trace-XXXXXX");
+   ck_assert_ptr_ne(mkdtemp(trace_dir), NULL);
+
+   snprintf(trace_path, sizeof(trace_path), "%s/trace", trace_dir);
+   setenv("VTEST_TRACE", trace_path, 1);
+}
+
+static void trace_teardown(void)
+{
+   struct dirent *entry;
+   DIR *dir;
+
+   unsetenv("VTEST_TRACE");
+
+   dir = opendir(trace_dir);
+   if (dir) {
+      while ((entry = readdir(dir))) {
+         char path[PATH_MAX * 2];
+
+         if (entry->d_name[0] == '.')
+            continue;
+         snprintf(path, sizeof(path), "%s/%s", trace_dir, entry->d_name);
+         unlink(path);
+      }
+      closedir(dir);
+   }
+   rmdir(trace_dir);
+}
+
+/* the trace file name has the pid and the session appended */
+static void find_trace_file(char *path, size_t size)
+{
+   struct dirent *entry;
+   bool found = false;
+   DIR *dir;
+
+   dir = opendir(trace_dir);
+   ck_assert_ptr_ne(dir, NULL);
+
+   while ((entry = readdir(dir))) {
+      if (!strncmp(entry->d_name, "trace.", 6)) {
+         ck_assert(!found);
+         snprintf(path, size, "%s/%s", trace_dir, entry->d_name);
+         found = true;
+      }
+   }
+   closedir(dir);
+
+   ck_assert(found);
+}
+
+static void write_test_trace(void)
+{
+   const uint32_t cmd[] = { 1, VCMD_SYNC_READ, 7 };
+   const struct vtest_trace_shm shm = {
+      .res_handle = 3,
+      .offset = 64,
+   };
+   const char shm_data[] = "shm data";
+
+   vtest_trace_open();
+   ck_assert(vtest_trace_is_enabled());
+
+   vtest_trace_write(VTEST_TRACE_RECORD_SHM, 1, &shm, sizeof(shm),
+                     shm_data, sizeof(shm_data));
+   vtest_trace_write(VTEST_TRACE_RECORD_COMMAND, 1, NULL, 0, cmd,
+                     sizeof(cmd));
+   vtest_trace_write(VTEST_TRACE_RECORD_CLIENT_END, 1, NULL, 0, NULL, 0);
+
+   vtest_trace_close();
+   ck_assert(!vtest_trace_is_enabled());
+}
+
+START_TEST(vtest_trace_disabled)
+{
+   unsetenv("VTEST_TRACE");
+
+   vtest_trace_open();
+   ck_assert(!vtest_trace_is_enabled());
+
+   /* a no-op */
+   vtest_trace_write(VTEST_TRACE_RECORD_CLIENT_END, 1, NULL, 0, NULL, 0);
+   vtest_trace_close();
+}
+END_TEST
+
+START_TEST(vtest_trace_round_trip)
+{
+   struct vtest_trace_reader reader = { 0 };
+   struct vtest_trace_record record;
+   struct vtest_trace_shm shm;
+   const char *payload;
+   char path[PATH_MAX * 2];
+   uint32_t cmd[3];
+   uint64_t timestamp;
+   bool ok;
+
+   write_test_trace();
+
+   find_trace_file(path, sizeof(path));
+   ok = vtest_trace_load(&reader, path);
+   ck_assert(ok);
+   ck_assert_int_eq(reader.record_count, 3);
+
+   payload = vtest_trace_get_record(&reader, 0, &record);
+   ck_assert_int_eq(record.type, VTEST_TRACE_RECORD_SHM);
+   ck_assert_int_eq(record.client_id, 1);
+   ck_assert_int_eq(record.seqno, 0);
+   ck_assert_int_eq(record.size, sizeof(shm) + sizeof("shm data"));
+   memcpy(&shm, payload, sizeof(shm));
+   ck_assert_int_eq(shm.res_handle, 3);
+   ck_assert_int_eq(shm.offset, 64);
+   ck_assert_str_eq(payload + sizeof(shm), "shm data");
+   timestamp = record.timestamp;
+
+   payload = vtest_trace_get_record(&reader, 1, &record);
+   ck_assert_int_eq(record.type, VTEST_TRACE_RECORD_COMMAND);
+   ck_assert_int_eq(record.seqno, 1);
+   ck_assert_int_eq(record.size, sizeof(cmd));
+   ck_assert_int_ge(record.timestamp, timestamp);
+   memcpy(cmd, payload, sizeof(cmd));
+   ck_assert_int_eq(cmd[VTEST_CMD_LEN], 1);
+   ck_assert_int_eq(cmd[VTEST_CMD_ID], VCMD_SYNC_READ);
+   ck_assert_int_eq(cmd[VTEST_CMD_DATA_START], 7);
+
+   vtest_trace_get_record(&reader, 2, &record);
+   ck_assert_int_eq(record.type, VTEST_TRACE_RECORD_CLIENT_END);
+   ck_assert_int_eq(record.seqno, 2);
+   ck_assert_int_eq(record.size, 0);
+
+   vtest_trace_unload(&reader);
+}
+END_TEST
+
+START_TEST(vtest_trace_truncated)
+{
+   struct vtest_trace_reader reader = { 0 };
+   char path[PATH_MAX * 2];
+   bool ok;
+   int ret;
+
+   write_test_trace();
+   find_trace_file(path, sizeof(path));
+
+   /* cut the command record short; the record after it is lost as well */
+   ret = truncate(path, sizeof(struct vtest_trace_header) +
+                        sizeof(struct vtest_trace_record) * 2 +
+                        sizeof(struct vtest_trace_shm) + sizeof("shm data") +
+                        4);
+   ck_assert_int_eq(ret, 0);
+
+   ok = vtest_trace_load(&reader, path);
+   ck_assert(ok);
+   ck_assert_int_eq(reader.record_count, 1);
+
+   vtest_trace_unload(&reader);
+}
+END_TEST
+
+START_TEST(vtest_trace_bad_header)
+{
+   const struct vtest_trace_header header = {
+      .magic = VTEST_TRACE_MAGIC,
+      .version = VTEST_TRACE_VERSION + 1,
+   };
+   struct vtest_trace_reader reader = { 0 };
+   char path[PATH_MAX * 2];
+   FILE *file;
+   bool ok;
+
+   snprintf(path, sizeof(path), "%s.bad", trace_path);
+   file = fopen(path, "wb");
+   ck_assert_ptr_ne(file, NULL);
+   ck_assert_int_eq(fwrite(&header, sizeof(header), 1, file), 1);
+   fclose(file);
+
+   ok = vtest_trace_load(&reader, path);
+   ck_assert(!ok);
+   vtest_trace_unload(&reader);
+
+   /* shorter than the header */
+   ok = truncate(path, sizeof(header) - 1) == 0;
+   ck_assert(ok);
+
+   ok = vtest_trace_load(&reader, path);
+   ck_assert(!ok);
+   vtest_trace_unload(&reader);
+}
+END_TEST
+
+START_TEST(vtest_trace_replay_shm)
+{
+   const uint32_t shm_size = 4096;
+   const char data[] = "replayed";
+   struct testvtest_client client;
+   char *ptr;
+   int fd;
+   int ret;
+
+   testvtest_init_renderer();
+   testvtest_create_client(&client);
+
+   /* no transfer shm yet */
+   ret = vtest_replay_shm(client.ctx, 0, 0, data, sizeof(data));
+   ck_assert_int_eq(ret, -EFAULT);
+
+   ret = testvtest_dispatch(&client, vtest_transfer_shm_create, &shm_size,
+                            VCMD_TRANSFER_SHM_CREATE_SIZE);
+   ck_assert_int_eq(ret, 0);
+   testvtest_read_reply(&client, VCMD_TRANSFER_SHM_CREATE, NULL, 0);
+   fd = testvtest_receive_fd(&client);
+
+   ptr = mmap(NULL, shm_size, PROT_READ, MAP_SHARED, fd, 0);
+   ck_assert_ptr_ne(ptr, MAP_FAILED);
+   close(fd);
+
+   ret = vtest_replay_shm(client.ctx, 0, 128, data, sizeof(data));
+   ck_assert_int_eq(ret, 0);
+   ck_assert_str_eq(ptr + 128, data);
+
+   ret = vtest_replay_shm(client.ctx, 0, shm_size - 1, data, sizeof(data));
+   ck_assert_int_eq(ret, -EFAULT);
+
+   ret = vtest_replay_shm(client.ctx, 42, 0, data, sizeof(data));
+   ck_assert_int_eq(ret, -ESRCH);
+
+   munmap(ptr, shm_size);
+
+   testvtest_destroy_client(&client);
+   testvtest_fini_renderer();
+}
+END_TEST
+
+static Suite *vtest_trace_suite(void)
+{
+   Suite *s;
+   TCase *tc_core;
+
+   s = suite_create("vtest_trace");
+   tc_core = tcase_create("trace");
+
+   tcase_add_checked_fixture(tc_core, trace_setup, trace_teardown);
+   tcase_add_test(tc_core, vtest_trace_disabled);
+   tcase_add_test(tc_core, vtest_trace_round_trip);
+   tcase_add_test(tc_core, vtest_trace_truncated);
+   tcase_add_test(tc_core, vtest_trace_bad_header);
+   tcase_add_test(tc_core, vtest_trace_replay_shm);
+
+   suite_add_tcase(s, tc_core);
+
+   return s;
+}
+
+int main(void)
+{
+   Suite *s;
+   SRunner *sr;
+   int number_failed;
+
+   s = vtest_trace_suite();
+   sr = srunner_create(s);
+
+   srunner_run_all(sr, CK_NORMAL);
+   number_failed = srunner_ntests_failed(sr);
+   srunner_free(sr);
+
+   return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,145 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include "config.h"
+
+#include <check.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <virglrenderer.h>
+
+#include "testvtest.h"
+#include "vtest_protocol.h"
+
+void testvtest_init_renderer(void)
+{
+   int ret;
+
+   ret = vtest_init_renderer(false, false, VIRGL_RENDERER_NO_VIRGL, NULL);
+   ck_assert_int_eq(ret, 0);
+}
+
+void testvtest_fini_renderer(void)
+{
+   vtest_cleanup_renderer();
+}
+
+void testvtest_create_client(struct testvtest_client *client)
+{
+   static const char name[] = "testvtest";
+   int ret;
+
+   ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, client->fds);
+   ck_assert_int_eq(ret, 0);
+
+   client->input.data.buffer = &client->buffer;
+   client->input.read = vtest_buf_read;
+
+   client->buffer.buffer = name;
+   client->buffer.size = strlen(name);
+
+   ret = vtest_create_context(&client->input, client->fds[0], strlen(name),
+                              &client->ctx);
+   ck_assert_int_eq(ret, 0);
+   ck_assert_int_eq(client->buffer.size, 0);
+}
+
+void testvtest_destroy_client(struct testvtest_client *client)
+{
+   vtest_destroy_context(client->ctx);
+   close(client->fds[0]);
+   close(client->fds[1]);
+}
+
+int testvtest_dispatch(struct testvtest_client *client,
+                       int (*handler)(uint32_t length_dw),
+                       const uint32_t *args,
+                       uint32_t length_dw)
+{
+   int ret;
+
+   client->buffer.buffer = (const char *)args;
+   client->buffer.size = length_dw * 4;
+
+   vtest_set_current_context(client->ctx);
+   ret = handler(length_dw);
+
+   /* a handler consumes all of its arguments */
+   if (!ret)
+      ck_assert_int_eq(client->buffer.size, 0);
+
+   return ret;
+}
+
+void testvtest_read_reply(struct testvtest_client *client,
+                          uint32_t cmd_id,
+                          uint32_t *data,
+                          uint32_t length_dw)
+{
+   uint32_t hdr[VTEST_HDR_SIZE];
+   ssize_t ret;
+
+   ret = read(client->fds[1], hdr, sizeof(hdr));
+   ck_assert_int_eq(ret, sizeof(hdr));
+   ck_assert_int_eq(hdr[VTEST_CMD_LEN], length_dw);
+   ck_assert_int_eq(hdr[VTEST_CMD_ID], cmd_id);
+
+   if (length_dw) {
+      ret = read(client->fds[1], data, length_dw * 4);
+      ck_assert_int_eq(ret, length_dw * 4);
+   }
+}
+
+int testvtest_receive_fd(struct testvtest_client *client)
+{
+   char buf[CMSG_SPACE(sizeof(int))];
+   char c;
+   struct iovec iov = {
+      .iov_base = &c,
+      .iov_len = sizeof(c),
+   };
+   struct msghdr msg = {
+      .msg_iov = &iov,
+      .msg_iovlen = 1,
+      .msg_control = buf,
+      .msg_controllen = sizeof(buf),
+   };
+   struct cmsghdr *cmsg;
+   ssize_t ret;
+   int fd;
+
+   ret = recvmsg(client->fds[1], &msg, MSG_CMSG_CLOEXEC);
+   ck_assert_int_eq(ret, 1);
+
+   cmsg = CMSG_FIRSTHDR(&msg);
+   ck_assert_ptr_ne(cmsg, NULL);
+   ck_assert_int_eq(cmsg->cmsg_level, SOL_SOCKET);
+   ck_assert_int_eq(cmsg->cmsg_type, SCM_RIGHTS);
+
+   memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+
+   return fd;
+}
@@ -0,0 +1,64 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#ifndef TESTVTEST_H
+#define TESTVTEST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vtest.h"
+
+/* a client driving the vtest command handlers directly; the handlers read
+ * their arguments from buffer and write their replies to fds[0]
+ */
+struct testvtest_client {
+   struct vtest_context *ctx;
+
+   struct vtest_buffer buffer;
+   struct vtest_input input;
+
+   int fds[2];
+};
+
+/* a renderer without vrend or venus, which is enough for syncs and shm */
+void testvtest_init_renderer(void);
+void testvtest_fini_renderer(void);
+
+void testvtest_create_client(struct testvtest_client *client);
+void testvtest_destroy_client(struct testvtest_client *client);
+
+int testvtest_dispatch(struct testvtest_client *client,
+                       int (*handler)(uint32_t length_dw),
+                       const uint32_t *args,
+                       uint32_t length_dw);
+
+void testvtest_read_reply(struct testvtest_client *client,
+                          uint32_t cmd_id,
+                          uint32_t *data,
+                          uint32_t length_dw);
+int testvtest_receive_fd(struct testvtest_client *client);
+
+#endif
@@ -34,19 +34,59 @@ struct vtest_buffer {
    int size;
 };
 
+/* data read ahead from fd, between start and end */
+struct vtest_read_buffer {
+   int fd;
+   char *data;
+   int size;
+   int start;
+   int end;
+};
+
+/* what a context has spent its time on; times are in nanoseconds */
+struct vtest_context_stats {
+   uint64_t submit_count;
+   uint64_t submit_bytes;
+   uint64_t submit_ns;
+
+   /* only data copied through the socket or the transfer shm is counted as
+    * bytes; transfers to shm-backed resources are counted as 0 bytes
+    */
+   uint64_t transfer_get_count;
+   uint64_t transfer_get_bytes;
+   uint64_t transfer_put_count;
+   uint64_t transfer_put_bytes;
+   uint64_t transfer_ns;
+
+   /* time blocked in VCMD_RESOURCE_BUSY_WAIT */
+   uint64_t busy_wait_ns;
+   /* time from VCMD_SYNC_WAIT until its fd is signaled */
+   uint64_t sync_wait_count;
+   uint64_t sync_wait_ns;
+
+   /* replies */
+   uint64_t write_bytes;
+   uint64_t write_ns;
+};
+
 struct vtest_input {
    union {
       int fd;
       struct vtest_buffer *buffer;
+      struct vtest_read_buffer *read_buffer;
    } data;
    int (*read)(struct vtest_input *input, void *buf, int size);
 };
 
 int vtest_init_renderer(bool multi_clients,
+                        bool threaded,
                         int ctx_flags,
                         const char *render_device);
 void vtest_cleanup_renderer(void);
 
+void vtest_lock_renderer(void);
+void vtest_unlock_renderer(void);
+
 int vtest_create_context(struct vtest_input *input, int out_fd,
                          uint32_t length_dw, struct vtest_context **out_ctx);
 int vtest_lazy_init_context(struct vtest_context *ctx);
@@ -75,6 +115,10 @@ int vtest_transfer_put2_nop(uint32_t length_dw);
 
 int vtest_block_read(struct vtest_input *input, void *buf, int size);
 int vtest_buf_read(struct vtest_input *input, void *buf, int size);
+int vtest_buffered_read(struct vtest_input *input, void *buf, int size);
+
+int vtest_init_read_buffer(struct vtest_read_buffer *rbuf, int fd, int size);
+void vtest_fini_read_buffer(struct vtest_read_buffer *rbuf);
 
 int vtest_resource_busy_wait(uint32_t length_dw);
 int vtest_resource_busy_wait_nop(uint32_t length_dw);
@@ -97,7 +141,20 @@ int vtest_sync_wait(uint32_t length_dw);
 
 int vtest_submit_cmd2(uint32_t length_dw);
 
+int vtest_transfer_shm_create(uint32_t length_dw);
+int vtest_transfer_shm_get(uint32_t length_dw);
+int vtest_transfer_shm_put(uint32_t length_dw);
+
 void vtest_set_max_length(uint32_t length);
 
+uint32_t vtest_get_context_id(struct vtest_context *ctx);
+const struct vtest_context_stats *
+vtest_get_context_stats(struct vtest_context *ctx);
+int vtest_replay_shm(struct vtest_context *ctx,
+                     uint32_t res_handle,
+                     uint64_t offset,
+                     const void *data,
+                     size_t size);
+
 #endif
 
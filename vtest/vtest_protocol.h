@@ -82,6 +82,10 @@
 #define VCMD_SYNC_WRITE 22
 #define VCMD_SYNC_WAIT 23
 #define VCMD_SUBMIT_CMD2 24
+/* supported when VCMD_PARAM_TRANSFER_SHM is valid */
+#define VCMD_TRANSFER_SHM_CREATE 25
+#define VCMD_TRANSFER_SHM_GET 26
+#define VCMD_TRANSFER_SHM_PUT 27
 #endif /* VIRGL_RENDERER_UNSTABLE_APIS */
 
 #define VCMD_RES_CREATE_SIZE 10
@@ -154,6 +158,7 @@
 
 enum vcmd_param  {
    VCMD_PARAM_MAX_TIMELINE_COUNT = 1,
+   VCMD_PARAM_TRANSFER_SHM = 2,
 };
 #define VCMD_GET_PARAM_SIZE 1
 #define VCMD_GET_PARAM_PARAM 0
@@ -241,6 +246,33 @@ struct vcmd_submit_cmd2_batch {
 #define VCMD_SUBMIT_CMD2_BATCH_SYNC_COUNT(n)       (1 + 8 * (n) + 4)
 #define VCMD_SUBMIT_CMD2_BATCH_RING_IDX(n)         (1 + 8 * (n) + 5)
 
+/*
+ * A context can have a shared memory region for transfers.  Unlike
+ * VCMD_TRANSFER_GET/PUT, VCMD_TRANSFER_SHM_GET/PUT transfer data between a
+ * resource and the region instead of sending it over the socket.
+ *
+ * VCMD_TRANSFER_SHM_PUT has no response.  The client must not modify the data
+ * until the response to a later command has been received.
+ */
+#define VCMD_TRANSFER_SHM_CREATE_SIZE 1
+#define VCMD_TRANSFER_SHM_CREATE_DATA_SIZE 0
+/* resp mmap'able fd; replaces the previous region */
+
+#define VCMD_TRANSFER_SHM_SIZE 12
+#define VCMD_TRANSFER_SHM_RES_HANDLE 0
+#define VCMD_TRANSFER_SHM_LEVEL 1
+#define VCMD_TRANSFER_SHM_STRIDE 2
+#define VCMD_TRANSFER_SHM_LAYER_STRIDE 3
+#define VCMD_TRANSFER_SHM_X 4
+#define VCMD_TRANSFER_SHM_Y 5
+#define VCMD_TRANSFER_SHM_Z 6
+#define VCMD_TRANSFER_SHM_WIDTH 7
+#define VCMD_TRANSFER_SHM_HEIGHT 8
+#define VCMD_TRANSFER_SHM_DEPTH 9
+#define VCMD_TRANSFER_SHM_DATA_SIZE 10
+#define VCMD_TRANSFER_SHM_DATA_OFFSET 11
+/* resp 0 on success for VCMD_TRANSFER_SHM_GET */
+
 #endif /* VIRGL_RENDERER_UNSTABLE_APIS */
 
 #endif /* VTEST_PROTOCOL */
@@ -33,6 +33,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 
 #include "virgl_hw.h"
 #include "virglrenderer.h"
@@ -47,10 +48,12 @@
 #include "vtest.h"
 #include "vtest_shm.h"
 #include "vtest_protocol.h"
+#include "vtest_trace.h"
 
 #include "util.h"
 #include "util/u_debug.h"
 #include "util/u_double_list.h"
+#include "util/u_format.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_pointer.h"
@@ -58,6 +61,9 @@
 
 #define VTEST_MAX_TIMELINE_COUNT 64
 
+/* larger command buffers are freed after use rather than kept around */
+#define VTEST_CMD_BUF_MAX_RETAINED_SIZE (4 * 1024 * 1024)
+
 struct vtest_resource {
    struct list_head head;
 
@@ -65,6 +71,11 @@ struct vtest_resource {
    uint32_t res_id;
 
    struct iovec iov;
+
+   /* PIPE_FORMAT_NONE for blob resources */
+   enum pipe_format format;
+   uint32_t width;
+   uint32_t height;
 };
 
 struct vtest_sync {
@@ -74,6 +85,11 @@ struct vtest_sync {
    int refcount;
 
    uint64_t value;
+
+   /* vtest_sync_waiters sorted by value such that a signal only visits the
+    * waiters it completes
+    */
+   struct list_head waiters;
 };
 
 struct vtest_timeline {
@@ -90,8 +106,20 @@ struct vtest_timeline_submit {
    uint64_t *values;
 };
 
+/* a vtest_sync_wait waiting for a sync to reach a value */
+struct vtest_sync_waiter {
+   /* on vtest_sync::waiters while sync is set */
+   struct list_head head;
+
+   struct vtest_sync_wait *wait;
+   struct vtest_sync *sync;
+   uint64_t value;
+};
+
 struct vtest_sync_wait {
+   /* on vtest_context::sync_waits, sorted by valid_before */
    struct list_head head;
+   struct vtest_context *ctx;
 
    int fd;
 
@@ -99,10 +127,12 @@ struct vtest_sync_wait {
    uint64_t valid_before;
 
    uint32_t count;
-   struct vtest_sync **syncs;
-   uint64_t *values;
+   struct vtest_sync_waiter *waiters;
 
    uint32_t signaled_count;
+
+   /* when VCMD_SYNC_WAIT was received */
+   uint64_t begin;
 };
 
 struct vtest_context {
@@ -125,6 +155,23 @@ struct vtest_context {
    struct vtest_timeline timelines[VTEST_MAX_TIMELINE_COUNT];
 
    struct list_head sync_waits;
+
+   /* implicit fences of VCMD_SUBMIT_CMD for VCMD_RESOURCE_BUSY_WAIT */
+   uint32_t implicit_fence_submitted;
+   uint32_t implicit_fence_completed;
+   /* in threaded mode, the main thread polls the context and signals this
+    * eventfd on implicit fence retires to wake up busy waits
+    */
+   int implicit_fence_fd;
+
+   /* receive buffer reused by VCMD_SUBMIT_CMD and VCMD_SUBMIT_CMD2 */
+   void *cmd_buf;
+   size_t cmd_buf_size;
+
+   /* region shared with the client for VCMD_TRANSFER_SHM_GET/PUT */
+   struct iovec transfer_shm;
+
+   struct vtest_context_stats stats;
 };
 
 struct vtest_renderer {
@@ -134,9 +181,6 @@ struct vtest_renderer {
 
    uint32_t max_length;
 
-   int implicit_fence_submitted;
-   int implicit_fence_completed;
-
    struct list_head active_contexts;
    struct list_head free_contexts;
    int next_context_id;
@@ -148,32 +192,98 @@ struct vtest_renderer {
    int next_sync_id;
 
    struct vtest_context *current_context;
+
+   /* In threaded mode, every client runs on its own thread and the renderer
+    * lock serializes everything that touches virglrenderer or the state
+    * above.  Client threads hold it except when they block on I/O.
+    */
+   bool threaded;
+   pthread_mutex_t mutex;
 };
 
 /*
  * VCMD_RESOURCE_BUSY_WAIT is used to wait GPU works (VCMD_SUBMIT_CMD) or CPU
  * works (VCMD_TRANSFER_GET2).  A fence is needed only for GPU works.
+ *
+ * Implicit fences are per-context such that a busy wait is not blocked by
+ * other contexts.  They share write_context_fence with timeline submits,
+ * whose fence ids are pointers.  Implicit fence ids have the lowest bit set
+ * instead.
  */
-static void vtest_create_implicit_fence(struct vtest_renderer *renderer)
+#define VTEST_IMPLICIT_FENCE_BIT 1
+
+static struct vtest_context *vtest_lookup_context(uint32_t ctx_id);
+static uint64_t vtest_gettime(uint32_t offset_ms);
+static void vtest_collect_sync_waits(struct vtest_context *ctx, uint64_t now);
+
+static void vtest_create_implicit_fence(struct vtest_context *ctx)
 {
-   virgl_renderer_create_fence(++renderer->implicit_fence_submitted, 0);
+   const uint32_t seqno = ctx->implicit_fence_submitted + 1;
+   const uint64_t fence_id = ((uint64_t)seqno << 1) | VTEST_IMPLICIT_FENCE_BIT;
+   int ret;
+
+   /* not mergeable: ring 0 also carries the timeline fences of
+    * VCMD_SUBMIT_CMD2, and a merge across the two would drop a retire
+    */
+   ret = virgl_renderer_context_create_fence(ctx->ctx_id, 0, 0, fence_id);
+   if (ret) {
+      /* a fence that never signals would make busy waits hang */
+      report_failed_call("virgl_renderer_context_create_fence", ret);
+      return;
+   }
+
+   ctx->implicit_fence_submitted = seqno;
 }
 
-static void vtest_write_implicit_fence(UNUSED void *cookie, uint32_t fence_id_in)
+static void vtest_write_implicit_fence(struct vtest_context *ctx, uint32_t seqno)
 {
-   struct vtest_renderer *renderer = (struct vtest_renderer*)cookie;
-   renderer->implicit_fence_completed = fence_id_in;
+   /* ignore fences from an earlier incarnation of a recycled context */
+   if (seqno > ctx->implicit_fence_submitted)
+      return;
+
+   ctx->implicit_fence_completed = seqno;
+
+   if (ctx->implicit_fence_fd >= 0) {
+      const uint64_t val = 1;
+      if (write(ctx->implicit_fence_fd, &val, sizeof(val)) != sizeof(val))
+         report_failed_call("write", -errno);
+   }
+}
+
+static void vtest_drain_implicit_fence_fd(struct vtest_context *ctx)
+{
+   uint64_t val;
+
+   if (ctx->implicit_fence_fd >= 0) {
+      /* the eventfd is non-blocking and a single read resets it */
+      if (read(ctx->implicit_fence_fd, &val, sizeof(val)) < 0 && errno != EAGAIN)
+         report_failed_call("read", -errno);
+   }
+}
+
+static void vtest_write_fence(UNUSED void *cookie, UNUSED uint32_t fence_id_in)
+{
+   /* all fences are context fences */
 }
 
 static void vtest_signal_timeline(struct vtest_timeline *timeline,
                                   struct vtest_timeline_submit *to_submit);
 
 static void vtest_write_context_fence(UNUSED void *cookie,
-                                      UNUSED uint32_t ctx_id,
+                                      uint32_t ctx_id,
                                       UNUSED uint32_t ring_idx,
                                       uint64_t fence_id)
 {
-   struct vtest_timeline_submit *submit = (void*)(uintptr_t)fence_id;
+   struct vtest_timeline_submit *submit;
+
+   if (fence_id & VTEST_IMPLICIT_FENCE_BIT) {
+      struct vtest_context *ctx = vtest_lookup_context(ctx_id);
+      if (ctx)
+         vtest_write_implicit_fence(ctx, fence_id >> 1);
+      return;
+   }
+
+   submit = (void*)(uintptr_t)fence_id;
    vtest_signal_timeline(submit->timeline, submit);
 }
 
@@ -192,7 +302,7 @@ static int vtest_get_drm_fd(void *cookie)
 
 static struct virgl_renderer_callbacks renderer_cbs = {
    .version = VIRGL_RENDERER_CALLBACKS_VERSION,
-   .write_fence = vtest_write_implicit_fence,
+   .write_fence = vtest_write_fence,
    .get_drm_fd = vtest_get_drm_fd,
    .write_context_fence = vtest_write_context_fence,
 };
@@ -203,8 +313,51 @@ static struct vtest_renderer renderer = {
    .next_context_id = 1,
    .next_resource_id = 1,
    .next_sync_id = 1,
+   .mutex = PTHREAD_MUTEX_INITIALIZER,
 };
 
+static struct vtest_context *vtest_lookup_context(uint32_t ctx_id)
+{
+   struct vtest_context *ctx;
+
+   LIST_FOR_EACH_ENTRY(ctx, &renderer.active_contexts, head) {
+      if ((uint32_t)ctx->ctx_id == ctx_id)
+         return ctx;
+   }
+
+   return NULL;
+}
+
+void vtest_lock_renderer(void)
+{
+   if (renderer.threaded)
+      pthread_mutex_lock(&renderer.mutex);
+}
+
+void vtest_unlock_renderer(void)
+{
+   if (renderer.threaded)
+      pthread_mutex_unlock(&renderer.mutex);
+}
+
+/* Drop the renderer lock around a blocking call.  Other clients may run and
+ * change the current context in the meantime, so it is restored afterwards.
+ */
+static struct vtest_context *vtest_begin_blocking(void)
+{
+   struct vtest_context *ctx = renderer.current_context;
+
+   vtest_unlock_renderer();
+
+   return ctx;
+}
+
+static void vtest_end_blocking(struct vtest_context *ctx)
+{
+   vtest_lock_renderer();
+   renderer.current_context = ctx;
+}
+
 static struct vtest_resource *vtest_new_resource(uint32_t client_res_id)
 {
    struct vtest_resource *res;
@@ -224,6 +377,9 @@ static struct vtest_resource *vtest_new_resource(uint32_t client_res_id)
    res->res_id = client_res_id ? client_res_id : res->server_res_id;
    res->iov.iov_base = NULL;
    res->iov.iov_len = 0;
+   res->format = PIPE_FORMAT_NONE;
+   res->width = 0;
+   res->height = 0;
 
    return res;
 }
@@ -259,6 +415,7 @@ static struct vtest_sync *vtest_new_sync(uint64_t value)
 
    sync->refcount = 1;
    sync->value = value;
+   list_inithead(&sync->waiters);
 
    return sync;
 }
@@ -276,6 +433,8 @@ static void vtest_unref_sync(struct vtest_sync *sync)
    if (sync->refcount)
       return;
 
+   /* waiters hold references */
+   assert(list_is_empty(&sync->waiters));
    list_add(&sync->head, &renderer.free_syncs);
 }
 
@@ -292,8 +451,12 @@ static void vtest_free_sync_wait(struct vtest_sync_wait *wait)
    uint32_t i;
 
    for (i = 0; i < wait->count; i++) {
-      if (wait->syncs[i])
-         vtest_unref_sync(wait->syncs[i]);
+      struct vtest_sync_waiter *waiter = &wait->waiters[i];
+
+      if (waiter->sync) {
+         list_del(&waiter->head);
+         vtest_unref_sync(waiter->sync);
+      }
    }
    close(wait->fd);
    free(wait);
@@ -326,60 +489,190 @@ sync_destroy_func(void *value)
    vtest_unref_sync(sync);
 }
 
-static int vtest_block_write(int fd, void *buf, int size)
+/* iov is modified to track partial writes */
+static int vtest_block_writev(int fd, struct iovec *iov, int iov_count)
 {
-   char *ptr = buf;
-   int left;
-   int ret;
-   left = size;
+   struct vtest_context *ctx;
+   uint64_t begin;
+   ssize_t ret = 0;
+   int size = 0;
+   int i;
 
-   do {
-      ret = write(fd, ptr, left);
+   for (i = 0; i < iov_count; i++) {
+      size += iov[i].iov_len;
+   }
+
+   begin = vtest_trace_now();
+
+   ctx = vtest_begin_blocking();
+   while (iov_count) {
+      ret = writev(fd, iov, iov_count);
       if (ret < 0) {
-         return -errno;
+         ret = -errno;
+         break;
       }
 
-      left -= ret;
-      ptr += ret;
-   } while (left);
+      while (iov_count && (size_t)ret >= iov->iov_len) {
+         ret -= iov->iov_len;
+         iov++;
+         iov_count--;
+      }
 
-   return size;
+      if (iov_count) {
+         iov->iov_base = (char *)iov->iov_base + ret;
+         iov->iov_len -= ret;
+      }
+   }
+   vtest_end_blocking(ctx);
+
+   if (ctx) {
+      ctx->stats.write_bytes += size;
+      ctx->stats.write_ns += vtest_trace_now() - begin;
+   }
+
+   return iov_count ? (int)ret : size;
+}
+
+static int vtest_block_write(int fd, void *buf, int size)
+{
+   struct iovec iov = {
+      .iov_base = buf,
+      .iov_len = size,
+   };
+
+   return vtest_block_writev(fd, &iov, 1);
+}
+
+static void vtest_save_input(const void *buf, int size)
+{
+   static int savefd = -1;
+
+   if (getenv("VTEST_SAVE")) {
+      if (savefd == -1) {
+         savefd = open(getenv("VTEST_SAVE"),
+                       O_CLOEXEC|O_CREAT|O_WRONLY|O_TRUNC|O_DSYNC, S_IRUSR|S_IWUSR);
+         if (savefd == -1) {
+            perror("error opening save file");
+            exit(1);
+         }
+      }
+      if (write(savefd, buf, size) != size) {
+         perror("failed to save");
+         exit(1);
+      }
+   }
 }
 
 int vtest_block_read(struct vtest_input *input, void *buf, int size)
 {
+   struct vtest_context *ctx;
    int fd = input->data.fd;
    char *ptr = buf;
    int left;
    int ret;
-   static int savefd = -1;
 
    left = size;
+   ctx = vtest_begin_blocking();
    do {
       ret = read(fd, ptr, left);
       if (ret <= 0) {
-         return ret == -1 ? -errno : 0;
+         ret = ret == -1 ? -errno : 0;
+         break;
       }
 
       left -= ret;
       ptr += ret;
    } while (left);
+   vtest_end_blocking(ctx);
 
-   if (getenv("VTEST_SAVE")) {
-      if (savefd == -1) {
-         savefd = open(getenv("VTEST_SAVE"),
-                       O_CLOEXEC|O_CREAT|O_WRONLY|O_TRUNC|O_DSYNC, S_IRUSR|S_IWUSR);
-         if (savefd == -1) {
-            perror("error opening save file");
-            exit(1);
-         }
+   if (left) {
+      return ret;
+   }
+
+   vtest_save_input(buf, size);
+
+   return size;
+}
+
+int vtest_init_read_buffer(struct vtest_read_buffer *rbuf, int fd, int size)
+{
+   rbuf->data = malloc(size);
+   if (!rbuf->data) {
+      return -ENOMEM;
+   }
+
+   rbuf->fd = fd;
+   rbuf->size = size;
+   rbuf->start = 0;
+   rbuf->end = 0;
+
+   return 0;
+}
+
+void vtest_fini_read_buffer(struct vtest_read_buffer *rbuf)
+{
+   free(rbuf->data);
+   rbuf->data = NULL;
+}
+
+/*
+ * Like vtest_block_read, but read ahead as much as the fd has to offer such
+ * that the headers and payloads of pipelined commands are read with a single
+ * syscall.
+ */
+int vtest_buffered_read(struct vtest_input *input, void *buf, int size)
+{
+   struct vtest_read_buffer *rbuf = input->data.read_buffer;
+   struct vtest_context *ctx;
+   char *ptr = buf;
+   int left = size;
+   int ret = 0;
+
+   while (left) {
+      const int avail = rbuf->end - rbuf->start;
+      bool direct;
+
+      if (avail) {
+         const int count = MIN2(avail, left);
+
+         memcpy(ptr, rbuf->data + rbuf->start, count);
+         rbuf->start += count;
+         left -= count;
+         ptr += count;
+         continue;
       }
-      if (write(savefd, buf, size) != size) {
-         perror("failed to save");
-         exit(1);
+
+      rbuf->start = 0;
+      rbuf->end = 0;
+
+      /* read large payloads directly to save a copy */
+      direct = left >= rbuf->size;
+
+      ctx = vtest_begin_blocking();
+      if (direct) {
+         ret = read(rbuf->fd, ptr, left);
+      } else {
+         ret = read(rbuf->fd, rbuf->data, rbuf->size);
+      }
+      if (ret <= 0) {
+         ret = ret == -1 ? -errno : 0;
+      }
+      vtest_end_blocking(ctx);
+
+      if (ret <= 0) {
+         return ret;
+      }
+
+      if (direct) {
+         left -= ret;
+         ptr += ret;
+      } else {
+         rbuf->end = ret;
       }
    }
 
+   vtest_save_input(buf, size);
+
    return size;
 }
 
@@ -432,6 +725,7 @@ int vtest_buf_read(struct vtest_input *input, void *buf, int size)
 }
 
 int vtest_init_renderer(bool multi_clients,
+                        bool threaded,
                         int ctx_flags,
                         const char *render_device)
 {
@@ -452,6 +746,7 @@ int vtest_init_renderer(bool multi_clients,
    }
 
    renderer.multi_clients = multi_clients;
+   renderer.threaded = threaded;
    renderer.ctx_flags = ctx_flags;
 
    return 0;
@@ -501,6 +796,7 @@ void vtest_cleanup_renderer(void)
    }
 
    virgl_renderer_cleanup(&renderer);
+   renderer.threaded = false;
 }
 
 static struct vtest_context *vtest_new_context(struct vtest_input *input,
@@ -540,6 +836,22 @@ static struct vtest_context *vtest_new_context(struct vtest_input *input,
 
       list_inithead(&ctx->sync_waits);
 
+      ctx->implicit_fence_fd = -1;
+      if (renderer.threaded) {
+#ifdef HAVE_EVENTFD_H
+         ctx->implicit_fence_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+#endif
+         if (ctx->implicit_fence_fd < 0) {
+            util_hash_table_destroy(ctx->sync_table);
+            util_hash_table_destroy(ctx->resource_table);
+            free(ctx);
+            return NULL;
+         }
+      }
+
+      ctx->cmd_buf = NULL;
+      ctx->cmd_buf_size = 0;
+
       ctx->ctx_id = renderer.next_context_id++;
    } else {
       ctx = LIST_ENTRY(struct vtest_context, renderer.free_contexts.next, head);
@@ -554,6 +866,12 @@ static struct vtest_context *vtest_new_context(struct vtest_input *input,
    ctx->protocol_version = 0;
    ctx->capset_id = 0;
    ctx->context_initialized = false;
+   ctx->transfer_shm.iov_base = NULL;
+   ctx->transfer_shm.iov_len = 0;
+   ctx->implicit_fence_submitted = 0;
+   ctx->implicit_fence_completed = 0;
+   vtest_drain_implicit_fence_fd(ctx);
+   memset(&ctx->stats, 0, sizeof(ctx->stats));
 
    return ctx;
 }
@@ -563,6 +881,9 @@ static void vtest_free_context(struct vtest_context *ctx, bool cleanup)
    if (cleanup) {
       util_hash_table_destroy(ctx->resource_table);
       util_hash_table_destroy(ctx->sync_table);
+      if (ctx->implicit_fence_fd >= 0)
+         close(ctx->implicit_fence_fd);
+      free(ctx->cmd_buf);
       free(ctx);
    } else {
       list_add(&ctx->head, &renderer.free_contexts);
@@ -661,6 +982,8 @@ void vtest_destroy_context(struct vtest_context *ctx)
    list_inithead(&ctx->sync_waits);
 
    free(ctx->debug_name);
+   if (ctx->transfer_shm.iov_base)
+      munmap(ctx->transfer_shm.iov_base, ctx->transfer_shm.iov_len);
    if (ctx->context_initialized)
       virgl_renderer_context_destroy(ctx->ctx_id);
    util_hash_table_clear(ctx->resource_table);
@@ -671,6 +994,9 @@ void vtest_destroy_context(struct vtest_context *ctx)
 void vtest_poll_context(struct vtest_context *ctx)
 {
    virgl_renderer_context_poll(ctx->ctx_id);
+
+   if (!list_is_empty(&ctx->sync_waits))
+      vtest_collect_sync_waits(ctx, vtest_gettime(0));
 }
 
 int vtest_get_context_poll_fd(struct vtest_context *ctx)
@@ -745,12 +1071,11 @@ int vtest_protocol_version(UNUSED uint32_t length_dw)
 
    version_buf[VCMD_PROTOCOL_VERSION_VERSION] = ctx->protocol_version;
 
-   ret = vtest_block_write(ctx->out_fd, hdr_buf, sizeof(hdr_buf));
-   if (ret < 0) {
-      return ret;
-   }
-
-   ret = vtest_block_write(ctx->out_fd, version_buf, sizeof(version_buf));
+   struct iovec iov[] = {
+      { .iov_base = hdr_buf, .iov_len = sizeof(hdr_buf) },
+      { .iov_base = version_buf, .iov_len = sizeof(version_buf) },
+   };
+   ret = vtest_block_writev(ctx->out_fd, iov, ARRAY_SIZE(iov));
    if (ret < 0) {
       return ret;
    }
@@ -789,6 +1114,10 @@ int vtest_get_param(UNUSED uint32_t length_dw)
       resp[1] = 0;
 #endif
       break;
+   case VCMD_PARAM_TRANSFER_SHM:
+      resp[0] = true;
+      resp[1] = 1;
+      break;
    default:
       resp[0] = false;
       resp[1] = 0;
@@ -843,9 +1172,12 @@ int vtest_get_capset(UNUSED uint32_t length_dw)
    resp_buf[VTEST_CMD_LEN] = 1 + max_size / 4;
    resp_buf[VTEST_CMD_ID] = VCMD_GET_CAPSET;
    resp_buf[VTEST_CMD_DATA_START] = true;
-   ret = vtest_block_write(ctx->out_fd, resp_buf, sizeof(resp_buf));
-   if (ret >= 0)
-      ret = vtest_block_write(ctx->out_fd, caps, max_size);
+
+   struct iovec iov[] = {
+      { .iov_base = resp_buf, .iov_len = sizeof(resp_buf) },
+      { .iov_base = caps, .iov_len = max_size },
+   };
+   ret = vtest_block_writev(ctx->out_fd, iov, ARRAY_SIZE(iov));
 
    free(caps);
    return ret >= 0 ? 0 : ret;
@@ -880,7 +1212,6 @@ int vtest_send_caps2(UNUSED uint32_t length_dw)
    struct vtest_context *ctx = vtest_get_current_context();
    uint32_t hdr_buf[2];
    void *caps_buf;
-   int ret;
    uint32_t max_ver, max_size;
 
    virgl_renderer_get_cap_set(2, &max_ver, &max_size);
@@ -898,17 +1229,12 @@ int vtest_send_caps2(UNUSED uint32_t length_dw)
 
    hdr_buf[0] = max_size + 1;
    hdr_buf[1] = 2;
-   ret = vtest_block_write(ctx->out_fd, hdr_buf, 8);
-   if (ret < 0) {
-      goto end;
-   }
-
-   ret = vtest_block_write(ctx->out_fd, caps_buf, max_size);
-   if (ret < 0) {
-      goto end;
-   }
+   struct iovec iov[] = {
+      { .iov_base = hdr_buf, .iov_len = 8 },
+      { .iov_base = caps_buf, .iov_len = max_size },
+   };
+   vtest_block_writev(ctx->out_fd, iov, ARRAY_SIZE(iov));
 
-end:
    free(caps_buf);
    return 0;
 }
@@ -919,7 +1245,6 @@ int vtest_send_caps(UNUSED uint32_t length_dw)
    uint32_t  max_ver, max_size;
    void *caps_buf;
    uint32_t hdr_buf[2];
-   int ret;
 
    virgl_renderer_get_cap_set(1, &max_ver, &max_size);
 
@@ -932,17 +1257,12 @@ int vtest_send_caps(UNUSED uint32_t length_dw)
 
    hdr_buf[0] = max_size + 1;
    hdr_buf[1] = 1;
-   ret = vtest_block_write(ctx->out_fd, hdr_buf, 8);
-   if (ret < 0) {
-      goto end;
-   }
+   struct iovec iov[] = {
+      { .iov_base = hdr_buf, .iov_len = 8 },
+      { .iov_base = caps_buf, .iov_len = max_size },
+   };
+   vtest_block_writev(ctx->out_fd, iov, ARRAY_SIZE(iov));
 
-   ret = vtest_block_write(ctx->out_fd, caps_buf, max_size);
-   if (ret < 0) {
-      goto end;
-   }
-
-end:
    free(caps_buf);
    return 0;
 }
@@ -1050,6 +1370,9 @@ static int vtest_create_resource_internal(struct vtest_context *ctx,
    if (!res)
       return -ENOMEM;
    args->handle = res->res_id;
+   res->format = args->format;
+   res->width = args->width;
+   res->height = args->height;
 
    ret = virgl_renderer_resource_create(args, NULL, 0);
    if (ret) {
@@ -1249,34 +1572,79 @@ int vtest_resource_unref(UNUSED uint32_t length_dw)
    return 0;
 }
 
+/*
+ * Return a buffer of at least size bytes for receiving commands.  The buffer
+ * is owned by the context and is valid until vtest_context_put_cmd_buf.
+ */
+static void *vtest_context_get_cmd_buf(struct vtest_context *ctx, size_t size)
+{
+   size_t new_size;
+   void *new_buf;
+
+   if (ctx->cmd_buf && size <= ctx->cmd_buf_size) {
+      return ctx->cmd_buf;
+   }
+
+   /* grow geometrically such that growing submissions settle quickly */
+   new_size = MAX2(util_next_power_of_two64(size), 4096);
+
+   /* nothing in the old buffer needs to be preserved */
+   free(ctx->cmd_buf);
+   new_buf = malloc(new_size);
+   if (!new_buf) {
+      ctx->cmd_buf = NULL;
+      ctx->cmd_buf_size = 0;
+      return NULL;
+   }
+
+   ctx->cmd_buf = new_buf;
+   ctx->cmd_buf_size = new_size;
+
+   return new_buf;
+}
+
+static void vtest_context_put_cmd_buf(struct vtest_context *ctx)
+{
+   if (ctx->cmd_buf_size > VTEST_CMD_BUF_MAX_RETAINED_SIZE) {
+      free(ctx->cmd_buf);
+      ctx->cmd_buf = NULL;
+      ctx->cmd_buf_size = 0;
+   }
+}
+
 int vtest_submit_cmd(uint32_t length_dw)
 {
    struct vtest_context *ctx = vtest_get_current_context();
    uint32_t *cbuf;
+   uint64_t begin;
    int ret;
 
    if (length_dw > renderer.max_length / 4) {
       return -1;
    }
 
-   cbuf = malloc(length_dw * 4);
+   cbuf = vtest_context_get_cmd_buf(ctx, length_dw * 4);
    if (!cbuf) {
       return -1;
    }
 
    ret = ctx->input->read(ctx->input, cbuf, length_dw * 4);
    if (ret != (int)length_dw * 4) {
-      free(cbuf);
+      vtest_context_put_cmd_buf(ctx);
       return -1;
    }
 
+   begin = vtest_trace_now();
    ret = virgl_renderer_submit_cmd(cbuf, ctx->ctx_id, length_dw);
+   ctx->stats.submit_ns += vtest_trace_now() - begin;
+   ctx->stats.submit_count++;
+   ctx->stats.submit_bytes += length_dw * 4;
 
-   free(cbuf);
+   vtest_context_put_cmd_buf(ctx);
    if (ret)
       return -1;
 
-   vtest_create_implicit_fence(&renderer);
+   vtest_create_implicit_fence(ctx);
    return 0;
 }
 
@@ -1376,6 +1744,8 @@ static int vtest_transfer_get_internal(struct vtest_context *ctx,
    }
 
    if (do_transfer) {
+      uint64_t begin = vtest_trace_now();
+
       ret = virgl_renderer_transfer_read_iov(res->res_id,
                                              ctx->ctx_id,
                                              args->level,
@@ -1388,6 +1758,10 @@ static int vtest_transfer_get_internal(struct vtest_context *ctx,
       if (ret) {
          report_failed_call("virgl_renderer_transfer_read_iov", ret);
       }
+
+      ctx->stats.transfer_ns += vtest_trace_now() - begin;
+      ctx->stats.transfer_get_count++;
+      ctx->stats.transfer_get_bytes += data_size;
    } else if (data_size) {
       memset(data_iov.iov_base, 0, data_iov.iov_len);
    }
@@ -1403,6 +1777,54 @@ static int vtest_transfer_get_internal(struct vtest_context *ctx,
    return ret;
 }
 
+/* The size of the data of a transfer to or from the backing iov of a
+ * resource, computed the same way as vrend does.
+ */
+static uint64_t vtest_transfer_size(const struct vtest_resource *res,
+                                    const struct vtest_transfer_args *args)
+{
+   const struct virgl_box *box = &args->box;
+   const uint32_t w = box->w ? box->w : 1;
+   const uint32_t h = box->h ? box->h : 1;
+   const uint32_t d = box->d ? box->d : 1;
+   uint64_t stride = args->stride;
+   uint64_t layer_stride = args->layer_stride;
+
+   /* blob resources are plain bytes */
+   if (res->format == PIPE_FORMAT_NONE)
+      return w;
+
+   if (!stride)
+      stride = util_format_get_stride(res->format, u_minify(res->width, args->level));
+   if (!layer_stride) {
+      layer_stride = util_format_get_2d_size(res->format, stride,
+                                             u_minify(res->height, args->level));
+   }
+
+   return (d - 1) * layer_stride +
+          (util_format_get_nblocksy(res->format, h) - 1) * stride +
+          util_format_get_nblocksx(res->format, w) *
+          util_format_get_blocksize(res->format);
+}
+
+static void vtest_trace_shm(struct vtest_context *ctx,
+                            uint32_t res_handle,
+                            uint64_t offset,
+                            const void *data,
+                            size_t size)
+{
+   const struct vtest_trace_shm info = {
+      .res_handle = res_handle,
+      .offset = offset,
+   };
+
+   if (!vtest_trace_is_enabled())
+      return;
+
+   vtest_trace_write(VTEST_TRACE_RECORD_SHM, ctx->ctx_id, &info, sizeof(info),
+                     data, size);
+}
+
 static int vtest_transfer_put_internal(struct vtest_context *ctx,
                                        struct vtest_transfer_args *args,
                                        uint32_t data_size,
@@ -1429,9 +1851,18 @@ static int vtest_transfer_put_internal(struct vtest_context *ctx,
       if (ret < 0) {
          return ret;
       }
+   } else if (do_transfer && res->iov.iov_base && args->offset < res->iov.iov_len) {
+      /* the client has written the data to the shm directly */
+      const uint64_t size = MIN2(vtest_transfer_size(res, args),
+                                 res->iov.iov_len - args->offset);
+
+      vtest_trace_shm(ctx, args->handle, args->offset,
+                      (char *)res->iov.iov_base + args->offset, size);
    }
 
    if (do_transfer) {
+      uint64_t begin = vtest_trace_now();
+
       ret = virgl_renderer_transfer_write_iov(res->res_id,
                                               ctx->ctx_id,
                                               args->level,
@@ -1444,6 +1875,10 @@ static int vtest_transfer_put_internal(struct vtest_context *ctx,
       if (ret) {
          report_failed_call("virgl_renderer_transfer_write_iov", ret);
       }
+
+      ctx->stats.transfer_ns += vtest_trace_now() - begin;
+      ctx->stats.transfer_put_count++;
+      ctx->stats.transfer_put_bytes += data_size;
    }
 
    if (data_size) {
@@ -1592,33 +2027,50 @@ int vtest_resource_busy_wait(UNUSED uint32_t length_dw)
    if (!ctx->context_initialized && bw_buf[VCMD_BUSY_WAIT_HANDLE])
       return -1;
 
-   /*  handle = bw_buf[VCMD_BUSY_WAIT_HANDLE]; unused as of now */
+   /* handle = bw_buf[VCMD_BUSY_WAIT_HANDLE]; unused because submitted
+    * commands are opaque to us and may use any resource of the context
+    */
    flags = bw_buf[VCMD_BUSY_WAIT_FLAGS];
 
    do {
-      busy = renderer.implicit_fence_completed !=
-             renderer.implicit_fence_submitted;
+      busy = ctx->implicit_fence_completed != ctx->implicit_fence_submitted;
       if (!busy || !(flags & VCMD_BUSY_WAIT_FLAG_WAIT))
          break;
 
-      /* TODO this is bad when there are multiple clients */
-      fd = virgl_renderer_get_poll_fd();
+      /* In threaded mode, the main thread polls the context and may drain
+       * its poll fd before we get to wait on it.  Wait on the eventfd that
+       * the fence callback signals instead.  The callback runs under the
+       * renderer lock, so a retire after the check above is not missed.
+       */
+      fd = ctx->implicit_fence_fd;
+      if (fd == -1)
+         fd = virgl_renderer_context_get_poll_fd(ctx->ctx_id);
+      if (fd == -1)
+         fd = virgl_renderer_get_poll_fd();
       if (fd != -1) {
+         uint64_t begin = vtest_trace_now();
+
+         ctx = vtest_begin_blocking();
          vtest_wait_for_fd_read(fd);
+         vtest_end_blocking(ctx);
+
+         vtest_drain_implicit_fence_fd(ctx);
+
+         ctx->stats.busy_wait_ns += vtest_trace_now() - begin;
       }
       virgl_renderer_poll();
+      virgl_renderer_context_poll(ctx->ctx_id);
    } while (true);
 
    hdr_buf[VTEST_CMD_LEN] = 1;
    hdr_buf[VTEST_CMD_ID] = VCMD_RESOURCE_BUSY_WAIT;
    reply_buf[0] = busy ? 1 : 0;
 
-   ret = vtest_block_write(ctx->out_fd, hdr_buf, sizeof(hdr_buf));
-   if (ret < 0) {
-      return ret;
-   }
-
-   ret = vtest_block_write(ctx->out_fd, reply_buf, sizeof(reply_buf));
+   struct iovec iov[] = {
+      { .iov_base = hdr_buf, .iov_len = sizeof(hdr_buf) },
+      { .iov_base = reply_buf, .iov_len = sizeof(reply_buf) },
+   };
+   ret = vtest_block_writev(ctx->out_fd, iov, ARRAY_SIZE(iov));
    if (ret < 0) {
       return ret;
    }
@@ -1686,11 +2138,26 @@ static inline void write_ready(int fd)
 }
 
 
-/* TODO this is slow */
+static void vtest_complete_sync_wait(struct vtest_sync_wait *wait,
+                                     uint64_t now)
+{
+   struct vtest_context *ctx = wait->ctx;
+
+   /* the client has given up on expired waits */
+   if (wait->valid_before >= now) {
+      ctx->stats.sync_wait_count++;
+      ctx->stats.sync_wait_ns += now - wait->begin;
+      write_ready(wait->fd);
+   }
+
+   list_del(&wait->head);
+   vtest_free_sync_wait(wait);
+}
+
 static void vtest_signal_sync(struct vtest_sync *sync, uint64_t value)
 {
-   struct vtest_context *ctx;
-   uint64_t now;
+   struct list_head *pos;
+   uint64_t now = 0;
 
    if (sync->value >= value) {
       sync->value = value;
@@ -1698,41 +2165,49 @@ static void vtest_signal_sync(struct vtest_sync *sync, uint64_t value)
    }
    sync->value = value;
 
-   now = vtest_gettime(0);
+   /* completing a wait removes all of its waiters, so always restart from
+    * the head of the list
+    */
+   while (!list_is_empty(&sync->waiters)) {
+      struct vtest_sync_waiter *waiter =
+         LIST_ENTRY(struct vtest_sync_waiter, sync->waiters.next, head);
+      struct vtest_sync_wait *wait = waiter->wait;
 
-   LIST_FOR_EACH_ENTRY(ctx, &renderer.active_contexts, head) {
-      struct vtest_sync_wait *wait, *tmp;
-      LIST_FOR_EACH_ENTRY_SAFE(wait, tmp, &ctx->sync_waits, head) {
-         bool is_ready = false;
-         uint32_t i;
-
-         /* garbage collect */
-         if (wait->valid_before < now) {
-            list_del(&wait->head);
-            vtest_free_sync_wait(wait);
-            continue;
-         }
+      if (waiter->value > value)
+         break;
 
-         for (i = 0; i < wait->count; i++) {
-            if (wait->syncs[i] != sync || wait->values[i] > value)
-               continue;
+      list_del(&waiter->head);
+      waiter->sync = NULL;
+      vtest_unref_sync(sync);
 
-            vtest_unref_sync(wait->syncs[i]);
-            wait->syncs[i] = NULL;
+      wait->signaled_count++;
+      if (wait->signaled_count == wait->count ||
+          (wait->flags & VCMD_SYNC_WAIT_FLAG_ANY)) {
+         if (!now)
+            now = vtest_gettime(0);
+         vtest_complete_sync_wait(wait, now);
+      }
+   }
 
-            wait->signaled_count++;
-            if (wait->signaled_count == wait->count ||
-                (wait->flags & VCMD_SYNC_WAIT_FLAG_ANY)) {
-               is_ready = true;
-               break;
-            }
-         }
+   if (list_is_empty(&sync->waiters))
+      return;
 
-         if (is_ready) {
-            list_del(&wait->head);
-            write_ready(wait->fd);
-            vtest_free_sync_wait(wait);
-         }
+   /* expired waits of the remaining waiters still hold references to the
+    * sync; collecting a context frees all of its expired waits, so restart
+    * from the head afterwards
+    */
+   if (!now)
+      now = vtest_gettime(0);
+   pos = sync->waiters.next;
+   while (pos != &sync->waiters) {
+      struct vtest_sync_wait *wait =
+         LIST_ENTRY(struct vtest_sync_waiter, pos, head)->wait;
+
+      if (wait->valid_before < now) {
+         vtest_collect_sync_waits(wait->ctx, now);
+         pos = sync->waiters.next;
+      } else {
+         pos = pos->next;
       }
    }
 }
@@ -1900,6 +2375,7 @@ static int vtest_sync_wait_init(struct vtest_sync_wait *wait,
    if (wait->fd < 0)
       return -ENODEV;
 
+   wait->ctx = ctx;
    wait->flags = flags;
    wait->valid_before = vtest_gettime(timeout);
 
@@ -1918,8 +2394,12 @@ static int vtest_sync_wait_init(struct vtest_sync_wait *wait,
 
       /* skip signaled */
       if (sync->value < value) {
-         wait->syncs[wait->count] = vtest_ref_sync(sync);
-         wait->values[wait->count] = value;
+         struct vtest_sync_waiter *waiter = &wait->waiters[wait->count];
+
+         list_inithead(&waiter->head);
+         waiter->wait = wait;
+         waiter->sync = vtest_ref_sync(sync);
+         waiter->value = value;
          wait->count++;
       }
    }
@@ -1932,6 +2412,51 @@ static int vtest_sync_wait_init(struct vtest_sync_wait *wait,
    return 0;
 }
 
+/* free the waits of the context that the client has given up on */
+static void vtest_collect_sync_waits(struct vtest_context *ctx, uint64_t now)
+{
+   while (!list_is_empty(&ctx->sync_waits)) {
+      struct vtest_sync_wait *wait =
+         LIST_ENTRY(struct vtest_sync_wait, ctx->sync_waits.next, head);
+
+      if (wait->valid_before >= now)
+         break;
+
+      list_del(&wait->head);
+      vtest_free_sync_wait(wait);
+   }
+}
+
+static void vtest_queue_sync_wait(struct vtest_context *ctx,
+                                  struct vtest_sync_wait *wait)
+{
+   struct list_head *pos;
+   uint32_t i;
+
+   vtest_collect_sync_waits(ctx, wait->begin);
+
+   /* timeouts mostly match, so the position is usually at the tail */
+   pos = ctx->sync_waits.prev;
+   while (pos != &ctx->sync_waits &&
+          LIST_ENTRY(struct vtest_sync_wait, pos, head)->valid_before >
+          wait->valid_before)
+      pos = pos->prev;
+   list_add(&wait->head, pos);
+
+   for (i = 0; i < wait->count; i++) {
+      struct vtest_sync_waiter *waiter = &wait->waiters[i];
+      struct vtest_sync *sync = waiter->sync;
+
+      /* values mostly increase, so the position is usually at the tail */
+      pos = sync->waiters.prev;
+      while (pos != &sync->waiters &&
+             LIST_ENTRY(struct vtest_sync_waiter, pos, head)->value >
+             waiter->value)
+         pos = pos->prev;
+      list_add(&waiter->head, pos);
+   }
+}
+
 int vtest_sync_wait(uint32_t length_dw)
 {
    struct vtest_context *ctx = vtest_get_current_context();
@@ -1964,15 +2489,13 @@ int vtest_sync_wait(uint32_t length_dw)
    flags = sync_wait_buf[VCMD_SYNC_WAIT_FLAGS];
    timeout = sync_wait_buf[VCMD_SYNC_WAIT_TIMEOUT];
 
-   wait = malloc(sizeof(*wait) +
-                 sizeof(*wait->syncs) * sync_count +
-                 sizeof(*wait->values) * sync_count);
+   wait = malloc(sizeof(*wait) + sizeof(*wait->waiters) * sync_count);
    if (!wait) {
       free(sync_wait_buf);
       return -ENOMEM;
    }
-   wait->syncs = (void *)&wait[1];
-   wait->values = (void *)&wait->syncs[sync_count];
+   wait->waiters = (void *)&wait[1];
+   wait->begin = vtest_gettime(0);
 
    ret = vtest_sync_wait_init(wait, ctx, flags, timeout,
          sync_wait_buf + 2, sync_count);
@@ -1986,6 +2509,7 @@ int vtest_sync_wait(uint32_t length_dw)
       is_ready = true;
 
    if (is_ready) {
+      ctx->stats.sync_wait_count++;
       write_ready(wait->fd);
    }
 
@@ -1998,7 +2522,7 @@ int vtest_sync_wait(uint32_t length_dw)
    if (ret || is_ready || !timeout)
       vtest_free_sync_wait(wait);
    else
-      list_addtail(&wait->head, &ctx->sync_waits);
+      vtest_queue_sync_wait(ctx, wait);
 
    return ret;
 }
@@ -2009,10 +2533,15 @@ static int vtest_submit_cmd2_batch(struct vtest_context *ctx,
                                    const uint32_t *syncs)
 {
    struct vtest_timeline_submit *submit = NULL;
+   uint64_t begin;
    uint32_t i;
    int ret;
 
+   begin = vtest_trace_now();
    ret = virgl_renderer_submit_cmd((void *)cmds, ctx->ctx_id, batch->cmd_size);
+   ctx->stats.submit_ns += vtest_trace_now() - begin;
+   ctx->stats.submit_count++;
+   ctx->stats.submit_bytes += batch->cmd_size * 4;
    if (ret)
       return -EINVAL;
 
@@ -2088,19 +2617,19 @@ int vtest_submit_cmd2(uint32_t length_dw)
    if (length_dw > renderer.max_length / 4)
       return -EINVAL;
 
-   submit_cmd2_buf = malloc(length_dw * 4);
+   submit_cmd2_buf = vtest_context_get_cmd_buf(ctx, length_dw * 4);
    if (!submit_cmd2_buf)
       return -ENOMEM;
 
    ret = ctx->input->read(ctx->input, submit_cmd2_buf, length_dw * 4);
    if (ret != (int)length_dw * 4) {
-      free(submit_cmd2_buf);
+      vtest_context_put_cmd_buf(ctx);
       return -1;
    }
 
    batch_count = submit_cmd2_buf[VCMD_SUBMIT_CMD2_BATCH_COUNT];
    if (VCMD_SUBMIT_CMD2_BATCH_COUNT + 6 * batch_count > length_dw) {
-      free(submit_cmd2_buf);
+      vtest_context_put_cmd_buf(ctx);
       return -EINVAL;
    }
 
@@ -2119,18 +2648,233 @@ int vtest_submit_cmd2(uint32_t length_dw)
       if (batch.cmd_offset + batch.cmd_size > length_dw ||
           batch.sync_offset + batch.sync_count * 3 > length_dw ||
           batch.ring_idx >= VTEST_MAX_TIMELINE_COUNT) {
-         free(submit_cmd2_buf);
+         vtest_context_put_cmd_buf(ctx);
          return -EINVAL;
       }
 
       ret = vtest_submit_cmd2_batch(ctx, &batch, cmds, syncs);
       if (ret) {
-         free(submit_cmd2_buf);
+         vtest_context_put_cmd_buf(ctx);
          return ret;
       }
    }
 
-   free(submit_cmd2_buf);
+   vtest_context_put_cmd_buf(ctx);
+
+   return 0;
+}
+
+int vtest_transfer_shm_create(UNUSED uint32_t length_dw)
+{
+   struct vtest_context *ctx = vtest_get_current_context();
+   uint32_t create_buf[VCMD_TRANSFER_SHM_CREATE_SIZE];
+   uint32_t resp_buf[VTEST_HDR_SIZE];
+   uint32_t size;
+   void *ptr;
+   int fd;
+   int ret;
+
+   ret = ctx->input->read(ctx->input, create_buf, sizeof(create_buf));
+   if (ret != sizeof(create_buf))
+      return -1;
+
+   size = create_buf[VCMD_TRANSFER_SHM_CREATE_DATA_SIZE];
+   if (!size || size > renderer.max_length)
+      return -EINVAL;
+
+   fd = vtest_new_shm(ctx->ctx_id, size);
+   if (fd < 0)
+      return report_failed_call("vtest_new_shm", fd);
+
+#ifdef F_ADD_SEALS
+   /* the client must not be able to make our mapping fault */
+   if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL) < 0) {
+      close(fd);
+      return report_failed_call("fcntl", -errno);
+   }
+#endif
+
+   ptr = mmap(NULL, size, PROT_WRITE | PROT_READ, MAP_SHARED, fd, 0);
+   if (ptr == MAP_FAILED) {
+      close(fd);
+      return -ENOMEM;
+   }
+
+   if (ctx->transfer_shm.iov_base)
+      munmap(ctx->transfer_shm.iov_base, ctx->transfer_shm.iov_len);
+   ctx->transfer_shm.iov_base = ptr;
+   ctx->transfer_shm.iov_len = size;
+
+   resp_buf[VTEST_CMD_LEN] = 0;
+   resp_buf[VTEST_CMD_ID] = VCMD_TRANSFER_SHM_CREATE;
+   ret = vtest_block_write(ctx->out_fd, resp_buf, sizeof(resp_buf));
+   if (ret >= 0)
+      ret = vtest_send_fd(ctx->out_fd, fd);
+
+   close(fd);
+
+   return ret < 0 ? ret : 0;
+}
+
+static int vtest_transfer_shm_decode_args(struct vtest_context *ctx,
+                                          struct vtest_transfer_args *args,
+                                          struct iovec *data_iov)
+{
+   uint32_t thdr_buf[VCMD_TRANSFER_SHM_SIZE];
+   uint32_t data_size;
+   uint32_t data_offset;
+   int ret;
+
+   ret = ctx->input->read(ctx->input, thdr_buf, sizeof(thdr_buf));
+   if (ret != sizeof(thdr_buf))
+      return -1;
+
+   args->handle = thdr_buf[VCMD_TRANSFER_SHM_RES_HANDLE];
+   args->level = thdr_buf[VCMD_TRANSFER_SHM_LEVEL];
+   args->stride = thdr_buf[VCMD_TRANSFER_SHM_STRIDE];
+   args->layer_stride = thdr_buf[VCMD_TRANSFER_SHM_LAYER_STRIDE];
+   args->box.x = thdr_buf[VCMD_TRANSFER_SHM_X];
+   args->box.y = thdr_buf[VCMD_TRANSFER_SHM_Y];
+   args->box.z = thdr_buf[VCMD_TRANSFER_SHM_Z];
+   args->box.w = thdr_buf[VCMD_TRANSFER_SHM_WIDTH];
+   args->box.h = thdr_buf[VCMD_TRANSFER_SHM_HEIGHT];
+   args->box.d = thdr_buf[VCMD_TRANSFER_SHM_DEPTH];
+   args->offset = 0;
+
+   data_size = thdr_buf[VCMD_TRANSFER_SHM_DATA_SIZE];
+   data_offset = thdr_buf[VCMD_TRANSFER_SHM_DATA_OFFSET];
+
+   if (!ctx->transfer_shm.iov_base)
+      return report_failure("no transfer shm", -EINVAL);
+   if (data_offset > ctx->transfer_shm.iov_len ||
+       data_size > ctx->transfer_shm.iov_len - data_offset)
+      return report_failure("data outside of transfer shm", -EFAULT);
+
+   data_iov->iov_base = (char *)ctx->transfer_shm.iov_base + data_offset;
+   data_iov->iov_len = data_size;
+
+   return 0;
+}
+
+int vtest_transfer_shm_get(UNUSED uint32_t length_dw)
+{
+   struct vtest_context *ctx = vtest_get_current_context();
+   uint32_t resp_buf[VTEST_HDR_SIZE + 1];
+   struct vtest_transfer_args args;
+   struct vtest_resource *res;
+   struct iovec data_iov;
+   uint64_t begin;
+   int ret;
+
+   ret = vtest_transfer_shm_decode_args(ctx, &args, &data_iov);
+   if (ret < 0)
+      return ret;
+
+   res = util_hash_table_get(ctx->resource_table,
+                             intptr_to_pointer(args.handle));
+   if (!res)
+      return report_failed_call("util_hash_table_get", -ESRCH);
+
+   begin = vtest_trace_now();
+   ret = virgl_renderer_transfer_read_iov(res->res_id,
+                                          ctx->ctx_id,
+                                          args.level,
+                                          args.stride,
+                                          args.layer_stride,
+                                          &args.box,
+                                          args.offset,
+                                          &data_iov,
+                                          1);
+   if (ret)
+      report_failed_call("virgl_renderer_transfer_read_iov", ret);
+
+   ctx->stats.transfer_ns += vtest_trace_now() - begin;
+   ctx->stats.transfer_get_count++;
+   ctx->stats.transfer_get_bytes += data_iov.iov_len;
+
+   resp_buf[VTEST_CMD_LEN] = 1;
+   resp_buf[VTEST_CMD_ID] = VCMD_TRANSFER_SHM_GET;
+   resp_buf[VTEST_CMD_DATA_START] = ret ? 1 : 0;
+
+   ret = vtest_block_write(ctx->out_fd, resp_buf, sizeof(resp_buf));
+   return ret < 0 ? ret : 0;
+}
+
+int vtest_transfer_shm_put(UNUSED uint32_t length_dw)
+{
+   struct vtest_context *ctx = vtest_get_current_context();
+   struct vtest_transfer_args args;
+   struct vtest_resource *res;
+   struct iovec data_iov;
+   uint64_t begin;
+   int ret;
+
+   ret = vtest_transfer_shm_decode_args(ctx, &args, &data_iov);
+   if (ret < 0)
+      return ret;
+
+   res = util_hash_table_get(ctx->resource_table,
+                             intptr_to_pointer(args.handle));
+   if (!res)
+      return report_failed_call("util_hash_table_get", -ESRCH);
+
+   vtest_trace_shm(ctx, 0,
+                   (char *)data_iov.iov_base - (char *)ctx->transfer_shm.iov_base,
+                   data_iov.iov_base, data_iov.iov_len);
+
+   begin = vtest_trace_now();
+   ret = virgl_renderer_transfer_write_iov(res->res_id,
+                                           ctx->ctx_id,
+                                           args.level,
+                                           args.stride,
+                                           args.layer_stride,
+                                           &args.box,
+                                           args.offset,
+                                           &data_iov,
+                                           1);
+   if (ret)
+      report_failed_call("virgl_renderer_transfer_write_iov", ret);
+
+   ctx->stats.transfer_ns += vtest_trace_now() - begin;
+   ctx->stats.transfer_put_count++;
+   ctx->stats.transfer_put_bytes += data_iov.iov_len;
+
+   return ret;
+}
+
+uint32_t vtest_get_context_id(struct vtest_context *ctx)
+{
+   return ctx->ctx_id;
+}
+
+const struct vtest_context_stats *
+vtest_get_context_stats(struct vtest_context *ctx)
+{
+   return &ctx->stats;
+}
+
+int vtest_replay_shm(struct vtest_context *ctx,
+                     uint32_t res_handle,
+                     uint64_t offset,
+                     const void *data,
+                     size_t size)
+{
+   const struct iovec *iov;
+
+   if (res_handle) {
+      struct vtest_resource *res =
+         util_hash_table_get(ctx->resource_table, intptr_to_pointer(res_handle));
+      if (!res)
+         return report_failed_call("util_hash_table_get", -ESRCH);
+      iov = &res->iov;
+   } else {
+      iov = &ctx->transfer_shm;
+   }
+
+   if (!iov->iov_base || offset > iov->iov_len || size > iov->iov_len - offset)
+      return report_failure("shm data out of range", -EFAULT);
+
+   memcpy((char *)iov->iov_base + offset, data, size);
 
    return 0;
 }
@@ -38,6 +38,10 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <pthread.h>
+#include <inttypes.h>
 
 #include "util.h"
 #include "util/u_double_list.h"
@@ -45,10 +49,11 @@
 #include "util/u_memory.h"
 #include "vtest.h"
 #include "vtest_protocol.h"
+#include "vtest_trace.h"
 #include "virglrenderer.h"
-#ifdef HAVE_SYS_SELECT_H
-#include <sys/select.h>
-#endif
+
+/* large enough for the headers and payloads of many pipelined commands */
+#define VTEST_CLIENT_READ_BUFFER_SIZE (64 * 1024)
 
 enum vtest_client_error {
    VTEST_CLIENT_ERROR_INPUT_READ = 2, /* for backward compatibility */
@@ -57,20 +62,94 @@ enum vtest_client_error {
    VTEST_CLIENT_ERROR_COMMAND_ID,
    VTEST_CLIENT_ERROR_COMMAND_UNEXPECTED,
    VTEST_CLIENT_ERROR_COMMAND_DISPATCH,
+   VTEST_CLIENT_ERROR_THREAD_CREATE,
+};
+
+enum vtest_event_type {
+   VTEST_EVENT_SOCKET,
+   VTEST_EVENT_CLIENT_INPUT,
+   VTEST_EVENT_CONTEXT_POLL,
+   VTEST_EVENT_THREAD_EXIT,
+};
+
+/* what an epoll event is for */
+struct vtest_event_source {
+   enum vtest_event_type type;
+   struct vtest_client *client;
+};
+
+/* the highest command id counted in vtest_client_stats */
+#define VTEST_STATS_MAX_COMMAND_ID VCMD_TRANSFER_SHM_PUT
+
+/* what a client has spent its time on; the renderer keeps the rest in
+ * vtest_context_stats
+ */
+struct vtest_client_stats
+{
+   uint64_t begin;
+
+   uint64_t command_counts[VTEST_STATS_MAX_COMMAND_ID + 1];
+   /* from after the header is read until the command is dispatched */
+   uint64_t command_ns[VTEST_STATS_MAX_COMMAND_ID + 1];
+
+   uint64_t read_bytes;
+   uint64_t read_ns;
 };
 
 struct vtest_client
 {
    int in_fd;
    int out_fd;
+   struct vtest_read_buffer in_buffer;
    struct vtest_input input;
 
    struct list_head head;
 
+   struct vtest_event_source in_source;
+   /* in_fd cannot be watched by epoll (e.g., a regular file) and is always
+    * ready */
+   bool in_fd_always_ready;
    bool in_fd_ready;
+   /* the peer has hung up; a hangup carries no bytes for FIONREAD to see, so
+    * the client stays ready until a read returns EOF
+    */
+   bool in_fd_hangup;
+
    struct vtest_context *context;
+   struct vtest_event_source context_source;
    int context_poll_fd;
    bool context_need_poll;
+
+   /* on vtest_server::ready_clients while in_fd_ready or context_need_poll */
+   struct list_head ready_head;
+   /* on vtest_server::poll_clients while the context has no poll fd */
+   struct list_head poll_head;
+
+   /* in threaded mode, the client is served by its own thread until
+    * thread_done is set with the renderer lock held
+    */
+   pthread_t thread;
+   bool thread_started;
+   bool thread_done;
+   int thread_err;
+
+   /* the input of the current command while tracing */
+   char *trace_data;
+   size_t trace_size;
+   size_t trace_capacity;
+
+   /* when replaying, the input is the payload of a command record */
+   struct vtest_buffer replay_buffer;
+   uint32_t replay_id;
+
+   struct vtest_client_stats stats;
+};
+
+/* a pre-forked process with the renderer initialized, waiting for a client */
+struct vtest_worker
+{
+   int channel;
+   struct list_head head;
 };
 
 struct vtest_server
@@ -85,6 +164,8 @@ struct vtest_server
    bool do_fork;
    bool loop;
    bool multi_clients;
+   bool threads;
+   int prefork_count;
 
    bool use_glx;
    bool use_egl_surfaceless;
@@ -99,11 +180,48 @@ struct vtest_server
    struct list_head new_clients;
    struct list_head active_clients;
    struct list_head inactive_clients;
+
+   /* Active clients' in_fds are watched edge-triggered.  A client stays on
+    * ready_clients until its input is drained, one command per iteration
+    * such that busy clients cannot starve the others.
+    */
+   int epoll_fd;
+   struct vtest_event_source socket_source;
+   bool socket_watched;
+   bool socket_armed;
+   struct list_head ready_clients;
+   /* clients whose contexts are polled on every wakeup */
+   struct list_head poll_clients;
+
+   /* In threaded mode, the main thread only accepts clients, polls their
+    * contexts, and reaps the client threads.  Exiting client threads write to
+    * thread_exit_fds[1] to wake it up.
+    */
+   int thread_exit_fds[2];
+   struct vtest_event_source thread_exit_source;
+
+   /* In fork mode with --prefork, new clients are handed to idle workers
+    * over their channels with SCM_RIGHTS instead of to freshly forked
+    * children that still have to initialize the renderer.
+    */
+   struct list_head idle_workers;
+   int idle_worker_count;
+   bool renderer_initialized;
+
+   const char *replay_file;
+   int replay_loops;
+
+   /* client stats are appended to it as JSON lines */
+   const char *stats_file;
 };
 
 struct vtest_server server = {
    .socket_name = VTEST_DEFAULT_SOCKET_NAME,
    .socket = -1,
+   .epoll_fd = -1,
+   .socket_source = { .type = VTEST_EVENT_SOCKET },
+   .thread_exit_fds = { -1, -1 },
+   .thread_exit_source = { .type = VTEST_EVENT_THREAD_EXIT },
 
    .read_file = NULL,
 
@@ -115,6 +233,8 @@ struct vtest_server server = {
    .multi_clients = false,
 
    .ctx_flags = 0,
+
+   .replay_loops = 1,
 };
 
 static void vtest_server_getenv(void);
@@ -126,6 +246,7 @@ static void vtest_server_open_socket(void);
 static void vtest_server_run(void);
 static void vtest_server_close_socket(void);
 static int vtest_client_dispatch_commands(struct vtest_client *client);
+static void vtest_server_replay(void);
 
 
 int main(int argc, char **argv)
@@ -140,6 +261,9 @@ while (__AFL_LOOP(1000)) {
    list_inithead(&server.new_clients);
    list_inithead(&server.active_clients);
    list_inithead(&server.inactive_clients);
+   list_inithead(&server.ready_clients);
+   list_inithead(&server.poll_clients);
+   list_inithead(&server.idle_workers);
 
    if (server.do_fork) {
       vtest_server_set_signal_child();
@@ -147,7 +271,11 @@ while (__AFL_LOOP(1000)) {
       vtest_server_set_signal_segv();
    }
 
-   vtest_server_run();
+   if (server.replay_file) {
+      vtest_server_replay();
+   } else {
+      vtest_server_run();
+   }
 
 #ifdef __AFL_LOOP
    if (!server.main_server) {
@@ -168,6 +296,13 @@ while (__AFL_LOOP(1000)) {
 #define OPT_RENDER_SERVER 'n'
 #define OPT_SOCKET_PATH 'p'
 #define OPT_NO_VIRGL 'g'
+#define OPT_THREADS 't'
+#define OPT_PREFORK 'k'
+#define OPT_REPLAY 'y'
+#define OPT_REPLAY_LOOPS 'o'
+
+/* keep a sane number of idle renderer processes around */
+#define VTEST_MAX_PREFORK_COUNT 64
 
 static void vtest_server_parse_args(int argc, char **argv)
 {
@@ -184,6 +319,10 @@ static void vtest_server_parse_args(int argc, char **argv)
       {"venus",               no_argument, NULL, OPT_VENUS},
       {"socket-path",         optional_argument, NULL, OPT_SOCKET_PATH},
       {"no-virgl",            no_argument, NULL, OPT_NO_VIRGL},
+      {"threads",             no_argument, NULL, OPT_THREADS},
+      {"prefork",             required_argument, NULL, OPT_PREFORK},
+      {"replay",              required_argument, NULL, OPT_REPLAY},
+      {"replay-loops",        required_argument, NULL, OPT_REPLAY_LOOPS},
       {0, 0, 0, 0}
    };
 
@@ -222,6 +361,18 @@ static void vtest_server_parse_args(int argc, char **argv)
       case OPT_NO_VIRGL:
          server.no_virgl = true;
          break;
+      case OPT_THREADS:
+         server.threads = true;
+         break;
+      case OPT_PREFORK:
+         server.prefork_count = CLAMP(atoi(optarg), 0, VTEST_MAX_PREFORK_COUNT);
+         break;
+      case OPT_REPLAY:
+         server.replay_file = optarg;
+         break;
+      case OPT_REPLAY_LOOPS:
+         server.replay_loops = MAX2(atoi(optarg), 1);
+         break;
 #ifdef ENABLE_VENUS
       case OPT_VENUS:
          server.venus = true;
@@ -233,7 +384,8 @@ static void vtest_server_parse_args(int argc, char **argv)
       default:
          printf("Usage: %s [--no-fork] [--no-loop-or-fork] [--multi-clients] "
                 "[--use-glx] [--use-egl-surfaceless] [--use-gles] [--no-virgl]"
-                "[--rendernode <dev>] [--socket-path <path>] "
+                "[--rendernode <dev>] [--socket-path <path>] [--threads] "
+                "[--prefork <count>] [--replay <trace> [--replay-loops <count>]] "
 #ifdef ENABLE_VENUS
                 " [--venus]"
 #endif
@@ -249,6 +401,39 @@ static void vtest_server_parse_args(int argc, char **argv)
       server.loop = false;
       server.do_fork = false;
       server.multi_clients = false;
+      server.threads = false;
+      server.prefork_count = 0;
+   }
+
+   if (server.threads && (server.do_fork || !server.multi_clients)) {
+      fprintf(stderr, "--threads requires --multi-clients and --no-fork.\n");
+      exit(EXIT_FAILURE);
+   }
+
+   /* GL contexts are current to one thread and vrend tracks the current
+    * context globally, so only proxied venus contexts can move between
+    * threads.  Their commands are decoded and executed by the render server,
+    * and a venus client blocked on a socket, a transfer, or a busy wait no
+    * longer stalls the other clients.
+    */
+   if (server.threads && (!server.no_virgl || !server.venus)) {
+      fprintf(stderr, "--threads requires --no-virgl and --venus.\n");
+      exit(EXIT_FAILURE);
+   }
+
+   if (server.replay_file) {
+      if (server.read_file || server.multi_clients || server.threads ||
+          server.prefork_count) {
+         fprintf(stderr, "--replay cannot be combined with other modes.\n");
+         exit(EXIT_FAILURE);
+      }
+      server.do_fork = false;
+      server.loop = false;
+   }
+
+   if (server.prefork_count && !server.do_fork) {
+      fprintf(stderr, "--prefork cannot be used without forking.\n");
+      exit(EXIT_FAILURE);
    }
 
    if (!server.no_virgl) {
@@ -281,6 +466,7 @@ static void vtest_server_getenv(void)
    server.use_egl_surfaceless = getenv("VTEST_USE_EGL_SURFACELESS") != NULL;
    server.use_gles = getenv("VTEST_USE_GLES") != NULL;
    server.render_device = getenv("VTEST_RENDERNODE");
+   server.stats_file = getenv("VTEST_STATS");
 }
 
 static void handler(int sig, siginfo_t *si, void *unused)
@@ -325,6 +511,147 @@ static void vtest_server_set_signal_segv(void)
    }
 }
 
+static void vtest_client_trace_input(struct vtest_client *client,
+                                     const void *buf,
+                                     size_t size)
+{
+   if (client->trace_size + size > client->trace_capacity) {
+      size_t capacity = MAX2(client->trace_capacity * 2, 4096);
+      char *data;
+
+      while (capacity < client->trace_size + size)
+         capacity *= 2;
+
+      data = realloc(client->trace_data, capacity);
+      if (!data) {
+         fprintf(stderr, "failed to trace client input\n");
+         return;
+      }
+
+      client->trace_data = data;
+      client->trace_capacity = capacity;
+   }
+
+   memcpy(client->trace_data + client->trace_size, buf, size);
+   client->trace_size += size;
+}
+
+static int vtest_client_read(struct vtest_input *input, void *buf, int size)
+{
+   struct vtest_client *client = LIST_ENTRY(struct vtest_client, input, input);
+   uint64_t begin = vtest_trace_now();
+   int ret;
+
+   ret = vtest_buffered_read(input, buf, size);
+   if (ret > 0 && vtest_trace_is_enabled()) {
+      vtest_client_trace_input(client, buf, ret);
+   }
+
+   client->stats.read_ns += vtest_trace_now() - begin;
+   if (ret > 0)
+      client->stats.read_bytes += ret;
+
+   return ret;
+}
+
+static void vtest_client_trace_command(struct vtest_client *client)
+{
+   if (client->trace_size && vtest_trace_is_enabled()) {
+      vtest_trace_write(VTEST_TRACE_RECORD_COMMAND,
+                        vtest_get_context_id(client->context),
+                        NULL, 0, client->trace_data, client->trace_size);
+   }
+
+   client->trace_size = 0;
+}
+
+static void vtest_client_count_command(struct vtest_client *client,
+                                       uint32_t cmd_id,
+                                       uint64_t begin)
+{
+   if (cmd_id > VTEST_STATS_MAX_COMMAND_ID)
+      return;
+
+   client->stats.command_counts[cmd_id]++;
+   client->stats.command_ns[cmd_id] += vtest_trace_now() - begin;
+}
+
+static void vtest_server_report_client_stats(struct vtest_client *client)
+{
+   const struct vtest_context_stats *ctx_stats;
+   const struct vtest_client_stats *stats = &client->stats;
+   const char *sep = "";
+   char *line = NULL;
+   size_t line_size = 0;
+   FILE *fp;
+   int fd;
+   int i;
+
+   if (!server.stats_file)
+      return;
+
+   fp = open_memstream(&line, &line_size);
+   if (!fp)
+      return;
+
+   ctx_stats = vtest_get_context_stats(client->context);
+
+   fprintf(fp, "{\"pid\": %d, \"ctx_id\": %u, \"duration_ns\": %" PRIu64,
+           (int)getpid(), vtest_get_context_id(client->context),
+           vtest_trace_now() - stats->begin);
+
+   fprintf(fp, ", \"commands\": {");
+   for (i = 0; i <= VTEST_STATS_MAX_COMMAND_ID; i++) {
+      if (!stats->command_counts[i])
+         continue;
+      fprintf(fp, "%s\"%d\": {\"count\": %" PRIu64 ", \"ns\": %" PRIu64 "}",
+              sep, i, stats->command_counts[i], stats->command_ns[i]);
+      sep = ", ";
+   }
+   fprintf(fp, "}");
+
+   fprintf(fp, ", \"read_bytes\": %" PRIu64 ", \"read_ns\": %" PRIu64,
+           stats->read_bytes, stats->read_ns);
+   fprintf(fp, ", \"write_bytes\": %" PRIu64 ", \"write_ns\": %" PRIu64,
+           ctx_stats->write_bytes, ctx_stats->write_ns);
+   fprintf(fp, ", \"submit_count\": %" PRIu64 ", \"submit_bytes\": %" PRIu64
+           ", \"submit_ns\": %" PRIu64,
+           ctx_stats->submit_count, ctx_stats->submit_bytes,
+           ctx_stats->submit_ns);
+   fprintf(fp, ", \"transfer_get_count\": %" PRIu64
+           ", \"transfer_get_bytes\": %" PRIu64
+           ", \"transfer_put_count\": %" PRIu64
+           ", \"transfer_put_bytes\": %" PRIu64
+           ", \"transfer_ns\": %" PRIu64,
+           ctx_stats->transfer_get_count, ctx_stats->transfer_get_bytes,
+           ctx_stats->transfer_put_count, ctx_stats->transfer_put_bytes,
+           ctx_stats->transfer_ns);
+   fprintf(fp, ", \"busy_wait_ns\": %" PRIu64
+           ", \"sync_wait_count\": %" PRIu64 ", \"sync_wait_ns\": %" PRIu64
+           "}\n",
+           ctx_stats->busy_wait_ns, ctx_stats->sync_wait_count,
+           ctx_stats->sync_wait_ns);
+
+   if (fclose(fp)) {
+      free(line);
+      return;
+   }
+
+   /* forked servers append to the same file; a single write keeps the lines
+    * intact
+    */
+   fd = open(server.stats_file, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+   if (fd < 0) {
+      perror("Failed to open stats file");
+   } else {
+      if (write(fd, line, line_size) != (ssize_t)line_size)
+         perror("Failed to write stats");
+      close(fd);
+   }
+
+   free(line);
+}
+
 static int vtest_server_add_client(int in_fd, int out_fd)
 {
    struct vtest_client *client;
@@ -335,12 +662,27 @@ static int vtest_server_add_client(int in_fd, int out_fd)
 
    client->in_fd = in_fd;
    client->out_fd = out_fd;
+   client->stats.begin = vtest_trace_now();
+
+   if (vtest_init_read_buffer(&client->in_buffer, in_fd,
+                              VTEST_CLIENT_READ_BUFFER_SIZE)) {
+      free(client);
+      return -1;
+   }
 
-   client->input.data.fd = in_fd;
-   client->input.read = vtest_block_read;
+   client->input.data.read_buffer = &client->in_buffer;
+   client->input.read = vtest_client_read;
 
+   client->in_source.type = VTEST_EVENT_CLIENT_INPUT;
+   client->in_source.client = client;
+
+   client->context_source.type = VTEST_EVENT_CONTEXT_POLL;
+   client->context_source.client = client;
    client->context_poll_fd = -1;
 
+   list_inithead(&client->ready_head);
+   list_inithead(&client->poll_head);
+
    list_addtail(&client->head, &server.new_clients);
 
    return 0;
@@ -400,72 +742,233 @@ err:
    exit(1);
 }
 
-static void vtest_server_wait_clients(void)
+static void vtest_server_init_epoll(void)
 {
-   struct vtest_client *client;
-   fd_set read_fds;
-   int max_fd = -1;
-   int ret;
+   server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+   if (server.epoll_fd < 0) {
+      perror("Failed to create epoll fd");
+      exit(1);
+   }
 
-   FD_ZERO(&read_fds);
+   server.socket_watched = false;
+   server.socket_armed = false;
+}
 
-   LIST_FOR_EACH_ENTRY(client, &server.active_clients, head) {
-      FD_SET(client->in_fd, &read_fds);
-      max_fd = MAX2(client->in_fd, max_fd);
+static void vtest_server_close_epoll(void)
+{
+   if (server.epoll_fd >= 0) {
+      close(server.epoll_fd);
+      server.epoll_fd = -1;
+   }
+}
+
+static void vtest_server_init_threads(void)
+{
+   struct epoll_event ev = {
+      .events = EPOLLIN,
+      .data.ptr = &server.thread_exit_source,
+   };
+
+   if (pipe2(server.thread_exit_fds, O_CLOEXEC | O_NONBLOCK)) {
+      perror("Failed to create thread exit pipe");
+      exit(1);
+   }
 
-      if (client->context_poll_fd >= 0) {
-         FD_SET(client->context_poll_fd, &read_fds);
-         max_fd = MAX2(client->context_poll_fd, max_fd);
+   if (epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.thread_exit_fds[0], &ev)) {
+      perror("Failed to watch thread exit pipe");
+      exit(1);
+   }
+}
+
+static void vtest_server_fini_threads(void)
+{
+   for (int i = 0; i < 2; i++) {
+      if (server.thread_exit_fds[i] >= 0) {
+         close(server.thread_exit_fds[i]);
+         server.thread_exit_fds[i] = -1;
       }
    }
+}
 
-   /* accept new clients when there is none or when multi_clients is set */
-   if (server.socket >= 0 && (max_fd < 0 || server.multi_clients)) {
-      FD_SET(server.socket, &read_fds);
-      max_fd = MAX2(server.socket, max_fd);
+static void vtest_server_drain_thread_exits(void)
+{
+   char buf[64];
+
+   while (read(server.thread_exit_fds[0], buf, sizeof(buf)) > 0)
+      ;
+}
+
+static void vtest_server_notify_thread_exit(void)
+{
+   const char byte = 0;
+
+   /* a full pipe already guarantees a wakeup */
+   if (write(server.thread_exit_fds[1], &byte, 1) < 0 && errno != EAGAIN)
+      perror("Failed to notify thread exit");
+}
+
+static void vtest_server_arm_socket(bool arm)
+{
+   struct epoll_event ev = {
+      .events = arm ? EPOLLIN : 0,
+      .data.ptr = &server.socket_source,
+   };
+   int op;
+
+   if (server.socket < 0 || server.socket_armed == arm)
+      return;
+
+   op = server.socket_watched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+   if (epoll_ctl(server.epoll_fd, op, server.socket, &ev)) {
+      perror("Failed to watch socket");
+      exit(1);
    }
 
-   if (max_fd < 0) {
-      if (!LIST_IS_EMPTY(&server.new_clients)) {
-         return;
+   server.socket_watched = true;
+   server.socket_armed = arm;
+}
+
+static void vtest_client_queue(struct vtest_client *client)
+{
+   if (list_is_empty(&client->ready_head))
+      list_addtail(&client->ready_head, &server.ready_clients);
+}
+
+static void vtest_server_watch_client(struct vtest_client *client)
+{
+   struct epoll_event ev = {
+      .events = EPOLLIN | EPOLLRDHUP | EPOLLET,
+      .data.ptr = &client->in_source,
+   };
+
+   if (epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, client->in_fd, &ev)) {
+      if (errno != EPERM) {
+         perror("Failed to watch client");
+         exit(1);
       }
 
-      fprintf(stderr, "server has no fd to wait\n");
+      client->in_fd_always_ready = true;
+      client->in_fd_ready = true;
+      vtest_client_queue(client);
+   }
+}
+
+static void vtest_server_watch_context(struct vtest_client *client)
+{
+   struct epoll_event ev = {
+      .events = EPOLLIN,
+      .data.ptr = &client->context_source,
+   };
+
+   if (epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, client->context_poll_fd, &ev)) {
+      perror("Failed to watch context");
       exit(1);
    }
 
-   ret = select(max_fd + 1, &read_fds, NULL, NULL, NULL);
-   if (ret < 0) {
-      perror("Failed to select on socket!");
+   list_delinit(&client->poll_head);
+}
+
+static void vtest_server_unwatch_client(struct vtest_client *client)
+{
+   if (!server.threads && !client->in_fd_always_ready)
+      epoll_ctl(server.epoll_fd, EPOLL_CTL_DEL, client->in_fd, NULL);
+   if (client->context_poll_fd >= 0)
+      epoll_ctl(server.epoll_fd, EPOLL_CTL_DEL, client->context_poll_fd, NULL);
+
+   list_delinit(&client->ready_head);
+   list_delinit(&client->poll_head);
+}
+
+static bool vtest_client_has_pending_input(struct vtest_client *client)
+{
+   int avail;
+
+   if (client->in_fd_always_ready || client->in_fd_hangup)
+      return true;
+
+   /* commands that have been read ahead */
+   if (client->in_buffer.start != client->in_buffer.end)
+      return true;
+
+   return !ioctl(client->in_fd, FIONREAD, &avail) && avail > 0;
+}
+
+static void vtest_server_accept_client(void)
+{
+   int new_fd = accept(server.socket, NULL, NULL);
+   if (new_fd < 0) {
+      perror("Failed to accept socket.");
       exit(1);
    }
 
-   LIST_FOR_EACH_ENTRY(client, &server.active_clients, head) {
-      if (FD_ISSET(client->in_fd, &read_fds)) {
-         client->in_fd_ready = true;
-      }
+   if (vtest_server_add_client(new_fd, new_fd)) {
+      perror("Failed to add client.");
+      exit(1);
+   }
+}
 
-      if (client->context_poll_fd >= 0) {
-         if (FD_ISSET(client->context_poll_fd, &read_fds)) {
-            client->context_need_poll = true;
-         }
-      } else if (client->context) {
-         client->context_need_poll = true;
+static void vtest_server_wait_clients(void)
+{
+   struct vtest_client *client;
+   struct epoll_event events[64];
+   int timeout;
+   int count;
+
+   /* accept new clients when there is none or when multi_clients is set */
+   vtest_server_arm_socket(LIST_IS_EMPTY(&server.active_clients) ||
+                           server.multi_clients);
+
+   if (!server.socket_armed && LIST_IS_EMPTY(&server.active_clients)) {
+      if (!LIST_IS_EMPTY(&server.new_clients)) {
+         return;
       }
+
+      fprintf(stderr, "server has no fd to wait\n");
+      exit(1);
    }
 
-   if (server.socket >= 0 && FD_ISSET(server.socket, &read_fds)) {
-      int new_fd = accept(server.socket, NULL, NULL);
-      if (new_fd < 0) {
-         perror("Failed to accept socket.");
+   /* do not block when some clients still have input or polls pending */
+   timeout = LIST_IS_EMPTY(&server.ready_clients) ? -1 : 0;
+
+   count = epoll_wait(server.epoll_fd, events, ARRAY_SIZE(events), timeout);
+   if (count < 0) {
+      if (errno != EINTR) {
+         perror("Failed to wait on epoll!");
          exit(1);
       }
+      count = 0;
+   }
 
-      if (vtest_server_add_client(new_fd, new_fd)) {
-         perror("Failed to add client.");
-         exit(1);
+   for (int i = 0; i < count; i++) {
+      struct vtest_event_source *source = events[i].data.ptr;
+
+      switch (source->type) {
+      case VTEST_EVENT_SOCKET:
+         vtest_server_accept_client();
+         break;
+      case VTEST_EVENT_CLIENT_INPUT:
+         if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            source->client->in_fd_hangup = true;
+         source->client->in_fd_ready = true;
+         vtest_client_queue(source->client);
+         break;
+      case VTEST_EVENT_CONTEXT_POLL:
+         source->client->context_need_poll = true;
+         vtest_client_queue(source->client);
+         break;
+      case VTEST_EVENT_THREAD_EXIT:
+         vtest_server_drain_thread_exits();
+         break;
       }
    }
+
+   /* client threads add themselves to poll_clients */
+   vtest_lock_renderer();
+   LIST_FOR_EACH_ENTRY(client, &server.poll_clients, poll_head) {
+      client->context_need_poll = true;
+      vtest_client_queue(client);
+   }
+   vtest_unlock_renderer();
 }
 
 static const char *vtest_client_error_string(enum vtest_client_error err)
@@ -478,6 +981,7 @@ static const char *vtest_client_error_string(enum vtest_client_error err)
    CASE(VTEST_CLIENT_ERROR_COMMAND_ID)
    CASE(VTEST_CLIENT_ERROR_COMMAND_UNEXPECTED)
    CASE(VTEST_CLIENT_ERROR_COMMAND_DISPATCH)
+   CASE(VTEST_CLIENT_ERROR_THREAD_CREATE)
 #undef CASE
    default: return "VTEST_CLIENT_ERROR_UNKNOWN";
    }
@@ -487,7 +991,7 @@ static void vtest_server_dispatch_clients(void)
 {
    struct vtest_client *client, *tmp;
 
-   LIST_FOR_EACH_ENTRY_SAFE(client, tmp, &server.active_clients, head) {
+   LIST_FOR_EACH_ENTRY_SAFE(client, tmp, &server.ready_clients, ready_head) {
       int err;
 
       if (client->context_need_poll) {
@@ -495,20 +999,110 @@ static void vtest_server_dispatch_clients(void)
          client->context_need_poll = false;
       }
 
-      if (!client->in_fd_ready)
+      if (client->in_fd_ready) {
+         err = vtest_client_dispatch_commands(client);
+         if (err) {
+            fprintf(stderr, "client failed: %s\n",
+                    vtest_client_error_string(err));
+            vtest_server_unwatch_client(client);
+            list_del(&client->head);
+            list_addtail(&client->head, &server.inactive_clients);
+            continue;
+         }
+
+         /* there will be no new edge for input that is already there */
+         client->in_fd_ready = vtest_client_has_pending_input(client);
+      }
+
+      if (!client->in_fd_ready && !client->context_need_poll)
+         list_delinit(&client->ready_head);
+   }
+}
+
+static void vtest_server_dispatch_threaded_clients(void)
+{
+   struct vtest_client *client, *tmp;
+
+   vtest_lock_renderer();
+
+   LIST_FOR_EACH_ENTRY_SAFE(client, tmp, &server.ready_clients, ready_head) {
+      if (client->context_need_poll) {
+         vtest_poll_context(client->context);
+         client->context_need_poll = false;
+      }
+
+      list_delinit(&client->ready_head);
+   }
+
+   LIST_FOR_EACH_ENTRY_SAFE(client, tmp, &server.active_clients, head) {
+      if (!client->thread_done)
          continue;
-      client->in_fd_ready = false;
 
+      fprintf(stderr, "client failed: %s\n",
+              vtest_client_error_string(client->thread_err));
+      vtest_server_unwatch_client(client);
+      list_del(&client->head);
+      list_addtail(&client->head, &server.inactive_clients);
+   }
+
+   vtest_unlock_renderer();
+}
+
+static void *vtest_client_thread(void *arg)
+{
+   struct vtest_client *client = arg;
+   int err;
+
+   /* the lock is dropped while the client blocks on its socket */
+   vtest_lock_renderer();
+
+   do {
       err = vtest_client_dispatch_commands(client);
-      if (err) {
-         fprintf(stderr, "client failed: %s\n",
-                 vtest_client_error_string(err));
-         list_del(&client->head);
-         list_addtail(&client->head, &server.inactive_clients);
+   } while (!err);
+
+   client->thread_err = err;
+   client->thread_done = true;
+
+   vtest_unlock_renderer();
+
+   vtest_server_notify_thread_exit();
+
+   return NULL;
+}
+
+static void vtest_server_start_client_threads(void)
+{
+   struct vtest_client *client;
+
+   LIST_FOR_EACH_ENTRY(client, &server.active_clients, head) {
+      if (client->thread_started || client->thread_done)
+         continue;
+
+      if (pthread_create(&client->thread, NULL, vtest_client_thread, client)) {
+         /* reaped by vtest_server_dispatch_threaded_clients */
+         client->thread_err = VTEST_CLIENT_ERROR_THREAD_CREATE;
+         client->thread_done = true;
+         vtest_server_notify_thread_exit();
+         continue;
       }
+
+      client->thread_started = true;
    }
 }
 
+static void vtest_server_close_workers(void)
+{
+   struct vtest_worker *worker, *tmp;
+
+   /* idle workers exit when their channels are closed */
+   LIST_FOR_EACH_ENTRY_SAFE(worker, tmp, &server.idle_workers, head) {
+      close(worker->channel);
+      free(worker);
+   }
+   list_inithead(&server.idle_workers);
+   server.idle_worker_count = 0;
+}
+
 static pid_t vtest_server_fork(void)
 {
    pid_t pid = fork();
@@ -517,6 +1111,11 @@ static pid_t vtest_server_fork(void)
       /* child */
       vtest_server_set_signal_segv();
       vtest_server_close_socket();
+      vtest_server_close_workers();
+      server.prefork_count = 0;
+      /* the epoll instance would be shared with the parent */
+      vtest_server_close_epoll();
+      vtest_server_init_epoll();
       server.main_server = false;
       server.do_fork = false;
       server.loop = false;
@@ -526,11 +1125,172 @@ static pid_t vtest_server_fork(void)
    return pid;
 }
 
+static int vtest_server_receive_client_fd(int channel)
+{
+   char buf[CMSG_SPACE(sizeof(int))];
+   struct iovec iov;
+   struct msghdr msgh = { 0 };
+   struct cmsghdr *cmsg;
+   char c;
+   int fd;
+
+   iov.iov_base = &c;
+   iov.iov_len = sizeof(c);
+
+   msgh.msg_iov = &iov;
+   msgh.msg_iovlen = 1;
+   msgh.msg_control = buf;
+   msgh.msg_controllen = sizeof(buf);
+
+   if (recvmsg(channel, &msgh, MSG_CMSG_CLOEXEC) <= 0) {
+      return -1;
+   }
+
+   cmsg = CMSG_FIRSTHDR(&msgh);
+   if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+       cmsg->cmsg_type != SCM_RIGHTS ||
+       cmsg->cmsg_len != CMSG_LEN(sizeof(int))) {
+      return -1;
+   }
+
+   memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+
+   return fd;
+}
+
+static bool vtest_server_send_client_fd(int channel, int fd)
+{
+   char buf[CMSG_SPACE(sizeof(int))];
+   struct iovec iov;
+   struct msghdr msgh = { 0 };
+   struct cmsghdr *cmsg;
+   char c = 0;
+
+   memset(buf, 0, sizeof(buf));
+
+   iov.iov_base = &c;
+   iov.iov_len = sizeof(c);
+
+   msgh.msg_iov = &iov;
+   msgh.msg_iovlen = 1;
+   msgh.msg_control = buf;
+   msgh.msg_controllen = sizeof(buf);
+
+   cmsg = CMSG_FIRSTHDR(&msgh);
+   cmsg->cmsg_level = SOL_SOCKET;
+   cmsg->cmsg_type = SCM_RIGHTS;
+   cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+   memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+
+   /* the worker might have died */
+   return sendmsg(channel, &msgh, MSG_NOSIGNAL) == sizeof(c);
+}
+
+/* called in a freshly forked worker */
+static void vtest_server_start_worker(int channel)
+{
+   int fd;
+
+   /* this is what makes the first command of the client fast */
+   if (vtest_init_renderer(server.multi_clients,
+                           server.threads,
+                           server.ctx_flags,
+                           server.render_device)) {
+      exit(1);
+   }
+   server.renderer_initialized = true;
+   vtest_trace_open();
+
+   /* the parent closes the channel without a client when it exits */
+   fd = vtest_server_receive_client_fd(channel);
+   close(channel);
+   if (fd < 0) {
+      exit(0);
+   }
+
+   if (vtest_server_add_client(fd, fd)) {
+      perror("Failed to add client.");
+      exit(1);
+   }
+}
+
+static void vtest_server_fill_worker_pool(void)
+{
+   while (server.idle_worker_count < server.prefork_count) {
+      struct vtest_worker *worker;
+      int fds[2];
+      pid_t pid;
+
+      worker = calloc(1, sizeof(*worker));
+      if (!worker) {
+         return;
+      }
+
+      if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds)) {
+         perror("Failed to create worker channel");
+         free(worker);
+         return;
+      }
+
+      pid = vtest_server_fork();
+      if (pid < 0) {
+         perror("Failed to fork worker");
+         close(fds[0]);
+         close(fds[1]);
+         free(worker);
+         return;
+      }
+
+      if (!pid) {
+         /* worker: wait for a client and serve it like a forked child */
+         free(worker);
+         close(fds[0]);
+         vtest_server_start_worker(fds[1]);
+         return;
+      }
+
+      close(fds[1]);
+      worker->channel = fds[0];
+      list_addtail(&worker->head, &server.idle_workers);
+      server.idle_worker_count++;
+   }
+}
+
+static bool vtest_server_hand_off_client(struct vtest_client *client)
+{
+   while (!LIST_IS_EMPTY(&server.idle_workers)) {
+      struct vtest_worker *worker =
+         LIST_ENTRY(struct vtest_worker, server.idle_workers.next, head);
+      bool sent;
+
+      sent = vtest_server_send_client_fd(worker->channel, client->in_fd);
+
+      /* a worker serves at most one client */
+      list_del(&worker->head);
+      server.idle_worker_count--;
+      close(worker->channel);
+      free(worker);
+
+      if (sent) {
+         return true;
+      }
+   }
+
+   return false;
+}
+
 static void vtest_server_fork_clients(void)
 {
    struct vtest_client *client, *tmp;
 
    LIST_FOR_EACH_ENTRY_SAFE(client, tmp, &server.new_clients, head) {
+      if (vtest_server_hand_off_client(client)) {
+         /* parent: the worker owns the client now */
+         list_del(&client->head);
+         list_addtail(&client->head, &server.inactive_clients);
+         continue;
+      }
+
       if (vtest_server_fork()) {
          /* parent: move new clients to the inactive list */
          list_del(&client->head);
@@ -539,6 +1299,7 @@ static void vtest_server_fork_clients(void)
          /* child: move the first new client to the active list */
          list_del(&client->head);
          list_addtail(&client->head, &server.active_clients);
+         vtest_server_watch_client(client);
 
          /* move the rest new clients to the inactive list */
          LIST_FOR_EACH_ENTRY_SAFE(client, tmp, &server.new_clients, head) {
@@ -556,6 +1317,9 @@ static void vtest_server_activate_clients(void)
    /* move new clients to the active list */
    LIST_FOR_EACH_ENTRY_SAFE(client, tmp, &server.new_clients, head) {
       list_addtail(&client->head, &server.active_clients);
+      /* client threads read their in_fds directly */
+      if (!server.threads)
+         vtest_server_watch_client(client);
    }
    list_inithead(&server.new_clients);
 }
@@ -566,6 +1330,7 @@ static void vtest_server_inactivate_clients(void)
 
    /* move active clients to the inactive list */
    LIST_FOR_EACH_ENTRY_SAFE(client, tmp, &server.active_clients, head) {
+      vtest_server_unwatch_client(client);
       list_addtail(&client->head, &server.inactive_clients);
    }
    list_inithead(&server.active_clients);
@@ -576,8 +1341,23 @@ static void vtest_server_tidy_clients(void)
    struct vtest_client *client, *tmp;
 
    LIST_FOR_EACH_ENTRY_SAFE(client, tmp, &server.inactive_clients, head) {
+      if (client->thread_started) {
+         pthread_join(client->thread, NULL);
+      }
+
       if (client->context) {
+         vtest_server_report_client_stats(client);
+
+         if (vtest_trace_is_enabled()) {
+            vtest_trace_write(VTEST_TRACE_RECORD_CLIENT_END,
+                              vtest_get_context_id(client->context),
+                              NULL, 0, NULL, 0);
+         }
+
+         /* other client threads may still be running */
+         vtest_lock_renderer();
          vtest_destroy_context(client->context);
+         vtest_unlock_renderer();
       }
 
       if (client->in_fd >= 0) {
@@ -588,6 +1368,8 @@ static void vtest_server_tidy_clients(void)
          close(client->out_fd);
       }
 
+      vtest_fini_read_buffer(&client->in_buffer);
+      free(client->trace_data);
       free(client);
    }
 
@@ -598,6 +1380,11 @@ static void vtest_server_run(void)
 {
    bool run = true;
 
+   vtest_server_init_epoll();
+   if (server.threads) {
+      vtest_server_init_threads();
+   }
+
    if (server.read_file) {
       vtest_server_open_read_file();
    } else {
@@ -605,11 +1392,22 @@ static void vtest_server_run(void)
    }
 
    while (run) {
-      const bool was_empty = LIST_IS_EMPTY(&server.active_clients);
+      bool was_empty;
       bool is_empty;
 
+      /* workers return from here with their clients added */
+      if (server.do_fork && server.prefork_count) {
+         vtest_server_fill_worker_pool();
+      }
+
+      was_empty = LIST_IS_EMPTY(&server.active_clients);
+
       vtest_server_wait_clients();
-      vtest_server_dispatch_clients();
+      if (server.threads) {
+         vtest_server_dispatch_threaded_clients();
+      } else {
+         vtest_server_dispatch_clients();
+      }
 
       if (server.do_fork) {
          vtest_server_fork_clients();
@@ -619,21 +1417,32 @@ static void vtest_server_run(void)
 
       /* init renderer after the first active client is added */
       is_empty = LIST_IS_EMPTY(&server.active_clients);
-      if (was_empty && !is_empty) {
+      if (was_empty && !is_empty && !server.renderer_initialized) {
          int ret = vtest_init_renderer(server.multi_clients,
+                                       server.threads,
                                        server.ctx_flags,
                                        server.render_device);
          if (ret) {
             vtest_server_inactivate_clients();
             run = false;
+         } else {
+            server.renderer_initialized = true;
+            vtest_trace_open();
          }
       }
 
+      /* client threads need the renderer */
+      if (server.threads && run) {
+         vtest_server_start_client_threads();
+      }
+
       vtest_server_tidy_clients();
 
       /* clean up renderer after the last active client is removed */
       if (!was_empty && is_empty) {
+         vtest_trace_close();
          vtest_cleanup_renderer();
+         server.renderer_initialized = false;
          if (!server.loop) {
             run = false;
          }
@@ -641,6 +1450,9 @@ static void vtest_server_run(void)
    }
 
    vtest_server_close_socket();
+   vtest_server_close_workers();
+   vtest_server_fini_threads();
+   vtest_server_close_epoll();
 }
 
 static const struct vtest_command {
@@ -678,19 +1490,28 @@ static const struct vtest_command {
    [VCMD_SYNC_WRITE]            = { vtest_sync_write,            true },
    [VCMD_SYNC_WAIT]             = { vtest_sync_wait,             true },
    [VCMD_SUBMIT_CMD2]           = { vtest_submit_cmd2,           true },
+   [VCMD_TRANSFER_SHM_CREATE]   = { vtest_transfer_shm_create,   true },
+   [VCMD_TRANSFER_SHM_GET]      = { vtest_transfer_shm_get,      true },
+   [VCMD_TRANSFER_SHM_PUT]      = { vtest_transfer_shm_put,      true },
 };
 
 static int vtest_client_dispatch_commands(struct vtest_client *client)
 {
    const struct vtest_command *cmd;
+   uint64_t begin;
    int ret;
    uint32_t header[VTEST_HDR_SIZE];
 
+   /* drop the input of a failed command */
+   client->trace_size = 0;
+
    ret = client->input.read(&client->input, &header, sizeof(header));
    if (ret < 0 || (size_t)ret < sizeof(header)) {
       return VTEST_CLIENT_ERROR_INPUT_READ;
    }
 
+   begin = vtest_trace_now();
+
    if (!client->context) {
       /* The first command MUST be VCMD_CREATE_RENDERER */
       if (header[1] != VCMD_CREATE_RENDERER) {
@@ -705,6 +1526,12 @@ static int vtest_client_dispatch_commands(struct vtest_client *client)
       printf("%s: client context created.\n", __func__);
       vtest_poll_resource_busy_wait();
 
+      /* polled on every wakeup until it has a poll fd */
+      list_addtail(&client->poll_head, &server.poll_clients);
+
+      vtest_client_count_command(client, VCMD_CREATE_RENDERER, begin);
+      vtest_client_trace_command(client);
+
       return 0;
    }
 
@@ -724,7 +1551,11 @@ static int vtest_client_dispatch_commands(struct vtest_client *client)
       if (ret) {
          return VTEST_CLIENT_ERROR_CONTEXT_FAILED;
       }
-      client->context_poll_fd = vtest_get_context_poll_fd(client->context);
+      if (client->context_poll_fd < 0) {
+         client->context_poll_fd = vtest_get_context_poll_fd(client->context);
+         if (client->context_poll_fd >= 0)
+            vtest_server_watch_context(client);
+      }
    }
 
    vtest_set_current_context(client->context);
@@ -734,6 +1565,9 @@ static int vtest_client_dispatch_commands(struct vtest_client *client)
       return VTEST_CLIENT_ERROR_COMMAND_DISPATCH;
    }
 
+   vtest_client_count_command(client, header[1], begin);
+   vtest_client_trace_command(client);
+
    return 0;
 }
 
@@ -744,3 +1578,309 @@ static void vtest_server_close_socket(void)
       server.socket = -1;
    }
 }
+
+/* replies are not checked; drain them, and close the fds that come along */
+static void *vtest_server_replay_drain(void *arg)
+{
+   int fd = (int)(intptr_t)arg;
+   char buf[4096];
+   char cmsg_buf[CMSG_SPACE(sizeof(int) * 16)];
+
+   while (true) {
+      struct iovec iov = {
+         .iov_base = buf,
+         .iov_len = sizeof(buf),
+      };
+      struct msghdr msg = {
+         .msg_iov = &iov,
+         .msg_iovlen = 1,
+         .msg_control = cmsg_buf,
+         .msg_controllen = sizeof(cmsg_buf),
+      };
+      struct cmsghdr *cmsg;
+      ssize_t ret;
+
+      ret = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+      if (ret < 0 && errno == EINTR)
+         continue;
+      if (ret <= 0)
+         break;
+
+      for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+         if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            const int *fds = (const int *)CMSG_DATA(cmsg);
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            size_t i;
+
+            for (i = 0; i < count; i++)
+               close(fds[i]);
+         }
+      }
+   }
+
+   return NULL;
+}
+
+static struct vtest_client *vtest_server_replay_client(uint32_t replay_id,
+                                                       int out_fd)
+{
+   struct vtest_client *client;
+
+   LIST_FOR_EACH_ENTRY(client, &server.active_clients, head) {
+      if (client->replay_id == replay_id)
+         return client;
+   }
+
+   client = calloc(1, sizeof(*client));
+   if (!client)
+      return NULL;
+
+   client->in_fd = -1;
+   client->out_fd = out_fd;
+   client->in_fd_always_ready = true;
+   client->replay_id = replay_id;
+   client->stats.begin = vtest_trace_now();
+
+   client->input.data.buffer = &client->replay_buffer;
+   client->input.read = vtest_buf_read;
+
+   client->context_source.type = VTEST_EVENT_CONTEXT_POLL;
+   client->context_source.client = client;
+   client->context_poll_fd = -1;
+
+   list_inithead(&client->ready_head);
+   list_inithead(&client->poll_head);
+
+   list_addtail(&client->head, &server.active_clients);
+
+   return client;
+}
+
+static void vtest_server_replay_destroy_client(struct vtest_client *client)
+{
+   vtest_server_unwatch_client(client);
+   if (client->context) {
+      vtest_server_report_client_stats(client);
+      vtest_destroy_context(client->context);
+   }
+   list_del(&client->head);
+   free(client);
+}
+
+static bool vtest_server_replay_record(const struct vtest_trace_reader *trace,
+                                       size_t index,
+                                       int out_fd,
+                                       bool *frame_end)
+{
+   struct vtest_trace_record record;
+   const char *payload;
+   struct vtest_client *client;
+   int err;
+
+   payload = vtest_trace_get_record(trace, index, &record);
+
+   switch (record.type) {
+   case VTEST_TRACE_RECORD_COMMAND: {
+      uint32_t header[VTEST_HDR_SIZE];
+
+      if (record.size < sizeof(header))
+         break;
+      memcpy(header, payload, sizeof(header));
+
+      client = vtest_server_replay_client(record.client_id, out_fd);
+      if (!client)
+         return false;
+
+      client->replay_buffer.buffer = payload;
+      client->replay_buffer.size = record.size;
+
+      err = vtest_client_dispatch_commands(client);
+      if (err) {
+         fprintf(stderr, "record %zu failed: %s\n", index,
+                 vtest_client_error_string(err));
+         return false;
+      }
+      if (client->replay_buffer.size) {
+         fprintf(stderr, "record %zu has %d unused bytes\n", index,
+                 client->replay_buffer.size);
+      }
+
+      /* a client waiting for its rendering ends a frame */
+      if (header[1] == VCMD_RESOURCE_BUSY_WAIT &&
+          header[0] == VCMD_BUSY_WAIT_SIZE &&
+          record.size >= sizeof(header) + VCMD_BUSY_WAIT_SIZE * 4) {
+         uint32_t args[VCMD_BUSY_WAIT_SIZE];
+
+         memcpy(args, payload + sizeof(header), sizeof(args));
+         if (args[VCMD_BUSY_WAIT_FLAGS] & VCMD_BUSY_WAIT_FLAG_WAIT)
+            *frame_end = true;
+      }
+
+      if (client->context)
+         vtest_poll_context(client->context);
+      break;
+   }
+   case VTEST_TRACE_RECORD_SHM: {
+      struct vtest_trace_shm shm;
+
+      if (record.size < sizeof(shm))
+         break;
+      memcpy(&shm, payload, sizeof(shm));
+
+      LIST_FOR_EACH_ENTRY(client, &server.active_clients, head) {
+         if (client->replay_id == record.client_id && client->context) {
+            vtest_replay_shm(client->context, shm.res_handle, shm.offset,
+                             payload + sizeof(shm), record.size - sizeof(shm));
+            break;
+         }
+      }
+      break;
+   }
+   case VTEST_TRACE_RECORD_CLIENT_END:
+      LIST_FOR_EACH_ENTRY(client, &server.active_clients, head) {
+         if (client->replay_id == record.client_id) {
+            vtest_server_replay_destroy_client(client);
+            break;
+         }
+      }
+      break;
+   default:
+      fprintf(stderr, "ignoring unknown trace record %u\n", record.type);
+      break;
+   }
+
+   return true;
+}
+
+static int vtest_server_compare_u64(const void *a, const void *b)
+{
+   const uint64_t va = *(const uint64_t *)a;
+   const uint64_t vb = *(const uint64_t *)b;
+
+   return va < vb ? -1 : va > vb;
+}
+
+static void vtest_server_print_frame_times(uint64_t *frame_times, size_t count)
+{
+   static const int percentiles[] = { 50, 90, 99, 100 };
+   size_t i;
+
+   if (!count) {
+      printf("no frames\n");
+      return;
+   }
+
+   qsort(frame_times, count, sizeof(*frame_times), vtest_server_compare_u64);
+
+   printf("%zu frames:", count);
+   for (i = 0; i < ARRAY_SIZE(percentiles); i++) {
+      /* nearest rank */
+      size_t rank = (count * percentiles[i] + 99) / 100;
+      uint64_t ns = frame_times[MAX2(rank, 1) - 1];
+
+      if (percentiles[i] == 100)
+         printf(" max %.3f ms", ns / 1e6);
+      else
+         printf(" p%d %.3f ms", percentiles[i], ns / 1e6);
+   }
+   printf("\n");
+}
+
+static void vtest_server_replay(void)
+{
+   struct vtest_trace_reader trace = { 0 };
+   uint64_t *frame_times = NULL;
+   size_t frame_count = 0;
+   size_t frame_capacity = 0;
+   pthread_t drain_thread;
+   int fds[2];
+   int loop;
+
+   if (!vtest_trace_load(&trace, server.replay_file)) {
+      vtest_trace_unload(&trace);
+      exit(EXIT_FAILURE);
+   }
+
+   if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds)) {
+      perror("Failed to create socket pair");
+      exit(EXIT_FAILURE);
+   }
+   if (pthread_create(&drain_thread, NULL, vtest_server_replay_drain,
+                      (void *)(intptr_t)fds[1])) {
+      fprintf(stderr, "Failed to create drain thread\n");
+      exit(EXIT_FAILURE);
+   }
+
+   vtest_server_init_epoll();
+
+   for (loop = 0; loop < server.replay_loops; loop++) {
+      struct vtest_client *client, *tmp;
+      uint64_t begin, frame_begin, end;
+      size_t replayed = 0;
+      size_t i;
+
+      /* resource and context ids only match the trace with a fresh renderer */
+      if (vtest_init_renderer(false, false, server.ctx_flags,
+                              server.render_device)) {
+         fprintf(stderr, "Failed to init renderer\n");
+         break;
+      }
+
+      begin = vtest_trace_now();
+      frame_begin = begin;
+
+      for (i = 0; i < trace.record_count; i++) {
+         bool frame_end = false;
+
+         if (!vtest_server_replay_record(&trace, i, fds[0], &frame_end))
+            break;
+         replayed++;
+
+         if (frame_end) {
+            uint64_t now = vtest_trace_now();
+
+            if (frame_count == frame_capacity) {
+               uint64_t *times;
+
+               frame_capacity = MAX2(frame_capacity * 2, 1024);
+               times = realloc(frame_times,
+                               frame_capacity * sizeof(*frame_times));
+               if (!times) {
+                  fprintf(stderr, "out of memory\n");
+                  exit(EXIT_FAILURE);
+               }
+               frame_times = times;
+            }
+
+            frame_times[frame_count++] = now - frame_begin;
+            frame_begin = now;
+         }
+      }
+
+      end = vtest_trace_now();
+      printf("loop %d: %zu records in %.3f ms, %.0f records/s\n", loop,
+             replayed, (end - begin) / 1e6,
+             end > begin ? replayed * 1e9 / (end - begin) : 0.0);
+
+      LIST_FOR_EACH_ENTRY_SAFE(client, tmp, &server.active_clients, head) {
+         vtest_server_replay_destroy_client(client);
+      }
+
+      vtest_cleanup_renderer();
+
+      if (i < trace.record_count)
+         break;
+   }
+
+   vtest_server_print_frame_times(frame_times, frame_count);
+
+   vtest_server_close_epoll();
+
+   /* stop the drain thread */
+   close(fds[0]);
+   pthread_join(drain_thread, NULL);
+   close(fds[1]);
+
+   free(frame_times);
+   vtest_trace_unload(&trace);
+}
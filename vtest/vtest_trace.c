@@ -0,0 +1,250 @@
+/**************************************************************************
+ *
+ * Copyright (C) 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#include "vtest_trace.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static struct {
+   bool enabled;
+
+   pthread_mutex_t mutex;
+   FILE *file;
+   uint64_t seqno;
+} trace = {
+   .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+uint64_t vtest_trace_now(void)
+{
+   const uint64_t ns_per_sec = 1000000000llu;
+   struct timespec now;
+
+   if (clock_gettime(CLOCK_MONOTONIC, &now))
+      return 0;
+
+   return ns_per_sec * now.tv_sec + now.tv_nsec;
+}
+
+void vtest_trace_open(void)
+{
+   static unsigned session;
+   const char *path = getenv("VTEST_TRACE");
+   const struct vtest_trace_header header = {
+      .magic = VTEST_TRACE_MAGIC,
+      .version = VTEST_TRACE_VERSION,
+   };
+   char filename[1024];
+   FILE *file;
+
+   if (!path || !*path || trace.file)
+      return;
+
+   /* there is a process per client in fork mode and the renderer can be
+    * initialized more than once per process otherwise
+    */
+   snprintf(filename, sizeof(filename), "%s.%d.%u", path, (int)getpid(),
+            session++);
+
+   file = fopen(filename, "wbe");
+   if (!file) {
+      fprintf(stderr, "failed to open trace file %s\n", filename);
+      return;
+   }
+
+   if (fwrite(&header, sizeof(header), 1, file) != 1) {
+      fprintf(stderr, "failed to write trace file %s\n", filename);
+      fclose(file);
+      return;
+   }
+
+   trace.file = file;
+   trace.seqno = 0;
+   trace.enabled = true;
+
+   printf("tracing to %s\n", filename);
+}
+
+void vtest_trace_close(void)
+{
+   if (!trace.file)
+      return;
+
+   fclose(trace.file);
+
+   trace.file = NULL;
+   trace.enabled = false;
+}
+
+bool vtest_trace_is_enabled(void)
+{
+   return trace.enabled;
+}
+
+void vtest_trace_write(enum vtest_trace_record_type type,
+                       uint32_t client_id,
+                       const void *info,
+                       size_t info_size,
+                       const void *data,
+                       size_t data_size)
+{
+   struct vtest_trace_record record = {
+      .type = type,
+      .client_id = client_id,
+      .timestamp = vtest_trace_now(),
+      .size = info_size + data_size,
+   };
+   bool ok;
+
+   if (!trace.enabled)
+      return;
+
+   pthread_mutex_lock(&trace.mutex);
+
+   /* check again in case a concurrent write has failed */
+   if (!trace.enabled) {
+      pthread_mutex_unlock(&trace.mutex);
+      return;
+   }
+
+   record.seqno = trace.seqno++;
+
+   ok = fwrite(&record, sizeof(record), 1, trace.file) == 1;
+   if (ok && info_size)
+      ok = fwrite(info, info_size, 1, trace.file) == 1;
+   if (ok && data_size)
+      ok = fwrite(data, data_size, 1, trace.file) == 1;
+
+   if (!ok) {
+      /* a truncated record makes the rest of the file useless */
+      fprintf(stderr, "failed to write trace record; tracing stopped\n");
+      trace.enabled = false;
+   }
+
+   pthread_mutex_unlock(&trace.mutex);
+}
+
+bool vtest_trace_load(struct vtest_trace_reader *reader, const char *path)
+{
+   struct vtest_trace_header header;
+   struct stat st;
+   size_t capacity = 0;
+   size_t offset;
+   void *data;
+   int fd;
+
+   fd = open(path, O_RDONLY | O_CLOEXEC);
+   if (fd < 0 || fstat(fd, &st)) {
+      perror("Failed to open trace");
+      if (fd >= 0)
+         close(fd);
+      return false;
+   }
+
+   if ((size_t)st.st_size < sizeof(header)) {
+      fprintf(stderr, "%s is not a vtest trace\n", path);
+      close(fd);
+      return false;
+   }
+
+   data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (data == MAP_FAILED) {
+      perror("Failed to map trace");
+      return false;
+   }
+
+   reader->data = data;
+   reader->size = st.st_size;
+
+   memcpy(&header, reader->data, sizeof(header));
+   if (header.magic != VTEST_TRACE_MAGIC ||
+       header.version != VTEST_TRACE_VERSION) {
+      fprintf(stderr, "%s is not a vtest trace\n", path);
+      return false;
+   }
+
+   /* index the records once such that looping over them is cheap */
+   offset = sizeof(header);
+   while (offset < reader->size) {
+      struct vtest_trace_record record;
+
+      if (reader->size - offset < sizeof(record)) {
+         fprintf(stderr, "ignoring truncated trace record\n");
+         break;
+      }
+
+      /* records are not aligned */
+      memcpy(&record, reader->data + offset, sizeof(record));
+      if (record.size > reader->size - offset - sizeof(record)) {
+         fprintf(stderr, "ignoring truncated trace record\n");
+         break;
+      }
+
+      if (reader->record_count == capacity) {
+         size_t *records;
+
+         capacity = capacity ? capacity * 2 : 1024;
+         records = realloc(reader->records, capacity * sizeof(*records));
+         if (!records) {
+            fprintf(stderr, "out of memory\n");
+            return false;
+         }
+         reader->records = records;
+      }
+
+      reader->records[reader->record_count++] = offset;
+      offset += sizeof(record) + record.size;
+   }
+
+   return true;
+}
+
+void vtest_trace_unload(struct vtest_trace_reader *reader)
+{
+   if (reader->data)
+      munmap((void *)reader->data, reader->size);
+   free(reader->records);
+
+   memset(reader, 0, sizeof(*reader));
+}
+
+const void *vtest_trace_get_record(const struct vtest_trace_reader *reader,
+                                   size_t index,
+                                   struct vtest_trace_record *record)
+{
+   const char *ptr = reader->data + reader->records[index];
+
+   memcpy(record, ptr, sizeof(*record));
+
+   return ptr + sizeof(*record);
+}
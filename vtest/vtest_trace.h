@@ -0,0 +1,111 @@
+/**************************************************************************
+ *
+ * Copyright (C) 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#ifndef VTEST_TRACE_H
+#define VTEST_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* When VTEST_TRACE is set to a path, every renderer session is recorded to
+ * "<path>.<pid>.<n>" and can be replayed with "virgl_test_server --replay".
+ *
+ * A trace file is a vtest_trace_header followed by records.  Each record is a
+ * vtest_trace_record followed by size bytes of payload.  Records are numbered
+ * by seqno, such that the replayer can index them once and loop over them
+ * cheaply.  All fields are in host byte order.
+ *
+ * Commands are recorded after they have been dispatched successfully, and
+ * are replayed in the recorded order no matter which client sent them.
+ * Client-written shared memory that a command consumes is recorded while the
+ * command is dispatched, and thus right before the command.
+ */
+
+#define VTEST_TRACE_MAGIC 0x52545456u /* "VTTR" */
+#define VTEST_TRACE_VERSION 1
+
+enum vtest_trace_record_type {
+   /* the command as read from the client, header included */
+   VTEST_TRACE_RECORD_COMMAND = 1,
+   /* vtest_trace_shm followed by the data */
+   VTEST_TRACE_RECORD_SHM = 2,
+   /* the client has gone away; no payload */
+   VTEST_TRACE_RECORD_CLIENT_END = 3,
+};
+
+struct vtest_trace_header {
+   uint32_t magic;
+   uint32_t version;
+};
+
+struct vtest_trace_record {
+   uint32_t type;
+   /* the id of the context of the client */
+   uint32_t client_id;
+   uint64_t seqno;
+   /* CLOCK_MONOTONIC */
+   uint64_t timestamp;
+   uint64_t size;
+};
+
+struct vtest_trace_shm {
+   /* 0 for the transfer shm of the context */
+   uint32_t res_handle;
+   uint32_t padding;
+   uint64_t offset;
+};
+
+void vtest_trace_open(void);
+void vtest_trace_close(void);
+
+bool vtest_trace_is_enabled(void);
+
+void vtest_trace_write(enum vtest_trace_record_type type,
+                       uint32_t client_id,
+                       const void *info,
+                       size_t info_size,
+                       const void *data,
+                       size_t data_size);
+
+uint64_t vtest_trace_now(void);
+
+/* a trace file mapped for replay, with the offsets of its complete records */
+struct vtest_trace_reader {
+   const char *data;
+   size_t size;
+
+   size_t *records;
+   size_t record_count;
+};
+
+bool vtest_trace_load(struct vtest_trace_reader *reader, const char *path);
+void vtest_trace_unload(struct vtest_trace_reader *reader);
+
+/* returns the payload of the record */
+const void *vtest_trace_get_record(const struct vtest_trace_reader *reader,
+                                   size_t index,
+                                   struct vtest_trace_record *record);
+
+#endif /* VTEST_TRACE_H */